@@ -27,6 +27,11 @@
 /** The number of bits in the Immediate field of an instruction. */
 #define ISA_INSTRUCTION_IMMEDIATE_SIZE 16
 
+/** The number of distinct opcode values (Funct and Format fields together). */
+#define ISA_NUM_OPCODES   (1U << (ISA_INSTRUCTION_FUNCT_SIZE + ISA_INSTRUCTION_FORMAT_SIZE))
+/** The number of distinct register indices. */
+#define ISA_NUM_REGISTERS (1U << ISA_INSTRUCTION_REGISTER_SIZE)
+
 /** Bitmask for the Format field of an instruction. */
 #define ISA_INSTRUCTION_FORMAT_MASK ((1U << ISA_INSTRUCTION_FORMAT_SIZE) - 1U)
 
@@ -228,6 +233,17 @@ struct isa_opcode_map {
 const struct isa_register_map *isa_get_register_map_from_symbol(const char *symbol);
 
 
+/**
+ * Gets a register mapping from a register's symbolic name that is not null terminated.
+ *
+ * @param text    The characters of the symbolic name (ABI or raw).
+ * @param length  The number of characters in the symbolic name.
+ *
+ * @return The register mapping for the provided symbolic name.
+ */
+const struct isa_register_map *isa_get_register_map_from_text(const char *text, size_t length);
+
+
 /**
  * Gets a register mapping from a register's binary index.
  *
@@ -250,6 +266,18 @@ const struct isa_register_map *isa_get_register_map_from_index(enum isa_register
 const struct isa_opcode_map *isa_get_opcode_map_from_symbol(const char *symbol);
 
 
+/**
+ * Gets an opcode mapping from an opcode's symbolic name that is not null terminated.
+ *
+ * @param text    The characters of the symbolic name (which can be a pseudo-opcode).
+ * @param length  The number of characters in the symbolic name.
+ *
+ * @return The opcode mapping for the provided symbolic name, as with
+ *         isa_get_opcode_map_from_symbol.
+ */
+const struct isa_opcode_map *isa_get_opcode_map_from_text(const char *text, size_t length);
+
+
 /**
  * Gets an opcode mapping from an opcode's binary value.
  *
@@ -9,13 +9,17 @@
 #define _ASSEMBLER_ENCODER_H_
 
 
-/** The maximum number of symbolic labels that may be defined. */
-#define ENCODER_MAX_LABELS 1024
+/** The number of zero bytes shared by all gaps when an image is written. */
+#define ENCODER_ZERO_BLOCK_SIZE 4096
 
 
+#include "assembler/object.h"
 #include "assembler/parser.h"
-#include "structures/list.h"
+#include "structures/intern_pool.h"
+#include "structures/vector.h"
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 
 
 /**
@@ -27,34 +31,192 @@ enum encoder_status {
     /** The encoder encountered an undefined label. */
     ENCODER_STATUS_UNKNOWN_LABEL,
     /** The encoder encountered an unexpected semantic group. */
-    ENCODER_STATUS_UNEXPECTED_GROUP
+    ENCODER_STATUS_UNEXPECTED_GROUP,
+    /** The encoder could not allocate memory for its label table or fixups. */
+    ENCODER_STATUS_OUT_OF_MEMORY
 };
 
 
 /**
- * Encodes the provided list of parser token groups into machine code.
+ * A run of contiguous bytes in an encoded image.
+ */
+struct encoder_segment {
+    /** The address of the first byte of the segment in the image. */
+    uint32_t address;
+    /** The offset of the first byte of the segment in the image data. */
+    uint32_t offset;
+    /** The number of bytes in the segment. */
+    uint32_t length;
+};
+
+
+/**
+ * The machine code produced by the encoder.
+ *
+ * Only bytes that were emitted are stored. Gaps left by .org directives are implicitly zero and
+ * take no memory; they are only produced when the image is written.
+ */
+struct encoder_image {
+    /** The bytes of every segment, back to back (uint8_t elements). */
+    struct vector *data;
+    /** The segments of the image in increasing address order (struct encoder_segment elements). */
+    struct vector *segments;
+    /** The address that the next emitted byte will be placed at. */
+    uint32_t position;
+    /** The high-water mark of the image, which is the size of the image when it is written. */
+    uint32_t size;
+};
+
+
+/**
+ * A reference to a label that was not yet declared when the referencing group was encoded (or any
+ * reference to a label, when encoding an object).
+ */
+struct encoder_fixup {
+    /** The offset of the referencing field in the image data. */
+    uint32_t offset;
+    /** The ID of the label whose address is stored in the field. */
+    uint32_t label;
+    /** The field that holds the address. */
+    enum object_relocation_type type;
+};
+
+
+/**
+ * The state of the encoder while it encodes one stream of groups in a single pass.
+ *
+ * Each group is emitted into the image as soon as it is encoded. References to labels that are
+ * declared later are recorded as fixups and patched by encoder_finish.
+ */
+struct encoder_context {
+    /** The image being encoded. */
+    struct encoder_image *image;
+    /** The names of labels, indexed by label ID. */
+    const struct intern_pool *labels;
+    /** The address of each label declared so far, indexed by label ID (uint32_t elements). */
+    struct vector *addresses;
+    /** The forward label references to patch (struct encoder_fixup elements). */
+    struct vector *fixups;
+    /** Whether an object is being encoded, in which no label reference is resolved. */
+    bool relocatable;
+    /** The segment each label is declared in, indexed by label ID, if relocatable (uint32_t). */
+    struct vector *label_segments;
+};
+
+
+/**
+ * Creates a new encoder context and starts an empty image.
+ *
+ * @param labels      The names of labels, indexed by label ID, used to report errors.
+ * @param arena[in]   The arena to allocate the label table, fixups, and image from, or NULL to use
+ *                    the heap.
+ * @param image[out]  A pointer to the image to encode into. It is the caller's responsibility to
+ *                    free the image's vectors with destroy_vector, or by resetting the arena.
+ *
+ * @return Pointer to the created encoder context.
+ */
+struct encoder_context *create_encoder_context(const struct intern_pool *labels,
+                                               struct arena *arena,
+                                               struct encoder_image *image);
+
+
+/**
+ * Frees an encoder context created with create_encoder_context. The image is not freed.
+ *
+ * @param context  The encoder context to destroy.
+ */
+void destroy_encoder_context(struct encoder_context *context);
+
+
+/**
+ * Encodes an object rather than an image with later calls to encoder_encode_group.
+ *
+ * Every label reference becomes a fixup, and every .org directive starts a new segment of the image
+ * at its address. The first segment of the image (at address 0) is relocatable; the others are
+ * absolute. This must be called before any group is encoded.
+ *
+ * @param context  The encoder context to configure.
+ */
+void encoder_set_relocatable(struct encoder_context *context);
+
+
+/**
+ * Encodes the next semantic group of a program into the image.
+ *
+ * Label groups record the address of the label. Instruction and directive groups are emitted at
+ * the end of the image, with the Immediate field of any instruction that references a label not
+ * yet declared left to be patched by encoder_finish.
+ *
+ * @param context    The encoder context to use.
+ * @param group      The group to encode.
+ * @param directive  The operands of the group if it is a directive group, or NULL.
+ *
+ * @return The status of the encoding. If not SUCCESS, the encoder should not be called again.
+ */
+enum encoder_status encoder_encode_group(struct encoder_context *context,
+                                         const struct parser_group *group,
+                                         const struct parser_directive *directive);
+
+
+/**
+ * Patches every forward label reference once all groups have been encoded.
+ *
+ * @param context  The encoder context to finish.
+ *
+ * @return Whether encoding was successful. UNKNOWN_LABEL if a referenced label was never declared.
+ */
+enum encoder_status encoder_finish(struct encoder_context *context);
+
+
+/**
+ * Builds an object from a relocatable encoder context once all groups have been encoded.
+ *
+ * Each segment of the image becomes a section of the object, each label declared or referenced
+ * becomes a symbol, and each fixup becomes a relocation. Labels that are referenced but not
+ * declared are left for the linker to resolve.
+ *
+ * @param context      The encoder context, which must have been made relocatable.
+ * @param arena[in]    The arena to allocate the object's vectors from, or NULL to use the heap.
+ * @param object[out]  A pointer to return the object. Its section data and symbol names refer to
+ *                     the image and label names, which must outlive it.
+ *
+ * @return Whether the object was built.
+ */
+enum encoder_status encoder_finish_object(struct encoder_context *context,
+                                          struct arena *arena,
+                                          struct object *object);
+
+
+/**
+ * Encodes the groups of a parsed program into machine code.
+ *
+ * This is equivalent to passing each group of the program to encoder_encode_group in order, and
+ * then calling encoder_finish.
  *
- * Encoding is performed in two steps:
+ * @param program     The program to encode.
+ * @param arena[in]   The arena to allocate the label table and output from, or NULL to use the
+ *                    heap.
+ * @param image[out]  A pointer to return the encoded image. It is the caller's responsibility to
+ *                    free the image's vectors with destroy_vector, or by resetting the arena.
  *
- *   1) The encoder will find all groups in the provided list with the type PARSER_GROUP_LABEL.
- *      IMPORTANT: Label nodes will be REMOVED from the provided list by the encoder (and later
- *      freed by the encoder)--these nodes will not exist in the node list after encoding.
- *   2) The encoder will process the remaining PARSER_GROUP_INSTRUCTION nodes and set the
- *      .binary member of each node to the encoded binary. The .imm_num member of each parser group
- *      (within a node) may be set during label resolution/encoding.
+ * @return Whether encoding was successful. If SUCCESS, the encoded binary is stored in the image.
+ */
+enum encoder_status encoder_encode_program(const struct parser_program *program,
+                                           struct arena *arena,
+                                           struct encoder_image *image);
+
+
+/**
+ * Writes an encoded image to a file, including the zero bytes of any gaps.
  *
- * After encoding, the caller is still responsible for using the list API to free the nodes left
- * in the provided list.
+ * The file is written with as few writev calls as possible, bypassing the stdio buffer.
  *
- * @param groups[inout]  List of parser group nodes to encode. Groups will be popped from this list.
- * @param bytes[out]     A pointer to return a list of encoded bytes. It is the caller's
- *                       responsibility to free this list with the structures/list API. The bytes
- *                       themselves must be freed with the list_default_node_free_callback.
+ * @param image  The image to write.
+ * @param file   The file to write to, which must be open for writing in binary mode.
  *
- * @return Whether encoding was successful. If SUCCESS, the encoded binary can be read by traversing
- *         the bytes list. On error, the state/order of nodes in the groups list is not guaranteed.
+ * @return Whether the whole image was written.
  */
-enum encoder_status encoder_encode_groups(struct list *groups, struct list **bytes);
+bool encoder_write_image(const struct encoder_image *image, FILE *file);
 
 
 #endif  // _ASSEMBLER_ENCODER_H_
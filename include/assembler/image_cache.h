@@ -0,0 +1,155 @@
+/**
+ * A content-addressed cache of assembled images, shared by runs of the assembler on one machine.
+ *
+ * @author Jonathan Uhler
+ */
+
+
+#ifndef _ASSEMBLER_IMAGE_CACHE_H_
+#define _ASSEMBLER_IMAGE_CACHE_H_
+
+
+#include "structures/sha256.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** The deepest nesting of includes that is followed when a key is computed. */
+#define IMAGE_CACHE_MAX_INCLUDE_DEPTH 64
+/** The name of the file in the cache directory that holds the hit and miss counts. */
+#define IMAGE_CACHE_STATISTICS_FILE "statistics"
+
+
+/**
+ * A cache directory.
+ *
+ * Each image is stored in a file named after its key. Files are written under a temporary name and
+ * renamed into place, so concurrent runs never see a partial image.
+ */
+struct image_cache {
+    /** The path of the cache directory. */
+    char *directory;
+};
+
+
+/**
+ * The key that identifies an image in the cache.
+ */
+struct image_cache_key {
+    /** The digest of everything the image depends on. */
+    uint8_t digest[SHA256_DIGEST_SIZE];
+};
+
+
+/**
+ * Status of image cache API calls.
+ */
+enum image_cache_status {
+    /** The image cache API function completed successfully. */
+    IMAGE_CACHE_STATUS_SUCCESS = 0,
+    /** The image is not in the cache. */
+    IMAGE_CACHE_STATUS_MISS,
+    /** No key can be computed, because the input cannot be read or its includes nest too deeply. */
+    IMAGE_CACHE_STATUS_UNCACHEABLE,
+    /** The image cache API function did not complete because a file could not be accessed. */
+    IMAGE_CACHE_STATUS_IO_ERROR,
+    /** The image cache API function did not complete because it was called incorrectly. */
+    IMAGE_CACHE_STATUS_INVALID_ARGUMENT
+};
+
+
+/**
+ * Opens a cache directory, creating it if it does not exist.
+ *
+ * @param directory  The path of the cache directory.
+ *
+ * @return Pointer to the opened cache, or NULL if the directory cannot be created.
+ */
+struct image_cache *create_image_cache(const char *directory);
+
+
+/**
+ * Closes a cache opened with create_image_cache. The cached images are kept.
+ *
+ * @param cache  The image cache to close.
+ */
+void destroy_image_cache(struct image_cache *cache);
+
+
+/**
+ * Computes the key of the image assembled from a source file.
+ *
+ * The key is a hash of the assembler version, the options that change the output, the normalized
+ * text of the source file (with comments removed and whitespace collapsed, which does not change
+ * its tokens), and the normalized text of every file it includes, transitively. The includes are
+ * found by searching the normalized text, without lexing or parsing it.
+ *
+ * @param input_path    The path of the source file.
+ * @param options       The options of the run that change the output.
+ * @param options_size  The number of bytes of options.
+ * @param key[out]      A pointer to return the key.
+ *
+ * @return The status of the computation. UNCACHEABLE if the source file cannot be read or includes
+ *         nest more than IMAGE_CACHE_MAX_INCLUDE_DEPTH deep.
+ */
+enum image_cache_status image_cache_compute_key(const char *input_path,
+                                                const void *options,
+                                                size_t options_size,
+                                                struct image_cache_key *key);
+
+
+/**
+ * Copies a cached image to an output file.
+ *
+ * @param cache        The image cache.
+ * @param key          The key of the image.
+ * @param output_path  The path to write the image to.
+ *
+ * @return The status of the lookup. MISS if the image is not in the cache.
+ */
+enum image_cache_status image_cache_fetch(const struct image_cache *cache,
+                                          const struct image_cache_key *key,
+                                          const char *output_path);
+
+
+/**
+ * Copies an assembled image into the cache.
+ *
+ * @param cache        The image cache.
+ * @param key          The key of the image.
+ * @param output_path  The path of the assembled image.
+ *
+ * @return The status of the store.
+ */
+enum image_cache_status image_cache_store(const struct image_cache *cache,
+                                          const struct image_cache_key *key,
+                                          const char *output_path);
+
+
+/**
+ * Adds a hit or a miss to the statistics of a cache.
+ *
+ * @param cache  The image cache.
+ * @param hit    Whether the image was found in the cache.
+ *
+ * @return The status of the update.
+ */
+enum image_cache_status image_cache_record(const struct image_cache *cache, bool hit);
+
+
+/**
+ * Reads the statistics of a cache.
+ *
+ * @param cache        The image cache.
+ * @param hits[out]    A pointer to return the number of hits.
+ * @param misses[out]  A pointer to return the number of misses.
+ *
+ * @return The status of the read.
+ */
+enum image_cache_status image_cache_statistics(const struct image_cache *cache,
+                                               uint64_t *hits,
+                                               uint64_t *misses);
+
+
+#endif  // _ASSEMBLER_IMAGE_CACHE_H_
@@ -0,0 +1,190 @@
+/**
+ * A cache of the tokens of included files, which are lexed ahead of time by worker threads.
+ *
+ * @author Jonathan Uhler
+ */
+
+
+#ifndef _ASSEMBLER_INCLUDE_CACHE_H_
+#define _ASSEMBLER_INCLUDE_CACHE_H_
+
+
+#include "assembler/lexer.h"
+#include "structures/arena.h"
+#include "structures/hash_map.h"
+#include "structures/vector.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+
+/** The largest number of worker threads that lex included files ahead of time. */
+#define INCLUDE_CACHE_MAX_WORKERS 8
+
+
+/**
+ * The progress of lexing a file in the cache.
+ */
+enum include_cache_state {
+    /** The file is known, but has not been lexed or queued to be lexed. */
+    INCLUDE_CACHE_STATE_UNLOADED = 0,
+    /** The file is waiting for a worker to lex it. */
+    INCLUDE_CACHE_STATE_QUEUED,
+    /** The file is being lexed. */
+    INCLUDE_CACHE_STATE_LEXING,
+    /** The file was lexed and its tokens are in the cache. */
+    INCLUDE_CACHE_STATE_READY,
+    /** The file could not be lexed. */
+    INCLUDE_CACHE_STATE_FAILED
+};
+
+
+/**
+ * A file in the include cache.
+ */
+struct include_cache_entry {
+    /** The canonical path of the file, which is its key in the cache. */
+    char *path;
+    /** The path of the file as first written in an include, which its tokens are reported with. */
+    char *name;
+    /** The modification time of the file when it was lexed. */
+    struct timespec mtime;
+    /** The progress of lexing the file. */
+    enum include_cache_state state;
+    /** The arena that owns the text and tokens of the file (NULL until it is lexed). */
+    struct arena *arena;
+    /** The tokens of the file (struct lexer_token elements) if the file is READY. */
+    struct vector *tokens;
+    /** Whether the file was included (or is the file being assembled) in the current run. */
+    bool included;
+};
+
+
+/**
+ * A cache of the tokens of included files for one run of the assembler.
+ *
+ * Files are keyed by their canonical path, so different spellings of the same path share tokens,
+ * and are lexed again if their modification time changes. Includes discovered in the file being
+ * assembled, and in the files it includes, are queued to be lexed by worker threads before the
+ * parser reaches them.
+ */
+struct include_cache {
+    /** Protects every other field (except the constants set at creation). */
+    pthread_mutex_t lock;
+    /** Signaled when a file is queued or the workers should stop. */
+    pthread_cond_t job_queued;
+    /** Signaled when a file finishes lexing. */
+    pthread_cond_t job_done;
+    /** The files in the cache, by canonical path (struct include_cache_entry * values). */
+    struct hash_map *entries;
+    /** Every entry in the cache, to free them (struct include_cache_entry * elements). */
+    struct vector *all_entries;
+    /** The queue of files to lex (struct include_cache_entry * elements). */
+    struct vector *jobs;
+    /** The index in jobs of the next file to lex. */
+    uint32_t next_job;
+    /** The worker threads, started when the first file is queued. */
+    pthread_t *workers;
+    /** The largest number of worker threads to start. */
+    uint32_t max_workers;
+    /** The number of worker threads started. */
+    uint32_t num_workers;
+    /** Whether the workers should stop. */
+    bool stopping;
+    /** Whether each file is included at most once per run. */
+    bool once;
+    /** The scanner used to lex files. */
+    enum lexer_scanner scanner;
+    /** The lexer context used to lex files on the thread that requests them. */
+    struct lexer_context *lexer;
+    /** Arenas of files that were lexed again, kept because their tokens may still be in use. */
+    struct vector *retired_arenas;
+};
+
+
+/**
+ * Status of include cache API calls.
+ */
+enum include_cache_status {
+    /** The include cache API function completed successfully. */
+    INCLUDE_CACHE_STATUS_SUCCESS = 0,
+    /** The file was already included in this run and should be skipped. */
+    INCLUDE_CACHE_STATUS_SKIPPED,
+    /** The file does not exist or its path could not be resolved. */
+    INCLUDE_CACHE_STATUS_NOT_FOUND,
+    /** The file could not be lexed. */
+    INCLUDE_CACHE_STATUS_LEXER_ERROR,
+    /** The include cache API function did not complete because it was called incorrectly. */
+    INCLUDE_CACHE_STATUS_INVALID_ARGUMENT,
+    /** The include cache API function did not complete because the system is out of memory. */
+    INCLUDE_CACHE_STATUS_OUT_OF_MEMORY
+};
+
+
+/**
+ * Creates a new, empty include cache.
+ *
+ * @param max_workers  The largest number of worker threads that lex included files ahead of time,
+ *                     at most INCLUDE_CACHE_MAX_WORKERS. If 0, files are only lexed when they are
+ *                     requested.
+ * @param scanner      The scanner used to lex files.
+ * @param once         Whether each file is included at most once per run, with later includes of
+ *                     the same file skipped.
+ *
+ * @return Pointer to the created include cache.
+ */
+struct include_cache *create_include_cache(uint32_t max_workers,
+                                           enum lexer_scanner scanner,
+                                           bool once);
+
+
+/**
+ * Stops the workers of an include cache created with create_include_cache and frees it, including
+ * the tokens and text of every cached file.
+ *
+ * @param cache  The include cache to destroy.
+ */
+void destroy_include_cache(struct include_cache *cache);
+
+
+/**
+ * Starts a run of the assembler on a file.
+ *
+ * No file is marked as included except the file being assembled, and the includes in its text are
+ * queued to be lexed.
+ *
+ * @param cache          The include cache.
+ * @param file_name      The path to the file being assembled.
+ * @param source         The text of the file being assembled.
+ * @param source_length  The number of characters in the text.
+ */
+void include_cache_start_run(struct include_cache *cache,
+                             const char *file_name,
+                             const char *source,
+                             size_t source_length);
+
+
+/**
+ * Gets the tokens of an included file, lexing it first if no worker has done so.
+ *
+ * Only one thread may get files from a cache at a time.
+ *
+ * @param cache            The include cache.
+ * @param file_name        The path to the included file.
+ * @param tokens[out]      A pointer to return the tokens of the file, which remain valid until the
+ *                         cache is destroyed.
+ * @param num_tokens[out]  A pointer to return the number of tokens.
+ *
+ * @return The status of the lookup. SKIPPED if the cache includes each file once and the file was
+ *         already included. If NOT_FOUND or LEXER_ERROR, the file should be lexed directly so the
+ *         error is reported.
+ */
+enum include_cache_status include_cache_get(struct include_cache *cache,
+                                            const char *file_name,
+                                            const struct lexer_token **tokens,
+                                            uint32_t *num_tokens);
+
+
+#endif  // _ASSEMBLER_INCLUDE_CACHE_H_
@@ -9,13 +9,17 @@
 #define _ASSEMBLER_LEXER_H_
 
 
-#include "structures/list.h"
+#include "structures/arena.h"
+#include "structures/intern_pool.h"
+#include "structures/vector.h"
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 
-/** The maximum length (EXCLUDING the null terminator) for lexer tokens. */
+/** The maximum length (EXCLUDING the null terminator) for token text copied out of the source. */
 #define LEXER_TOKEN_MAX_LENGTH 127
 
 
@@ -44,13 +48,18 @@ enum lexer_token_type {
 
 /**
  * A single lexed token.
+ *
+ * The text of a token is a slice of the source file rather than a copy, and so remains valid only
+ * as long as the arena the token was lexed into.
  */
 struct lexer_token {
     /** The type of the token. */
     enum lexer_token_type type;
-    /** The textual content of the token (null-terminated). */
-    char text[LEXER_TOKEN_MAX_LENGTH + 1];
-    /** A numeric value (for number/register tokens). */
+    /** The textual content of the token in the source file (NOT null-terminated). */
+    const char *text;
+    /** The number of characters in the textual content of the token. */
+    uint32_t length;
+    /** A numeric value (for number/register tokens) or the interned ID (for identifier tokens). */
     uint32_t value;
     /** The name of the source file in which the token appears. */
     const char *file;
@@ -72,30 +81,226 @@ enum lexer_status {
     /** The lexer was called with incorrect arguments. */
     LEXER_STATUS_INVALID_ARGUMENT,
     /** The lexer encountered an unknown character or token while reading the source file. */
-    LEXER_STATUS_LEXICAL_ERROR
+    LEXER_STATUS_LEXICAL_ERROR,
+    /** The vector scanner disagreed with the scalar scanner (LEXER_SCANNER_CHECKED only). */
+    LEXER_STATUS_CHECK_FAILED
+};
+
+
+/**
+ * The scanners available to skip whitespace and comments between tokens.
+ */
+enum lexer_scanner {
+    /** The reference scanner, which classifies one character at a time. */
+    LEXER_SCANNER_SCALAR = 0,
+    /** The SIMD scanner, which classifies a block of characters at a time. */
+    LEXER_SCANNER_VECTOR,
+    /** The SIMD scanner with each skip checked against the scalar scanner. */
+    LEXER_SCANNER_CHECKED
+};
+
+
+/**
+ * The position of the lexer in a file whose lexing was suspended to lex an included file.
+ */
+struct lexer_file {
+    /** The name of the file. */
+    const char *name;
+    /** The text of the file. */
+    const char *source;
+    /** The number of characters in the text of the file. */
+    size_t source_length;
+    /** The offset of the next character to lex in the text. */
+    size_t position;
+    /** The line number of the next character to lex. */
+    uint32_t line;
+    /** The offset of the first character on that line. */
+    size_t line_start;
+    /** The tokens being replayed instead of lexing the text (or NULL). */
+    const struct lexer_token *replay;
+    /** The number of tokens being replayed. */
+    uint32_t replay_size;
+    /** The index of the next token to replay. */
+    uint32_t replay_index;
+};
+
+
+/**
+ * The state of the lexer while it processes one source file and the files it includes.
+ *
+ * Each thread that lexes concurrently must use its own context.
+ */
+struct lexer_context {
+    /** The name of the file being lexed, as given to the lexer. */
+    const char *file_name;
+    /** The text of the file being lexed. */
+    const char *source;
+    /** The number of characters in the text of the file being lexed. */
+    size_t source_length;
+    /** The offset of the next character to lex in the source text. */
+    size_t position;
+    /** The current line number of the lexer. */
+    uint32_t line;
+    /** The offset of the first character on the current line, from which columns are computed. */
+    size_t line_start;
+    /** The scanner used to skip whitespace and comments. */
+    enum lexer_scanner scanner;
+    /** The pool that identifier text is interned in, shared by all files lexed with the context. */
+    struct intern_pool *identifiers;
+    /** The arena that owns the text and names of the files being lexed (or NULL). */
+    struct arena *arena;
+    /** The files suspended by includes, innermost last (struct lexer_file elements). */
+    struct vector *includers;
+    /** Tokens lexed earlier that are returned instead of lexing the text (or NULL). */
+    const struct lexer_token *replay;
+    /** The number of tokens being replayed. */
+    uint32_t replay_size;
+    /** The index of the next token to replay. */
+    uint32_t replay_index;
+    /** Whether files that cannot be opened and tokens that cannot be lexed are logged as errors. */
+    bool report_errors;
 };
 
 
 /**
- * Runs the lexer on the provided input file to read all tokens into a list in they order they
+ * Creates a new lexer context that uses LEXER_SCANNER_VECTOR.
+ *
+ * @return Pointer to the created lexer context.
+ */
+struct lexer_context *create_lexer_context(void);
+
+
+/**
+ * Frees a lexer context created with create_lexer_context.
+ *
+ * The identifier IDs assigned by the context, and their interned text, are invalid afterwards.
+ *
+ * @param context  The lexer context to destroy.
+ */
+void destroy_lexer_context(struct lexer_context *context);
+
+
+/**
+ * Selects the scanner used to skip whitespace and comments by later calls to lexer_lex_file.
+ *
+ * All scanners produce the same tokens.
+ *
+ * @param context  The lexer context to configure.
+ * @param scanner  The scanner to use.
+ */
+void lexer_set_scanner(struct lexer_context *context, enum lexer_scanner scanner);
+
+
+/**
+ * Checks whether the text of a token is exactly the specified string.
+ *
+ * @param token  The token to check.
+ * @param text   The null terminated string to compare against.
+ *
+ * @return Whether the token text and string are equal.
+ */
+bool lexer_token_equals(const struct lexer_token *token, const char *text);
+
+
+/**
+ * Copies the text of a token into a null terminated buffer, truncating it if needed.
+ *
+ * @param token        The token to copy the text of.
+ * @param buffer[out]  The buffer to copy into.
+ * @param size         The number of bytes in the buffer, including room for the null terminator.
+ *
+ * @return The number of characters copied, excluding the null terminator.
+ */
+size_t lexer_token_copy_text(const struct lexer_token *token, char *buffer, size_t size);
+
+
+/**
+ * Starts lexing a file, abandoning any file that was being lexed with the context.
+ *
+ * The file is mapped into memory (or read into the arena if it cannot be mapped, e.g. when it is
+ * empty or not a regular file) and tokens refer to its text in place. The mapping is released
+ * when the arena is reset or destroyed.
+ *
+ * @param[inout] context    The lexer context to use.
+ * @param[in]    file_name  The path to the file to read tokens from.
+ * @param[in]    arena      The arena that owns the text of the file and of any file it includes.
+ *
+ * @return The status of opening the file. If SUCCESS, tokens can be read with lexer_next_token.
+ */
+enum lexer_status lexer_open_file(struct lexer_context *context,
+                                  const char *file_name,
+                                  struct arena *arena);
+
+
+/**
+ * Starts lexing a file included by the file being lexed.
+ *
+ * The tokens of the included file are returned by lexer_next_token before the rest of the tokens
+ * of the including file. Includes can be nested.
+ *
+ * @param[inout] context    The lexer context, which must have an open file.
+ * @param[in]    file_name  The path to the file to include.
+ *
+ * @return The status of opening the file. If not SUCCESS, lexing continues in the including file.
+ */
+enum lexer_status lexer_include_file(struct lexer_context *context, const char *file_name);
+
+
+/**
+ * Splices a run of tokens that were already lexed into the token stream, as if a file containing
+ * exactly those tokens was included by the file being lexed.
+ *
+ * The tokens are not copied, so the splice takes the same time regardless of the number of tokens,
+ * and the tokens (and their text) must stay valid until they have all been returned. Identifiers
+ * are interned again in the context's pool, so the tokens can come from a different context.
+ *
+ * @param[inout] context     The lexer context, which must have an open file.
+ * @param[in]    tokens      The tokens to splice in.
+ * @param[in]    num_tokens  The number of tokens to splice in.
+ *
+ * @return The status of the splice.
+ */
+enum lexer_status lexer_include_tokens(struct lexer_context *context,
+                                       const struct lexer_token *tokens,
+                                       uint32_t num_tokens);
+
+
+/**
+ * Lexes the next token of the open file.
+ *
+ * @param[inout] context  The lexer context, which must have an open file.
+ * @param[out]   token    A pointer to store the token information.
+ *
+ * @return The status of the lexer call. If SUCCESS, the lexer can be called again to get another
+ *         token. If EOF, the end of the opened file was reached. Otherwise, the lexer encountered
+ *         an error (which it has reported, with the location stored in the token).
+ */
+enum lexer_status lexer_next_token(struct lexer_context *context, struct lexer_token *token);
+
+
+/**
+ * Runs the lexer on the provided input file to read all tokens into a vector in the order they
  * appear in the file.
  *
- * Lexing will proceed until the entire file is read (EOF) or an error is encountered. The lexer
- * does not need to be called as a generator to get further tokens after a successful call.
+ * Lexing will proceed until the entire file is read (EOF) or an error is encountered. This is
+ * equivalent to calling lexer_open_file and then lexer_next_token until it does not succeed.
  *
- * @param[inout] file_name  The path to the file to read tokens from.
- * @param[out]   tokens  A pointer to return a list of processed tokens. It is the caller's
- *                       responsibility to free this list with the structures/list API. The tokens
- *                       list must be freed with the list_default_node_free_callback to free the
- *                       node data as well.
+ * @param[inout] context    The lexer context to use.
+ * @param[in]    file_name  The path to the file to read tokens from.
+ * @param[in]    arena      The arena to allocate the tokens and source text from.
+ * @param[out]   tokens     A pointer to return a vector of processed tokens (struct lexer_token
+ *                          elements). It is released by resetting the arena.
  *
  * @return The status of the lexer call. If SUCCESS, the lexer processed all tokens in the file
- *         and stored them in the list output pointer (in a new list allocated by the lexer). If
+ *         and stored them in the vector output pointer (in a new vector allocated by the lexer). If
  *         failure, the lexer encountered an error while parsing the file and should not be called
  *         again. If a non-success status is returned, the caller does not need to free the tokens
- *         list.
+ *         vector.
  */
-enum lexer_status lexer_lex_file(const char *file_name, struct list **tokens);
+enum lexer_status lexer_lex_file(struct lexer_context *context,
+                                 const char *file_name,
+                                 struct arena *arena,
+                                 struct vector **tokens);
 
 
 #endif  // _ASSEMBLER_LEXER_H_
@@ -0,0 +1,168 @@
+/**
+ * Relocatable object files, which hold assembled code whose label references are resolved later
+ * by the linker.
+ *
+ * @author Jonathan Uhler
+ */
+
+
+#ifndef _ASSEMBLER_OBJECT_H_
+#define _ASSEMBLER_OBJECT_H_
+
+
+#include "structures/arena.h"
+#include "structures/vector.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+/** The first four bytes of every object file ("MPOB" in little-endian order). */
+#define OBJECT_MAGIC 0x424F504D
+/** The version of the object file format written by object_write. */
+#define OBJECT_VERSION 1
+/** The section of a symbol that is referenced by an object but not declared in it. */
+#define OBJECT_NO_SECTION UINT32_MAX
+
+
+/**
+ * The field that a relocation patches with the address of its symbol.
+ */
+enum object_relocation_type {
+    /** The Immediate field of an I or DSI Format instruction word. */
+    OBJECT_RELOCATION_IMMEDIATE = 0,
+    /** A halfword emitted by a .half directive. */
+    OBJECT_RELOCATION_HALF
+};
+
+
+/**
+ * A run of contiguous bytes in an object.
+ *
+ * The code before the first .org directive of a source file forms a relocatable section, which the
+ * linker may place at any address. Each .org directive starts an absolute section at its address.
+ */
+struct object_section {
+    /** The address of the section if it is absolute, otherwise 0. */
+    uint32_t address;
+    /** The number of bytes in the section. */
+    uint32_t size;
+    /** Whether the section must be placed at its address. */
+    bool absolute;
+    /** The bytes of the section, with every relocated field set to zero. */
+    uint8_t *data;
+};
+
+
+/**
+ * A label declared or referenced by an object.
+ */
+struct object_symbol {
+    /** The name of the label. */
+    const char *name;
+    /** The index of the section the label is declared in, or OBJECT_NO_SECTION. */
+    uint32_t section;
+    /** The offset of the label from the start of its section. */
+    uint32_t offset;
+};
+
+
+/**
+ * A reference to a label that must be patched once the address of the label is known.
+ */
+struct object_relocation {
+    /** The index of the section that holds the field to patch. */
+    uint32_t section;
+    /** The offset of the field to patch from the start of its section. */
+    uint32_t offset;
+    /** The index of the referenced symbol. */
+    uint32_t symbol;
+    /** The field to patch. */
+    enum object_relocation_type type;
+};
+
+
+/**
+ * An object in memory.
+ */
+struct object {
+    /** The sections of the object (struct object_section elements). */
+    struct vector *sections;
+    /** The symbols of the object (struct object_symbol elements). */
+    struct vector *symbols;
+    /** The relocations of the object (struct object_relocation elements). */
+    struct vector *relocations;
+};
+
+
+/**
+ * Status of object API calls.
+ */
+enum object_status {
+    /** The object API function completed successfully. */
+    OBJECT_STATUS_SUCCESS = 0,
+    /** The object API function did not complete because it was called incorrectly. */
+    OBJECT_STATUS_INVALID_ARGUMENT,
+    /** The object API function did not complete because the file could not be read or written. */
+    OBJECT_STATUS_IO_ERROR,
+    /** The object API function did not complete because the file is not a valid object. */
+    OBJECT_STATUS_INVALID_FORMAT
+};
+
+
+/**
+ * Creates a new object with no sections, symbols, or relocations.
+ *
+ * @param arena[in]    The arena to allocate the object's vectors from, or NULL to use the heap.
+ * @param object[out]  A pointer to the object to initialize. It is the caller's responsibility to
+ *                     free the object's vectors with destroy_vector, or by resetting the arena.
+ */
+void object_init(struct arena *arena, struct object *object);
+
+
+/**
+ * Writes an object to a file.
+ *
+ * @param object  The object to write.
+ * @param file    The file to write to, which must be open for writing in binary mode.
+ *
+ * @return The status of the write.
+ */
+enum object_status object_write(const struct object *object, FILE *file);
+
+
+/**
+ * Reads an object written by object_write from a file.
+ *
+ * @param file         The file to read from, which must be seekable and open for reading in binary
+ *                     mode.
+ * @param arena[in]    The arena to allocate the object from.
+ * @param object[out]  A pointer to return the object. Its names and section data are owned by the
+ *                     arena.
+ *
+ * @return The status of the read. If INVALID_FORMAT, the file is not an object or is corrupt.
+ */
+enum object_status object_read(FILE *file, struct arena *arena, struct object *object);
+
+
+/**
+ * Sets a relocated field to the address of its symbol.
+ *
+ * @param field    Pointer to the first byte of the field.
+ * @param type     The type of the field.
+ * @param address  The address to store, of which the low 16 bits are kept.
+ */
+void object_patch(uint8_t *field, enum object_relocation_type type, uint32_t address);
+
+
+/**
+ * Gets the number of bytes patched by a relocation of a type.
+ *
+ * @param type  The type of the relocation.
+ *
+ * @return The size of the field, or 0 if the type is not valid.
+ */
+uint32_t object_relocation_size(enum object_relocation_type type);
+
+
+#endif  // _ASSEMBLER_OBJECT_H_
@@ -9,9 +9,11 @@
 #define _ASSEMBLER_PARSER_H_
 
 
+#include "assembler/include_cache.h"
 #include "assembler/lexer.h"
 #include "architecture/isa.h"
-#include "structures/list.h"
+#include "structures/intern_pool.h"
+#include "structures/vector.h"
 #include <stdint.h>
 #include <stdio.h>
 
@@ -31,36 +33,43 @@ enum parser_group_type {
 };
 
 
+/** The label ID of an instruction whose immediate is not a label reference. */
+#define PARSER_NO_LABEL UINT32_MAX
+
+
 /**
  * Semantic group for an instruction.
+ *
+ * Fields are packed to the width of the corresponding instruction fields, and a label reference is
+ * stored as the ID of the label rather than its text.
  */
 struct parser_group_instruction {
-    /** Opcode of the instruction. */
-    enum isa_opcode opcode;
+    /** Opcode of the instruction (an enum isa_opcode). */
+    uint32_t opcode       : ISA_INSTRUCTION_FUNCT_SIZE + ISA_INSTRUCTION_FORMAT_SIZE;
     /** Destination register. */
-    enum isa_register dest;
+    uint32_t dest         : ISA_INSTRUCTION_REGISTER_SIZE;
     /** Source1 register. */
-    enum isa_register source1;
+    uint32_t source1      : ISA_INSTRUCTION_REGISTER_SIZE;
     /** Source2 register. */
-    enum isa_register source2;
-    /** Text of label used in the instruction. */
-    char label[LEXER_TOKEN_MAX_LENGTH + 1];
+    uint32_t source2      : ISA_INSTRUCTION_REGISTER_SIZE;
+    /** Unused bits. */
+    uint32_t __RESERVED__ : 11;
     /** Numeric immediate value used in the instruction. */
     uint16_t immediate;
-    /** Binary value of the instruction, set by the encoder. */
-    uint32_t binary;
-};
+    /** ID of the label used as the immediate, or PARSER_NO_LABEL. */
+    uint32_t label;
+} __attribute__((packed));
 
 
 /**
  * Semantic group for a label.
  */
 struct parser_group_label {
-    /** Text of the label. */
-    char label[LEXER_TOKEN_MAX_LENGTH + 1];
+    /** ID of the label. */
+    uint32_t label;
     /** Numeric immediate value of the label. */
     uint32_t immediate;
-};
+} __attribute__((packed));
 
 
 /**
@@ -77,7 +86,7 @@ enum parser_directive_type {
 
 
 /**
- * Semantic group for an organization directive.
+ * Operands of an organization directive.
  */
 struct parser_directive_org {
     /** The number of pad bytes needed to reach the .org location. */
@@ -86,49 +95,46 @@ struct parser_directive_org {
 
 
 /**
- * Semantic group for a half directive.
+ * Operands of a half directive.
  */
 struct parser_directive_half {
-    /** The value of the halfword. */
+    /** The value of the halfword if it is not the address of a label. */
     uint16_t element;
+    /** ID of the label whose address is the halfword, or PARSER_NO_LABEL. */
+    uint32_t label;
 };
 
 
 /**
- * Semantic group for an include directive (parser-level).
- *
- * This is used internally in the parser; include directives are expanded into tokens and do not
- * become semantic groups in the output list.
- */
-struct parser_directive_include {
-    /** Path to the file to be included (null-terminated). */
-    char path[LEXER_TOKEN_MAX_LENGTH + 1];
-};
-
-
-/**
- * Semantic group for any type of directive.
+ * An entry in the directive side table of a program.
  */
-struct parser_group_directive {
+struct parser_directive {
     /** The type of the directive. */
     enum parser_directive_type type;
     union {
-        /** .org view of the directive group. */
+        /** .org view of the directive. */
         struct parser_directive_org org;
-        /** .half view of the directive group. */
+        /** .half view of the directive. */
         struct parser_directive_half half;
-        /** .include view of the directive group. */
-        struct parser_directive_include include;
     };
 };
 
 
+/**
+ * Semantic group for any type of directive.
+ */
+struct parser_group_directive {
+    /** The index of the directive's operands in the directive side table of the program. */
+    uint32_t index;
+} __attribute__((packed));
+
+
 /**
  * A structure representing a single group of tokens that form a single semantic unit.
  */
 struct parser_group {
-    /** The type of the group, used to determine which other members are usable. */
-    enum parser_group_type type;
+    /** The type of the group (an enum parser_group_type), which determines the usable member. */
+    uint16_t type;
     union {
         /** Instruction view of the semantic group. */
         struct parser_group_instruction instruction;
@@ -137,6 +143,22 @@ struct parser_group {
         /** Directive view of the semantic group. */
         struct parser_group_directive directive;
     };
+} __attribute__((packed));
+
+
+/**
+ * The intermediate representation of an assembly program produced by the parser.
+ *
+ * Groups are small fixed-size records. Data that only some groups need is kept in side tables
+ * that the groups refer to by index.
+ */
+struct parser_program {
+    /** The semantic groups in chronological order (struct parser_group elements). */
+    struct vector *groups;
+    /** The operands of directive groups (struct parser_directive elements). */
+    struct vector *directives;
+    /** The names of labels, indexed by label ID. This is the identifier pool of the lexer. */
+    const struct intern_pool *labels;
 };
 
 
@@ -151,31 +173,134 @@ enum parser_status {
     /** The parser API function was called with an invalid argument. */
     PARSER_STATUS_INVALID_ARGUMENT,
     /** The parser encountered a semantic error during parsing. */
-    PARSER_STATUS_SEMANTIC_ERROR
+    PARSER_STATUS_SEMANTIC_ERROR,
+    /** The parser could not allocate memory for the program. */
+    PARSER_STATUS_OUT_OF_MEMORY,
+    /** The group callback stopped the parser. */
+    PARSER_STATUS_STOPPED,
+    /** The lexer could not open or lex the source (the lexer reports the error). */
+    PARSER_STATUS_LEXER_ERROR
 };
 
 
 /**
- * Parses all semantic groups from a list of tokens generated by the lexer, returning them in
- * chronological order.
+ * A function that receives each semantic group as soon as the parser produces it.
+ *
+ * @param data       The user data passed to the parser.
+ * @param group      The group, which is only valid during the call. The index of a directive group
+ *                   is not set, since the operands are passed separately.
+ * @param directive  The operands of the group if it is a directive group, or NULL.
+ *
+ * @return SUCCESS to continue parsing. Any other status stops the parser, which returns it.
+ */
+typedef enum parser_status (*parser_group_callback)(void *data,
+                                                    const struct parser_group *group,
+                                                    const struct parser_directive *directive);
+
+
+/** The number of tokens the parser can look ahead of the current position. */
+#define PARSER_LOOKAHEAD 2
+
+
+/**
+ * The state of the parser while it processes one token stream.
+ *
+ * Tokens are pulled from the lexer as the parser needs them, and only the tokens in the lookahead
+ * window are held at a time. Each thread that parses concurrently must use its own context.
+ */
+struct parser_context {
+    /** The lexer context that tokens are pulled from. */
+    struct lexer_context *lexer;
+    /** The tokens lexed but not yet consumed, as a ring starting at window_start. */
+    struct lexer_token window[PARSER_LOOKAHEAD];
+    /** The index in the window of the next token to parse. */
+    uint32_t window_start;
+    /** The number of tokens in the window. */
+    uint32_t window_size;
+    /** The status of the last call to the lexer (SUCCESS while more tokens may follow). */
+    enum lexer_status lexer_status;
+    /** The address that the next instruction or directive will be placed at. */
+    uint32_t pc;
+    /** Copy of the last token examined, to report the location of errors (file NULL if none). */
+    struct lexer_token last_token;
+    /** The cache that included files are taken from (or NULL to lex them directly). */
+    struct include_cache *includes;
+};
+
+
+/**
+ * Creates a new parser context.
+ *
+ * @param lexer  The lexer context used to lex included files. It must outlive the parser context.
+ *
+ * @return Pointer to the created parser context.
+ */
+struct parser_context *create_parser_context(struct lexer_context *lexer);
+
+
+/**
+ * Frees a parser context created with create_parser_context.
+ *
+ * @param context  The parser context to destroy.
+ */
+void destroy_parser_context(struct parser_context *context);
+
+
+/**
+ * Selects the cache that later calls to parser_stream_file take the tokens of included files from.
+ *
+ * @param context   The parser context to configure.
+ * @param includes  The include cache, which must outlive every group parsed with it, or NULL to lex
+ *                  included files directly.
+ */
+void parser_set_include_cache(struct parser_context *context, struct include_cache *includes);
+
+
+/**
+ * Parses all semantic groups of a source file, passing each one to a callback in chronological
+ * order instead of storing them.
+ *
+ * Tokens are pulled from the lexer one at a time, so memory use does not grow with the size of
+ * the source. Included files are lexed in place when their .include directive is reached.
+ *
+ * @param context    The parser context to use.
+ * @param file_name  The path to the source file to parse.
+ * @param arena      The arena that owns the text of the source file and of any included files.
+ * @param callback   The function to call with each group.
+ * @param data       The user data to pass to the callback.
+ *
+ * @return The status of the parser call. If SUCCESS, every token was parsed and every group was
+ *         accepted by the callback. Otherwise, the status of the parse error or the status that the
+ *         callback returned.
+ */
+enum parser_status parser_stream_file(struct parser_context *context,
+                                      const char *file_name,
+                                      struct arena *arena,
+                                      parser_group_callback callback,
+                                      void *data);
+
+
+/**
+ * Parses all semantic groups of a source file into a program, with the groups in chronological
+ * order.
  *
- * Parsing will proceed until the entire token stream is read (EOF) or an error is encountered. The
- * parser does not need to be called as a generator to get further semantic groups after a
- * successful call.
+ * Parsing will proceed until the entire source is read (EOF) or an error is encountered.
  *
- * @param tokens[inout]  The list of tokens to parse. Tokens will be popped from this list.
- * @param groups[out]    A pointer to return a list of processed semantic groups. It is the caller's
- *                       responsibility to free this list with the structures/list API. The groups
- *                       must be freed with the list_default_node_free_callback to free the node
- *                       data as well.
+ * @param context       The parser context to use.
+ * @param file_name     The path to the source file to parse.
+ * @param arena[in]     The arena that owns the text of the source files and the program.
+ * @param program[out]  A pointer to return the program. Each vector of the program is new, and it
+ *                      is the caller's responsibility to free them by resetting the arena. The
+ *                      label names belong to the lexer context, and are valid as long as it is.
  *
- * @return The status of the parser call. If SUCCESS, the parser proceeded all tokens and stored
- *         the associated semantic groups in the list output pointer (in a new list allocated by the
- *         parser). If failure, the parser encountered an error and should not be called again on
- *         the same token list. If a non-success status is returned, the caller does not need to
- *         free the groups list.
+ * @return The status of the parser call. If SUCCESS, the parser processed all tokens and stored
+ *         the associated semantic groups in the program. If a non-success status is returned, the
+ *         caller does not need to free the program.
  */
-enum parser_status parser_parse_tokens(struct list *tokens, struct list **groups);
+enum parser_status parser_parse_file(struct parser_context *context,
+                                     const char *file_name,
+                                     struct arena *arena,
+                                     struct parser_program *program);
 
 
 #endif  // _ASSEMBLER_PARSER_H_
@@ -0,0 +1,57 @@
+/**
+ * Scanners that skip the whitespace and comments between tokens in assembly source text.
+ *
+ * @author Jonathan Uhler
+ */
+
+
+#ifndef _ASSEMBLER_SCANNER_H_
+#define _ASSEMBLER_SCANNER_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * Skips whitespace and comments one character at a time. This is the reference scanner.
+ *
+ * @param text                 The source text.
+ * @param length               The number of characters in the source text.
+ * @param position             The offset to start skipping at.
+ * @param num_newlines[inout]  Incremented by the number of newlines skipped.
+ * @param line_start[inout]    Set to the offset after the last newline skipped, if any.
+ *
+ * @return The offset of the first character that is not whitespace or part of a comment, or
+ *         length if the end of the text was reached.
+ */
+size_t scanner_skip_scalar(const char *text,
+                           size_t length,
+                           size_t position,
+                           uint32_t *num_newlines,
+                           size_t *line_start);
+
+
+/**
+ * Skips whitespace and comments a block of characters at a time.
+ *
+ * AVX2 (32 characters) or SSE2 (16 characters) is used when the host supports it, and the scalar
+ * scanner otherwise. The result is always the same as scanner_skip_scalar.
+ *
+ * @param text                 The source text.
+ * @param length               The number of characters in the source text.
+ * @param position             The offset to start skipping at.
+ * @param num_newlines[inout]  Incremented by the number of newlines skipped.
+ * @param line_start[inout]    Set to the offset after the last newline skipped, if any.
+ *
+ * @return The offset of the first character that is not whitespace or part of a comment, or
+ *         length if the end of the text was reached.
+ */
+size_t scanner_skip_vector(const char *text,
+                           size_t length,
+                           size_t position,
+                           uint32_t *num_newlines,
+                           size_t *line_start);
+
+
+#endif  // _ASSEMBLER_SCANNER_H_
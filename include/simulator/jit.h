@@ -0,0 +1,90 @@
+/**
+ * Just-in-time compiler from translated blocks to x86-64 machine code.
+ *
+ * @author Jonathan Uhler
+ */
+
+
+#ifndef _SIMULATOR_JIT_H_
+#define _SIMULATOR_JIT_H_
+
+
+#include "simulator/processor.h"
+#include "simulator/translator.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** The number of times a block is interpreted before it is compiled. */
+#define JIT_HOT_THRESHOLD 16
+/** The size in bytes of the executable arena that holds compiled blocks. */
+#define JIT_ARENA_SIZE (4 * 1024 * 1024)
+/** An upper bound on the number of bytes of machine code emitted for one micro-op. */
+#define JIT_MAX_UOP_CODE_SIZE 128
+/** An upper bound on the number of bytes of machine code emitted for one block. */
+#define JIT_MAX_BLOCK_CODE_SIZE (64 + TRANSLATOR_MAX_BLOCK_LENGTH * JIT_MAX_UOP_CODE_SIZE)
+
+
+/**
+ * State of the JIT compiler for a single processor.
+ */
+struct jit_state {
+    /** The mmap'd arena compiled blocks are placed in (or NULL if the JIT is unsupported). */
+    uint8_t *arena;
+    /** The number of bytes of the arena in use. */
+    size_t arena_used;
+    /** A reference processor kept in lockstep in check mode (or NULL). */
+    struct processor *shadow;
+    /** The number of blocks compiled since the JIT state was created. */
+    uint32_t compiled_blocks;
+};
+
+
+/**
+ * Creates the JIT state for a processor, including the executable arena.
+ *
+ * If the host is not x86-64 or the arena cannot be mapped, the returned state has a NULL arena
+ * and no blocks will be compiled.
+ *
+ * The caller is responsible for calling destroy_jit_state to free associated memory.
+ *
+ * @return Pointer to the created state.
+ */
+struct jit_state *create_jit_state(void);
+
+
+/**
+ * Frees a JIT state and unmaps its arena.
+ *
+ * @param jit  The state to destroy.
+ */
+void destroy_jit_state(struct jit_state *jit);
+
+
+/**
+ * Executes instructions one translated block at a time, compiling hot blocks to host code.
+ *
+ * Blocks are interpreted with translator_run_block until they have been executed
+ * JIT_HOT_THRESHOLD times, and are run as native code afterwards. The register file remains the
+ * canonical processor state: compiled code reads and writes it directly, and updates pc and
+ * ccount exactly. Compiled code returns to the interpreter on HALT and after any store that
+ * modifies translated code.
+ *
+ * If the processor engine is PROCESSOR_ENGINE_JIT_CHECKED, every block is also executed on a
+ * shadow processor with processor_tick, and execution stops with CHECK_FAILED on any difference
+ * in registers or memory.
+ *
+ * @param processor[inout]  The processor to execute.
+ * @param max_cycles        The maximum number of instructions to execute.
+ * @param cycles[out]       A pointer to store the number of instructions that were executed.
+ *
+ * @return SUCCESS if max_cycles instructions were executed, otherwise the status of the
+ *         instruction that stopped execution.
+ */
+enum processor_status jit_execute(struct processor *processor,
+                                  uint32_t max_cycles,
+                                  uint32_t *cycles);
+
+
+#endif  // _SIMULATOR_JIT_H_
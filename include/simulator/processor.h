@@ -11,18 +11,33 @@
 
 #include "simulator/memory.h"
 #include "simulator/registers.h"
+#include "architecture/isa.h"
+#include <limits.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
 
+/** The number of entries in the decode cache (one for every possible pc value). */
+#define PROCESSOR_DECODE_CACHE_SIZE 65536
+/** The number of bytes in the breakpoint bitmap (one bit for every possible pc value). */
+#define PROCESSOR_BREAKPOINT_MAP_SIZE (PROCESSOR_DECODE_CACHE_SIZE / CHAR_BIT)
+
+
 /**
- * The processor state.
+ * The execution engines available to run instructions.
  */
-struct processor {
-    /** Memory in use by the processor. */
-    struct memory *memory;
-    /** Register file in ues by the processor. */
-    struct register_file *registers;
+enum processor_engine {
+    /** The reference engine, which executes each instruction with processor_tick. */
+    PROCESSOR_ENGINE_SWITCH = 0,
+    /** A direct-threaded interpreter dispatching through computed goto. */
+    PROCESSOR_ENGINE_THREADED,
+    /** An interpreter executing cached translations of whole basic blocks. */
+    PROCESSOR_ENGINE_BLOCK,
+    /** The block engine with hot blocks compiled to host machine code. */
+    PROCESSOR_ENGINE_JIT,
+    /** The JIT engine with each compiled block checked against processor_tick. */
+    PROCESSOR_ENGINE_JIT_CHECKED
 };
 
 
@@ -41,7 +56,99 @@ enum processor_status {
     /** The processor attempted to load an invalid instruction. */
     PROCESSOR_STATUS_INVALID_INSTRUCTION,
     /** The processor ran out of memory. */
-    PROCESSOR_STATUS_OUT_OF_MEMORY
+    PROCESSOR_STATUS_OUT_OF_MEMORY,
+    /** The JIT check mode found a difference between compiled code and processor_tick. */
+    PROCESSOR_STATUS_CHECK_FAILED
+};
+
+
+/**
+ * The reasons processor_run can stop. These are also used as bits in the stop mask.
+ */
+enum processor_stop_reason {
+    /** Execution has not stopped. */
+    PROCESSOR_STOP_NONE       = 0,
+    /** A HALT instruction was executed, or reset was already asserted. */
+    PROCESSOR_STOP_HALT       = 1 << 0,
+    /** The maximum number of cycles was executed. */
+    PROCESSOR_STOP_BUDGET     = 1 << 1,
+    /** A return (jlr0 r0, r0, ra) instruction was executed. */
+    PROCESSOR_STOP_RETURN     = 1 << 2,
+    /** The pc reached an address with a breakpoint. */
+    PROCESSOR_STOP_BREAKPOINT = 1 << 3,
+    /** An instruction could not be executed. */
+    PROCESSOR_STOP_ERROR      = 1 << 4
+};
+
+
+/**
+ * The outcome of a call to processor_run.
+ */
+struct processor_run_result {
+    /** The number of instructions that were executed. */
+    uint32_t cycles;
+    /** Why execution stopped. */
+    enum processor_stop_reason reason;
+};
+
+
+struct processor;
+struct processor_decoded_instruction;
+struct translator_cache;
+struct jit_state;
+
+
+/** Type definition for the routine that executes a predecoded instruction. */
+typedef enum processor_status (*processor_execute_handler)(
+    struct processor *processor,
+    const struct processor_decoded_instruction *decoded);
+
+
+/**
+ * A fetched and decoded instruction, cached by the address it was fetched from.
+ */
+struct processor_decoded_instruction {
+    /** The routine used to execute the instruction, or NULL if the Format field is invalid. */
+    processor_execute_handler execute;
+    /** The threaded engine handler for the instruction, resolved lazily (NULL if unresolved). */
+    const void *threaded_handler;
+    /** The raw instruction that was fetched from memory. */
+    union isa_instruction instruction;
+    /** The immediate value (for I-type and DSI-type instructions). */
+    uint16_t immediate;
+    /** The opcode of the instruction (Funct and Format fields). */
+    uint8_t opcode;
+    /** The destination register index. */
+    uint8_t dest;
+    /** The source1 register index. */
+    uint8_t source1;
+    /** The source2 register index (for DSS-type instructions). */
+    uint8_t source2;
+    /** Whether this cache entry holds a decoded instruction. */
+    bool valid;
+};
+
+
+/**
+ * The processor state.
+ */
+struct processor {
+    /** Memory in use by the processor. */
+    struct memory *memory;
+    /** Register file in ues by the processor. */
+    struct register_file *registers;
+    /** Decoded instructions indexed by the pc they were fetched from. */
+    struct processor_decoded_instruction *decode_cache;
+    /** Translated basic blocks, allocated when the block engine is first used (or NULL). */
+    struct translator_cache *translator;
+    /** Compiled code for hot blocks, allocated when the JIT engine is first used (or NULL). */
+    struct jit_state *jit;
+    /** The engine used by processor_execute. */
+    enum processor_engine engine;
+    /** Bitmap of addresses with a breakpoint set, indexed by pc. */
+    uint8_t *breakpoints;
+    /** The number of bits set in the breakpoint bitmap. */
+    uint32_t num_breakpoints;
 };
 
 
@@ -77,6 +184,34 @@ enum processor_status processor_load_program(struct processor *processor,
                                              uint16_t address);
 
 
+/**
+ * Gets the decoded form of the instruction at the specified address.
+ *
+ * The instruction is fetched and decoded only if the decode cache does not already hold a valid
+ * entry for the address.
+ *
+ * @param processor  The processor to fetch from.
+ * @param pc         The address of the instruction.
+ *
+ * @return Pointer to the decode cache entry for the address. The pointer remains owned by the
+ *         processor and is only valid until the next write to processor memory.
+ */
+struct processor_decoded_instruction *processor_decode(struct processor *processor, uint16_t pc);
+
+
+/**
+ * Invalidates any cached decode information for instructions overlapping a range of memory.
+ *
+ * This must be called whenever processor memory is changed outside of the processor API (e.g.
+ * with memory_store_byte) so that stale instructions are not executed.
+ *
+ * @param processor  The processor whose caches should be invalidated.
+ * @param address    The first address that was written.
+ * @param size       The number of bytes that were written.
+ */
+void processor_invalidate_range(struct processor *processor, uint16_t address, uint32_t size);
+
+
 /**
  * Sets the reset register in the provided processor.
  *
@@ -110,4 +245,76 @@ enum processor_status processor_deassert_reset(struct processor *processor);
 enum processor_status processor_tick(struct processor *processor, union isa_instruction *executed);
 
 
+/**
+ * Steps the processor clock forward by up to the specified number of cycles using the currently
+ * selected execution engine.
+ *
+ * All engines produce the same architectural state as repeated calls to processor_tick, but
+ * engines other than PROCESSOR_ENGINE_SWITCH do not log each executed instruction.
+ *
+ * @param processor[inout]  The processor to step.
+ * @param max_cycles        The maximum number of instructions to execute.
+ * @param cycles[out]       Optional output pointer to store the number of instructions that were
+ *                          executed (can be NULL).
+ *
+ * @return SUCCESS if max_cycles instructions were executed, otherwise the status of the
+ *         instruction that stopped execution (e.g. HALTED).
+ */
+enum processor_status processor_execute(struct processor *processor,
+                                        uint32_t max_cycles,
+                                        uint32_t *cycles);
+
+
+/**
+ * Runs the processor until a stop condition is reached.
+ *
+ * Execution always stops when a HALT instruction is executed, when max_cycles instructions have
+ * been executed, or when an instruction fails. Stopping when a return instruction is executed or
+ * when the pc reaches a breakpoint must be requested in the stop mask. The instruction at the
+ * starting pc is never treated as a breakpoint, so a run stopped at a breakpoint can be resumed.
+ *
+ * If neither return nor breakpoint stops are requested (or no breakpoints are set), the currently
+ * selected engine is used through processor_execute. Otherwise each instruction is executed from
+ * the decode cache without the logging and argument checks done by processor_tick.
+ *
+ * @param processor[inout]  The processor to run.
+ * @param max_cycles        The maximum number of instructions to execute.
+ * @param stop_mask         Bitwise OR of the optional PROCESSOR_STOP_RETURN and
+ *                          PROCESSOR_STOP_BREAKPOINT conditions to stop on.
+ * @param result[out]       Pointer to store the number of cycles executed and the stop reason.
+ *
+ * @return SUCCESS if execution stopped on the cycle budget, a return, or a breakpoint, HALTED if
+ *         the processor is halted, otherwise the status of the instruction that failed.
+ */
+enum processor_status processor_run(struct processor *processor,
+                                    uint32_t max_cycles,
+                                    uint32_t stop_mask,
+                                    struct processor_run_result *result);
+
+
+/**
+ * Sets or clears a breakpoint.
+ *
+ * @param processor  The processor to set the breakpoint for.
+ * @param address    The pc value to break at.
+ * @param enabled    Whether the breakpoint should be set (true) or cleared (false).
+ *
+ * @return Whether the breakpoint was updated.
+ */
+enum processor_status processor_set_breakpoint(struct processor *processor,
+                                               uint16_t address,
+                                               bool enabled);
+
+
+/**
+ * Checks whether a breakpoint is set at an address.
+ *
+ * @param processor  The processor to check.
+ * @param address    The pc value to check.
+ *
+ * @return Whether a breakpoint is set at the address.
+ */
+bool processor_has_breakpoint(const struct processor *processor, uint16_t address);
+
+
 #endif  // _SIMULATOR_PROCESSOR_H_
@@ -0,0 +1,36 @@
+/**
+ * Direct-threaded execution engine for the single-cycle simulator.
+ *
+ * @author Jonathan Uhler
+ */
+
+
+#ifndef _SIMULATOR_THREADED_H_
+#define _SIMULATOR_THREADED_H_
+
+
+#include "simulator/processor.h"
+#include <stdint.h>
+
+
+/**
+ * Executes instructions with a direct-threaded interpreter.
+ *
+ * Each entry in the processor's decode cache is bound to the address of a per-opcode handler, and
+ * handlers jump directly to the handler of the next instruction with a computed goto. The
+ * architectural state after execution is identical to calling processor_tick the same number of
+ * times, but no per-instruction log messages are emitted.
+ *
+ * @param processor[inout]  The processor to execute.
+ * @param max_cycles        The maximum number of instructions to execute.
+ * @param cycles[out]       A pointer to store the number of instructions that were executed.
+ *
+ * @return SUCCESS if max_cycles instructions were executed, otherwise the status of the
+ *         instruction that stopped execution.
+ */
+enum processor_status threaded_execute(struct processor *processor,
+                                       uint32_t max_cycles,
+                                       uint32_t *cycles);
+
+
+#endif  // _SIMULATOR_THREADED_H_
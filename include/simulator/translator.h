@@ -0,0 +1,247 @@
+/**
+ * Basic-block translation cache for the single-cycle simulator.
+ *
+ * @author Jonathan Uhler
+ */
+
+
+#ifndef _SIMULATOR_TRANSLATOR_H_
+#define _SIMULATOR_TRANSLATOR_H_
+
+
+#include "simulator/processor.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/** The maximum number of guest instructions translated into a single block. */
+#define TRANSLATOR_MAX_BLOCK_LENGTH 64
+/** The number of bytes of guest memory a block of maximum length can span. */
+#define TRANSLATOR_MAX_BLOCK_BYTES (TRANSLATOR_MAX_BLOCK_LENGTH * sizeof(uint32_t))
+
+
+/**
+ * Micro-op types that do not correspond to a core opcode. Core instructions use their opcode
+ * (enum isa_opcode) as the micro-op type.
+ */
+enum translator_uop_type {
+    /** An instruction with no architectural effect (e.g. an ALU operation targeting ZERO). */
+    TRANSLATOR_UOP_NOP = 0x40,
+    /** An instruction with an invalid Format field or opcode. */
+    TRANSLATOR_UOP_INVALID
+};
+
+
+/**
+ * A single translated guest instruction.
+ */
+struct translator_uop {
+    /** The opcode (enum isa_opcode) or micro-op type (enum translator_uop_type). */
+    uint8_t type;
+    /** The destination register index. */
+    uint8_t dest;
+    /** The source1 register index. */
+    uint8_t source1;
+    /** The source2 register index. */
+    uint8_t source2;
+    /** The immediate value. */
+    uint16_t immediate;
+};
+
+
+/**
+ * The ways in which execution of a translated block can end.
+ */
+enum translator_exit {
+    /** The block ran to completion and continued at the fall-through address. */
+    TRANSLATOR_EXIT_FALL_THROUGH = 0,
+    /** The block ran to completion and its final jump was taken. */
+    TRANSLATOR_EXIT_TAKEN,
+    /** A store in the block modified translated code, so the block and its links are stale. */
+    TRANSLATOR_EXIT_INVALIDATED,
+    /** The block executed a HALT instruction. */
+    TRANSLATOR_EXIT_HALTED,
+    /** The block reached an invalid instruction. */
+    TRANSLATOR_EXIT_INVALID_INSTRUCTION,
+    /** The block produced a different result than the reference engine (JIT check mode only). */
+    TRANSLATOR_EXIT_CHECK_FAILED
+};
+
+
+struct translator_block;
+
+
+/**
+ * Type definition for a block compiled to host machine code.
+ *
+ * A native block updates the pc, reset, and ccount registers itself and returns the reason it
+ * exited (enum translator_exit) in the upper 16 bits and the number of instructions it executed
+ * in the lower 16 bits.
+ */
+typedef uint32_t (*translator_native_block)(struct register_file *registers,
+                                            uint8_t *memory,
+                                            struct processor *processor);
+
+
+/**
+ * Type definition for a routine that executes one translated block.
+ *
+ * The routine must leave the processor registers (including pc) in the state they would have
+ * after executing the same instructions with processor_tick, and store the number of instructions
+ * executed in *executed.
+ */
+typedef enum translator_exit (*translator_block_runner)(struct processor *processor,
+                                                        struct translator_block *block,
+                                                        uint32_t *executed);
+
+
+/**
+ * A cached link from the end of one block to the block that executed after it.
+ */
+struct translator_link {
+    /** The block that was linked, valid only if epoch matches the translator cache epoch. */
+    struct translator_block *block;
+    /** The cache epoch at the time the link was made. */
+    uint32_t epoch;
+};
+
+
+/**
+ * A straight-line run of guest instructions ending at the first jump, halt, or invalid instruction
+ * (or after TRANSLATOR_MAX_BLOCK_LENGTH instructions).
+ */
+struct translator_block {
+    /** The address of the first guest instruction in the block. */
+    uint16_t start;
+    /** The number of micro-ops in the block. */
+    uint16_t length;
+    /** Link to the block at the fall-through address (start + 4 * length). */
+    struct translator_link fall_through;
+    /** Link to the block at the most recent taken jump target. */
+    struct translator_link taken;
+    /** The number of times the block has been executed (used to find hot blocks). */
+    uint32_t executions;
+    /** Host machine code compiled from the block (or NULL if it has not been compiled). */
+    translator_native_block native;
+    /** The translated instructions. */
+    struct translator_uop uops[];
+};
+
+
+/**
+ * A cache of translated blocks for a single processor.
+ */
+struct translator_cache {
+    /** Translated blocks indexed by their start address. */
+    struct translator_block *blocks[PROCESSOR_DECODE_CACHE_SIZE];
+    /** Whether each byte of memory is covered by a translated block. */
+    bool code_map[PROCESSOR_DECODE_CACHE_SIZE];
+    /** Counter incremented every time a block is invalidated, used to expire block links. */
+    uint32_t epoch;
+};
+
+
+/**
+ * Creates an empty translation cache.
+ *
+ * The caller is responsible for calling destroy_translator_cache to free associated memory.
+ *
+ * @return Pointer to the created cache.
+ */
+struct translator_cache *create_translator_cache(void);
+
+
+/**
+ * Frees a translation cache and all of its blocks.
+ *
+ * @param cache  The cache to destroy.
+ */
+void destroy_translator_cache(struct translator_cache *cache);
+
+
+/**
+ * Checks whether a micro-op ends a translated block.
+ *
+ * @param type  The micro-op type (enum isa_opcode or enum translator_uop_type).
+ *
+ * @return Whether the micro-op is a jump, HALT, or invalid instruction.
+ */
+bool translator_is_terminal(uint8_t type);
+
+
+/**
+ * Gets the translated block starting at the specified address, translating it if needed.
+ *
+ * @param processor  The processor whose memory holds the guest code.
+ * @param pc         The address of the first instruction of the block.
+ *
+ * @return Pointer to the block, owned by the processor's translation cache. The pointer is only
+ *         valid until the next write to processor memory.
+ */
+struct translator_block *translator_get_block(struct processor *processor, uint16_t pc);
+
+
+/**
+ * Discards every translated block that covers any byte in a range of memory.
+ *
+ * @param cache    The cache to invalidate blocks in.
+ * @param address  The first address that was written.
+ * @param size     The number of bytes that were written.
+ */
+void translator_invalidate_range(struct translator_cache *cache, uint16_t address, uint32_t size);
+
+
+/**
+ * Interprets the micro-ops in a single translated block.
+ *
+ * @param processor[inout]  The processor to execute.
+ * @param block             The block to execute, which must start at the current pc.
+ * @param executed[out]     A pointer to store the number of instructions that were executed.
+ *
+ * @return The reason execution of the block ended.
+ */
+enum translator_exit translator_run_block(struct processor *processor,
+                                          struct translator_block *block,
+                                          uint32_t *executed);
+
+
+/**
+ * Executes instructions one translated block at a time with the provided block runner.
+ *
+ * Whole blocks are executed while the remaining cycle budget allows it, following cached links
+ * between blocks. Any remaining cycles are single-stepped with processor_tick.
+ *
+ * @param processor[inout]  The processor to execute.
+ * @param run_block         The routine used to execute each block.
+ * @param max_cycles        The maximum number of instructions to execute.
+ * @param cycles[out]       A pointer to store the number of instructions that were executed.
+ *
+ * @return SUCCESS if max_cycles instructions were executed, otherwise the status of the
+ *         instruction that stopped execution.
+ */
+enum processor_status translator_execute_blocks(struct processor *processor,
+                                                translator_block_runner run_block,
+                                                uint32_t max_cycles,
+                                                uint32_t *cycles);
+
+
+/**
+ * Executes instructions one translated block at a time.
+ *
+ * This function is equivalent to translator_execute_blocks with translator_run_block. The
+ * architectural state after execution is identical to calling processor_tick the same number of
+ * times.
+ *
+ * @param processor[inout]  The processor to execute.
+ * @param max_cycles        The maximum number of instructions to execute.
+ * @param cycles[out]       A pointer to store the number of instructions that were executed.
+ *
+ * @return SUCCESS if max_cycles instructions were executed, otherwise the status of the
+ *         instruction that stopped execution.
+ */
+enum processor_status translator_execute(struct processor *processor,
+                                         uint32_t max_cycles,
+                                         uint32_t *cycles);
+
+
+#endif  // _SIMULATOR_TRANSLATOR_H_
@@ -0,0 +1,149 @@
+/**
+ * A bump allocator that hands out memory from large chunks and releases it all at once.
+ *
+ * @author Jonathan Uhler
+ */
+
+
+#ifndef _STRUCTURES_ARENA_H_
+#define _STRUCTURES_ARENA_H_
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** The default number of bytes in each chunk allocated by an arena. */
+#define ARENA_DEFAULT_CHUNK_SIZE 65536
+
+
+/**
+ * A single block of memory that allocations are carved from.
+ */
+struct arena_chunk {
+    /** Pointer to the previously allocated chunk (or NULL). */
+    struct arena_chunk *prev;
+    /** The number of bytes available in the data member. */
+    size_t size;
+    /** The number of bytes already handed out from the data member. */
+    size_t used;
+    /** The memory handed out by the arena. */
+    uint8_t data[];
+};
+
+
+/**
+ * A function called when an arena is reset or destroyed to release a resource tied to it.
+ */
+typedef void (*arena_cleanup_callback)(void *data);
+
+
+/**
+ * A cleanup callback registered with an arena, allocated from the arena itself.
+ */
+struct arena_cleanup {
+    /** Pointer to the previously registered cleanup (or NULL). */
+    struct arena_cleanup *prev;
+    /** The function to call. */
+    arena_cleanup_callback callback;
+    /** The argument to pass to the function. */
+    void *data;
+};
+
+
+/**
+ * An arena of zero or more chunks.
+ */
+struct arena {
+    /** Pointer to the chunk that allocations are currently made from (or NULL). */
+    struct arena_chunk *current;
+    /** The minimum size of new chunks. */
+    size_t chunk_size;
+    /** The number of bytes handed out since the arena was created or last reset. */
+    size_t bytes_allocated;
+    /** The most recently registered cleanup callback (or NULL). */
+    struct arena_cleanup *cleanups;
+};
+
+
+/**
+ * Creates a new arena with no chunks.
+ *
+ * @param chunk_size  The minimum number of bytes to request from the system at a time. If 0,
+ *                    ARENA_DEFAULT_CHUNK_SIZE is used.
+ *
+ * @return Pointer to the created arena.
+ */
+struct arena *create_arena(size_t chunk_size);
+
+
+/**
+ * Frees an arena created with create_arena and every allocation made from it.
+ *
+ * @param arena  The arena to destroy.
+ */
+void destroy_arena(struct arena *arena);
+
+
+/**
+ * Allocates memory from an arena.
+ *
+ * The memory is aligned for any type and is not initialized. It cannot be freed individually, and
+ * remains valid until the arena is reset or destroyed.
+ *
+ * @param arena  The arena to allocate from.
+ * @param size   The number of bytes to allocate.
+ *
+ * @return Pointer to the allocated memory, or NULL if the system is out of memory.
+ */
+void *arena_allocate(struct arena *arena, size_t size);
+
+
+/**
+ * Resizes an allocation made from an arena.
+ *
+ * If the allocation is the most recent one in the arena and there is room after it, it is grown
+ * or shrunk in place. Otherwise a new allocation is made and the old contents are copied to it; the
+ * old memory is not reused until the arena is reset.
+ *
+ * @param arena     The arena the allocation was made from.
+ * @param data      The allocation to resize, or NULL to make a new allocation.
+ * @param old_size  The size in bytes of the allocation.
+ * @param new_size  The requested size in bytes.
+ *
+ * @return Pointer to the resized allocation, or NULL if the system is out of memory (in which case
+ *         the old allocation is unchanged).
+ */
+void *arena_reallocate(struct arena *arena, void *data, size_t old_size, size_t new_size);
+
+
+/**
+ * Registers a function to call the next time the arena is reset or destroyed.
+ *
+ * This ties the lifetime of a resource that is not arena memory (e.g. a file mapping) to the
+ * allocations that refer to it. Callbacks are called in the reverse order they were registered,
+ * before any memory is released.
+ *
+ * @param arena     The arena to register with.
+ * @param callback  The function to call.
+ * @param data      The argument to pass to the function.
+ *
+ * @return Whether the callback was registered. If false, the arena is out of memory and the caller
+ *         remains responsible for releasing the resource.
+ */
+bool arena_add_cleanup(struct arena *arena, arena_cleanup_callback callback, void *data);
+
+
+/**
+ * Releases every allocation made from an arena so that its memory can be reused.
+ *
+ * Registered cleanup callbacks are called and forgotten. The largest chunk is kept for later
+ * allocations and all other chunks are returned to the system.
+ *
+ * @param arena  The arena to reset.
+ */
+void arena_reset(struct arena *arena);
+
+
+#endif  // _STRUCTURES_ARENA_H_
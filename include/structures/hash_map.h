@@ -0,0 +1,110 @@
+/**
+ * A generic open-addressing hash map from strings to data in the assembler and simulator.
+ *
+ * @author Jonathan Uhler
+ */
+
+
+#ifndef _STRUCTURES_HASH_MAP_H_
+#define _STRUCTURES_HASH_MAP_H_
+
+
+#include <stdint.h>
+
+
+/** The number of slots allocated by a new hash map if no capacity is requested. */
+#define HASH_MAP_INITIAL_CAPACITY 64
+
+
+/**
+ * A single slot in the hash map.
+ */
+struct hash_map_entry {
+    /** The key of the entry, or NULL if the slot is empty. */
+    const char *key;
+    /** The full hash of the key, used to skip most string comparisons and to rehash. */
+    uint32_t hash;
+    /** Pointer to the data associated with the key. The user is responsible for casting it. */
+    void *value;
+};
+
+
+/**
+ * A hash map using linear probing.
+ */
+struct hash_map {
+    /** The slots of the map. */
+    struct hash_map_entry *entries;
+    /** The number of slots (always a power of two). */
+    uint32_t capacity;
+    /** The number of keys in the map. */
+    uint32_t size;
+};
+
+
+/**
+ * Status of hash map API calls.
+ */
+enum hash_map_status {
+    /** The hash map API function completed successfully. */
+    HASH_MAP_STATUS_SUCCESS = 0,
+    /** The hash map API function did not complete because the key is already in the map. */
+    HASH_MAP_STATUS_DUPLICATE_KEY,
+    /** The hash map API function did not complete because the key is not in the map. */
+    HASH_MAP_STATUS_NOT_FOUND,
+    /** The hash map API function did not complete because it was called incorrectly. */
+    HASH_MAP_STATUS_INVALID_ARGUMENT,
+    /** The hash map API function did not complete because the map could not grow. */
+    HASH_MAP_STATUS_OUT_OF_MEMORY
+};
+
+
+/**
+ * Creates a new hash map with no keys.
+ *
+ * @param capacity  The number of keys to make room for before the map must grow. If 0, room for
+ *                  HASH_MAP_INITIAL_CAPACITY / 2 keys is made.
+ *
+ * @return Pointer to the created hash map.
+ */
+struct hash_map *create_hash_map(uint32_t capacity);
+
+
+/**
+ * Destructs a hash map created with create_hash_map.
+ *
+ * Keys and values are not owned by the map, so they must be freed by the caller if needed.
+ *
+ * @param map  The hash map to destroy.
+ */
+void destroy_hash_map(struct hash_map *map);
+
+
+/**
+ * Adds a key to the hash map.
+ *
+ * @param map    The hash map to add to.
+ * @param key    The null-terminated key. The map stores the pointer, so the string must remain
+ *               valid and unchanged for as long as it is in the map.
+ * @param value  The data to associate with the key.
+ *
+ * @return The status of the insert operation. If the key is already in the map, DUPLICATE_KEY is
+ *         returned and the existing value is kept.
+ */
+enum hash_map_status hash_map_insert(struct hash_map *map, const char *key, void *value);
+
+
+/**
+ * Gets the data associated with a key in the hash map.
+ *
+ * @param map    The hash map to search.
+ * @param key    The null-terminated key to find.
+ * @param value  A pointer to place the data.
+ *
+ * @return The status of the lookup operation. If not successful, no guarantee is made about the
+ *         void * pointer stored in value.
+ */
+enum hash_map_status hash_map_get(const struct hash_map *map, const char *key, void **value);
+
+
+#endif  // _STRUCTURES_HASH_MAP_H_
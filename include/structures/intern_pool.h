@@ -0,0 +1,137 @@
+/**
+ * A pool that stores one copy of each distinct string and identifies it by a small integer.
+ *
+ * @author Jonathan Uhler
+ */
+
+
+#ifndef _STRUCTURES_INTERN_POOL_H_
+#define _STRUCTURES_INTERN_POOL_H_
+
+
+#include "structures/arena.h"
+#include "structures/vector.h"
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** The number of slots allocated by a new intern pool. */
+#define INTERN_POOL_INITIAL_CAPACITY 64
+
+
+/**
+ * A single interned string.
+ */
+struct intern_pool_entry {
+    /** The null-terminated text of the string, owned by the pool. */
+    const char *text;
+    /** The number of characters in the string. */
+    uint32_t length;
+    /** The hash of the string, used to skip most string comparisons and to rehash. */
+    uint32_t hash;
+};
+
+
+/**
+ * An intern pool using linear probing.
+ *
+ * IDs are assigned densely from 0 in the order strings are first interned, and an ID and its text
+ * stay valid until the pool is destroyed.
+ */
+struct intern_pool {
+    /** The interned strings, indexed by ID (struct intern_pool_entry elements). */
+    struct vector *entries;
+    /** The slots of the lookup table, each holding an ID plus one (or 0 if the slot is empty). */
+    uint32_t *slots;
+    /** The number of slots (always a power of two). */
+    uint32_t capacity;
+    /** The arena that the text of the strings is copied into. */
+    struct arena *text;
+};
+
+
+/**
+ * Status of intern pool API calls.
+ */
+enum intern_pool_status {
+    /** The intern pool API function completed successfully. */
+    INTERN_POOL_STATUS_SUCCESS = 0,
+    /** The intern pool API function did not complete because the string is not in the pool. */
+    INTERN_POOL_STATUS_NOT_FOUND,
+    /** The intern pool API function did not complete because it was called incorrectly. */
+    INTERN_POOL_STATUS_INVALID_ARGUMENT,
+    /** The intern pool API function did not complete because the pool could not grow. */
+    INTERN_POOL_STATUS_OUT_OF_MEMORY
+};
+
+
+/**
+ * Creates a new intern pool with no strings.
+ *
+ * @return Pointer to the created intern pool.
+ */
+struct intern_pool *create_intern_pool(void);
+
+
+/**
+ * Destructs an intern pool created with create_intern_pool, including the text of its strings.
+ *
+ * @param pool  The intern pool to destroy.
+ */
+void destroy_intern_pool(struct intern_pool *pool);
+
+
+/**
+ * Gets the ID of a string, adding a copy of the string to the pool if it is not already in it.
+ *
+ * @param pool     The intern pool to add to.
+ * @param text     The text of the string, which does not need to be null-terminated.
+ * @param length   The number of characters in the string.
+ * @param id[out]  A pointer to return the ID of the string.
+ *
+ * @return The status of the intern operation.
+ */
+enum intern_pool_status intern_pool_intern(struct intern_pool *pool,
+                                           const char *text,
+                                           size_t length,
+                                           uint32_t *id);
+
+
+/**
+ * Gets the ID of a string without adding it to the pool.
+ *
+ * @param pool     The intern pool to search.
+ * @param text     The text of the string, which does not need to be null-terminated.
+ * @param length   The number of characters in the string.
+ * @param id[out]  A pointer to return the ID of the string.
+ *
+ * @return The status of the lookup operation. NOT_FOUND if the string has not been interned.
+ */
+enum intern_pool_status intern_pool_find(const struct intern_pool *pool,
+                                         const char *text,
+                                         size_t length,
+                                         uint32_t *id);
+
+
+/**
+ * Gets the text of an interned string.
+ *
+ * @param pool  The intern pool the string was interned in.
+ * @param id    The ID of the string.
+ *
+ * @return The null-terminated text of the string, or NULL if the ID is invalid.
+ */
+const char *intern_pool_text(const struct intern_pool *pool, uint32_t id);
+
+
+/**
+ * Gets the number of distinct strings in an intern pool, which is one more than the largest ID.
+ *
+ * @param pool  The intern pool to query.
+ *
+ * @return The number of strings in the pool.
+ */
+uint32_t intern_pool_size(const struct intern_pool *pool);
+
+
+#endif  // _STRUCTURES_INTERN_POOL_H_
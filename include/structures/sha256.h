@@ -0,0 +1,64 @@
+/**
+ * The SHA-256 hash function, used to identify data by its content.
+ *
+ * @author Jonathan Uhler
+ */
+
+
+#ifndef _STRUCTURES_SHA256_H_
+#define _STRUCTURES_SHA256_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** The number of bytes in a SHA-256 digest. */
+#define SHA256_DIGEST_SIZE 32
+/** The number of bytes hashed at a time. */
+#define SHA256_BLOCK_SIZE 64
+
+
+/**
+ * The state of a hash that data is being added to.
+ */
+struct sha256 {
+    /** The intermediate hash value. */
+    uint32_t state[8];
+    /** The data not yet hashed, which is less than one block. */
+    uint8_t buffer[SHA256_BLOCK_SIZE];
+    /** The number of bytes in the buffer. */
+    uint32_t buffer_size;
+    /** The total number of bytes added. */
+    uint64_t length;
+};
+
+
+/**
+ * Starts a new hash.
+ *
+ * @param hash  The hash to initialize.
+ */
+void sha256_init(struct sha256 *hash);
+
+
+/**
+ * Adds data to a hash.
+ *
+ * @param hash    The hash to add to.
+ * @param data    The data to add.
+ * @param length  The number of bytes of data.
+ */
+void sha256_update(struct sha256 *hash, const void *data, size_t length);
+
+
+/**
+ * Finishes a hash. No more data can be added afterwards.
+ *
+ * @param hash         The hash to finish.
+ * @param digest[out]  The buffer to store the SHA256_DIGEST_SIZE bytes of the digest in.
+ */
+void sha256_finish(struct sha256 *hash, uint8_t *digest);
+
+
+#endif  // _STRUCTURES_SHA256_H_
@@ -0,0 +1,182 @@
+/**
+ * A generic growable array that stores elements contiguously in the assembler and simulator.
+ *
+ * @author Jonathan Uhler
+ */
+
+
+#ifndef _STRUCTURES_VECTOR_H_
+#define _STRUCTURES_VECTOR_H_
+
+
+#include "structures/arena.h"
+#include <stddef.h>
+#include <stdint.h>
+
+
+/** The number of elements allocated the first time an element is added to an empty vector. */
+#define VECTOR_INITIAL_CAPACITY 16
+
+
+/**
+ * A vector of zero or more elements of the same size.
+ */
+struct vector {
+    /** Pointer to the element storage. The user is responsible for casting to another type. */
+    void *data;
+    /** The size in bytes of each element. */
+    size_t element_size;
+    /** Number of elements in the vector. */
+    uint32_t size;
+    /** Number of elements that fit in the element storage before it must be reallocated. */
+    uint32_t capacity;
+    /** The arena that the vector and its element storage are allocated from (or NULL for heap). */
+    struct arena *arena;
+};
+
+
+/**
+ * A position in a vector used to visit its elements in order.
+ */
+struct vector_iterator {
+    /** The vector being iterated over. */
+    const struct vector *vector;
+    /** The index of the next element to visit. */
+    uint32_t index;
+};
+
+
+/**
+ * Status of vector API calls.
+ */
+enum vector_status {
+    /** The vector API function completed successfully. */
+    VECTOR_STATUS_SUCCESS = 0,
+    /** The vector API function did not complete because the provided index is invalid. */
+    VECTOR_STATUS_INVALID_INDEX,
+    /** The vector API function did not complete because it was called incorrectly. */
+    VECTOR_STATUS_INVALID_ARGUMENT,
+    /** The vector API function did not complete because the element storage could not grow. */
+    VECTOR_STATUS_OUT_OF_MEMORY
+};
+
+
+/**
+ * Creates a new vector with zero elements.
+ *
+ * @param element_size  The size in bytes of each element.
+ *
+ * @return Pointer to the created vector.
+ */
+struct vector *create_vector(size_t element_size);
+
+
+/**
+ * Creates a new vector with zero elements whose memory is allocated from an arena.
+ *
+ * When the vector grows, its element storage is extended in place if it is the most recent arena
+ * allocation, and is otherwise copied (abandoning the old storage in the arena). All of its memory
+ * is released when the arena is reset or destroyed.
+ *
+ * @param arena         The arena to allocate from. If NULL, this is equivalent to create_vector.
+ * @param element_size  The size in bytes of each element.
+ *
+ * @return Pointer to the created vector, or NULL if the arena is out of memory.
+ */
+struct vector *create_vector_in_arena(struct arena *arena, size_t element_size);
+
+
+/**
+ * Destructs a vector created with create_vector.
+ *
+ * Elements are stored by value, so any memory they point to must be freed by the caller first.
+ * Calling this on a vector created with create_vector_in_arena has no effect.
+ *
+ * @param vector  The vector to destroy.
+ */
+void destroy_vector(struct vector *vector);
+
+
+/**
+ * Ensures the vector can hold at least the specified number of elements without reallocating.
+ *
+ * @param vector    The vector to reserve space in.
+ * @param capacity  The number of elements to reserve space for.
+ *
+ * @return The status of the reserve operation.
+ */
+enum vector_status vector_reserve(struct vector *vector, uint32_t capacity);
+
+
+/**
+ * Copies the provided element to the end of the vector.
+ *
+ * @param vector   The vector to add data to.
+ * @param element  Pointer to the element to copy (element_size bytes).
+ *
+ * @return The status of the add operation.
+ */
+enum vector_status vector_add(struct vector *vector, const void *element);
+
+
+/**
+ * Copies a run of elements into the vector so that the first of them occupies the specified index.
+ *
+ * @param vector    The vector to add data to.
+ * @param index     The index to insert the elements at. Indices strictly larger than the size of
+ *                  the vector are invalid.
+ * @param elements  Pointer to the elements to copy.
+ * @param count     The number of elements to copy.
+ *
+ * @return The status of the insert operation.
+ */
+enum vector_status vector_insert_at(struct vector *vector,
+                                    uint32_t index,
+                                    const void *elements,
+                                    uint32_t count);
+
+
+/**
+ * Gets a pointer to the element at the specified index in the vector.
+ *
+ * @param vector  The vector to get data from.
+ * @param index   The index to get the element at.
+ *
+ * @return Pointer to the element, or NULL if the index is invalid. The pointer is only valid until
+ *         the next operation that adds elements to the vector.
+ */
+void *vector_at(const struct vector *vector, uint32_t index);
+
+
+/**
+ * Removes all elements at or after the specified index.
+ *
+ * @param vector  The vector to shrink.
+ * @param size    The new number of elements, which must not be larger than the current size.
+ *
+ * @return The status of the truncate operation.
+ */
+enum vector_status vector_truncate(struct vector *vector, uint32_t size);
+
+
+/**
+ * Creates an iterator positioned at the first element of the vector.
+ *
+ * @param vector  The vector to iterate over.
+ *
+ * @return The iterator.
+ */
+struct vector_iterator vector_iterate(const struct vector *vector);
+
+
+/**
+ * Gets the next element from an iterator and advances it.
+ *
+ * @param iterator[inout]  The iterator to advance.
+ *
+ * @return Pointer to the next element, or NULL once every element has been visited.
+ */
+void *vector_iterator_next(struct vector_iterator *iterator);
+
+
+#endif  // _STRUCTURES_VECTOR_H_
@@ -1,4 +1,6 @@
 #include "architecture/isa.h"
+#include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -90,45 +92,213 @@ static const struct isa_opcode_map isa_opcode_table[] = {
 };
 
 
-const struct isa_register_map *isa_get_register_map_from_symbol(const char *symbol) {
-    size_t n = sizeof(isa_register_table) / sizeof(isa_register_table[0]);
-    for (size_t i = 0; i < n; i++) {
-        if (strncmp(symbol, isa_register_table[i].symbol, ISA_REGISTER_SYMBOL_MAX_LENGTH) == 0) {
-            return &isa_register_table[i];
+/** The number of slots in the register symbol hash table (a power of two). */
+#define ISA_REGISTER_HASH_SIZE 512
+/** The number of slots in the opcode symbol hash table (a power of two). */
+#define ISA_OPCODE_HASH_SIZE   256
+
+
+/** Register mappings indexed by register index, built from isa_register_table. */
+static const struct isa_register_map *isa_register_index_table[ISA_NUM_REGISTERS];
+/** Core opcode mappings indexed by opcode value, built from isa_opcode_table. */
+static const struct isa_opcode_map *isa_opcode_value_table[ISA_NUM_OPCODES];
+/** Perfect hash of register symbols, holding (index into isa_register_table) + 1 or 0 if empty. */
+static uint8_t isa_register_hash_table[ISA_REGISTER_HASH_SIZE];
+/** Perfect hash of opcode symbols, holding (index into isa_opcode_table) + 1 or 0 if empty. */
+static uint8_t isa_opcode_hash_table[ISA_OPCODE_HASH_SIZE];
+/** The seed that makes the register symbol hash collision-free. */
+static uint32_t isa_register_hash_seed;
+/** The seed that makes the opcode symbol hash collision-free. */
+static uint32_t isa_opcode_hash_seed;
+/** Ensures the lookup tables are built exactly once, even when first used by several threads. */
+static pthread_once_t isa_lookup_tables_once = PTHREAD_ONCE_INIT;
+
+
+/**
+ * Gets the length of a symbol without reading past a maximum length.
+ *
+ * @param symbol      The null terminated symbol.
+ * @param max_length  The maximum length of interest.
+ *
+ * @return The length of the symbol, or max_length + 1 if it is longer than max_length.
+ */
+static size_t isa_symbol_length(const char *symbol, size_t max_length) {
+    size_t length = 0;
+    while (length <= max_length && symbol[length] != '\0') {
+        length++;
+    }
+    return length;
+}
+
+
+/**
+ * Checks whether a run of characters spells exactly the specified symbol.
+ *
+ * @param text    The characters to check (not necessarily null terminated).
+ * @param length  The number of characters in text.
+ * @param symbol  The null terminated symbol to compare against.
+ *
+ * @return Whether the text and symbol are equal.
+ */
+static bool isa_symbol_matches(const char *text, size_t length, const char *symbol) {
+    return strncmp(text, symbol, length) == 0 && symbol[length] == '\0';
+}
+
+
+/**
+ * Hashes a symbol with a seeded FNV-1a hash.
+ *
+ * @param symbol  The symbol to hash.
+ * @param length  The number of characters in the symbol.
+ * @param seed    The seed to mix into the hash.
+ *
+ * @return The hash of the symbol.
+ */
+static uint32_t isa_hash_symbol(const char *symbol, size_t length, uint32_t seed) {
+    uint32_t hash = 2166136261U ^ seed;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t) symbol[i];
+        hash *= 16777619U;
+    }
+    return hash ^ (hash >> 15);
+}
+
+
+/**
+ * Finds a seed for which no two symbols hash to the same slot and fills the hash table with it.
+ *
+ * @param symbols[in]  The symbols to place.
+ * @param n            The number of symbols.
+ * @param slots[out]   The hash table to fill with (symbol index + 1) values.
+ * @param num_slots    The number of slots in the hash table (a power of two larger than n).
+ *
+ * @return The seed that was used.
+ */
+static uint32_t isa_build_perfect_hash(const char *const *symbols,
+                                       size_t n,
+                                       uint8_t *slots,
+                                       size_t num_slots)
+{
+    for (uint32_t seed = 0; ; seed++) {
+        memset(slots, 0, num_slots);
+
+        size_t i;
+        for (i = 0; i < n; i++) {
+            uint32_t slot = isa_hash_symbol(symbols[i], strlen(symbols[i]), seed) & (num_slots - 1);
+            if (slots[slot] != 0) {
+                break;
+            }
+            slots[slot] = (uint8_t) (i + 1);
+        }
+
+        if (i == n) {
+            return seed;
         }
     }
-    return NULL;
 }
 
 
-const struct isa_register_map *isa_get_register_map_from_index(enum isa_register index) {
-    size_t n = sizeof(isa_register_table) / sizeof(isa_register_table[0]);
-    for (size_t i = 0; i < n; i++) {
-        if (index == isa_register_table[i].index) {
-            return &isa_register_table[i];
+/**
+ * Fills the dense index tables and the perfect hash tables from the symbol tables the first time
+ * a lookup is made.
+ *
+ * Only the first mapping for each value is kept in the index tables, so the same entries are
+ * returned as a linear scan of the symbol tables would find (ABI register names and core opcodes).
+ */
+static void isa_fill_lookup_tables(void) {
+    size_t num_registers = sizeof(isa_register_table) / sizeof(isa_register_table[0]);
+    const char *register_symbols[sizeof(isa_register_table) / sizeof(isa_register_table[0])];
+    for (size_t i = 0; i < num_registers; i++) {
+        const struct isa_register_map *map = &isa_register_table[i];
+        if (isa_register_index_table[map->index] == NULL) {
+            isa_register_index_table[map->index] = map;
+        }
+        register_symbols[i] = map->symbol;
+    }
+    isa_register_hash_seed = isa_build_perfect_hash(register_symbols, num_registers,
+                                                    isa_register_hash_table,
+                                                    ISA_REGISTER_HASH_SIZE);
+
+    size_t num_opcodes = sizeof(isa_opcode_table) / sizeof(isa_opcode_table[0]);
+    const char *opcode_symbols[sizeof(isa_opcode_table) / sizeof(isa_opcode_table[0])];
+    for (size_t i = 0; i < num_opcodes; i++) {
+        const struct isa_opcode_map *map = &isa_opcode_table[i];
+        if (map->format != ISA_OPCODE_FORMAT_PSEUDO &&
+            isa_opcode_value_table[map->opcode] == NULL)
+        {
+            isa_opcode_value_table[map->opcode] = map;
         }
+        opcode_symbols[i] = map->symbol;
+    }
+    isa_opcode_hash_seed = isa_build_perfect_hash(opcode_symbols, num_opcodes,
+                                                  isa_opcode_hash_table,
+                                                  ISA_OPCODE_HASH_SIZE);
+}
+
+
+/**
+ * Builds the lookup tables if they have not been built yet.
+ */
+static void isa_build_lookup_tables(void) {
+    pthread_once(&isa_lookup_tables_once, &isa_fill_lookup_tables);
+}
+
+
+const struct isa_register_map *isa_get_register_map_from_symbol(const char *symbol) {
+    size_t length = isa_symbol_length(symbol, ISA_REGISTER_SYMBOL_MAX_LENGTH);
+    return isa_get_register_map_from_text(symbol, length);
+}
+
+
+const struct isa_register_map *isa_get_register_map_from_text(const char *text, size_t length) {
+    if (length > ISA_REGISTER_SYMBOL_MAX_LENGTH) {
+        return NULL;
+    }
+
+    isa_build_lookup_tables();
+    uint32_t hash = isa_hash_symbol(text, length, isa_register_hash_seed);
+    uint8_t entry = isa_register_hash_table[hash & (ISA_REGISTER_HASH_SIZE - 1)];
+    if (entry == 0 || !isa_symbol_matches(text, length, isa_register_table[entry - 1].symbol)) {
+        return NULL;
     }
-    return NULL;
+    return &isa_register_table[entry - 1];
+}
+
+
+const struct isa_register_map *isa_get_register_map_from_index(enum isa_register index) {
+    if ((uint32_t) index >= ISA_NUM_REGISTERS) {
+        return NULL;
+    }
+    isa_build_lookup_tables();
+    return isa_register_index_table[index];
 }
 
 
 const struct isa_opcode_map *isa_get_opcode_map_from_symbol(const char *symbol) {
-    size_t n = sizeof(isa_opcode_table) / sizeof(isa_opcode_table[0]);
-    for (size_t i = 0; i < n; i++) {
-        if (strncmp(symbol, isa_opcode_table[i].symbol, ISA_OPCODE_SYMBOL_MAX_LENGTH) == 0) {
-            return &isa_opcode_table[i];
-        }
+    size_t length = isa_symbol_length(symbol, ISA_OPCODE_SYMBOL_MAX_LENGTH);
+    return isa_get_opcode_map_from_text(symbol, length);
+}
+
+
+const struct isa_opcode_map *isa_get_opcode_map_from_text(const char *text, size_t length) {
+    if (length > ISA_OPCODE_SYMBOL_MAX_LENGTH) {
+        return NULL;
     }
-    return NULL;
+
+    isa_build_lookup_tables();
+    uint32_t hash = isa_hash_symbol(text, length, isa_opcode_hash_seed);
+    uint8_t entry = isa_opcode_hash_table[hash & (ISA_OPCODE_HASH_SIZE - 1)];
+    if (entry == 0 || !isa_symbol_matches(text, length, isa_opcode_table[entry - 1].symbol)) {
+        return NULL;
+    }
+    return &isa_opcode_table[entry - 1];
 }
 
 
 const struct isa_opcode_map *isa_get_opcode_map_from_opcode(enum isa_opcode opcode) {
-    size_t n = sizeof(isa_opcode_table) / sizeof(isa_opcode_table[0]);
-    for (size_t i = 0; i < n; i++) {
-        if (opcode == isa_opcode_table[i].opcode) {
-            return &isa_opcode_table[i];
-        }
+    if ((uint32_t) opcode >= ISA_NUM_OPCODES) {
+        return NULL;
     }
-    return NULL;
+    isa_build_lookup_tables();
+    return isa_opcode_value_table[opcode];
 }
@@ -1,11 +1,21 @@
+#define _DEFAULT_SOURCE
 #include "assembler/encoder.h"
+#include "assembler/image_cache.h"
+#include "assembler/include_cache.h"
 #include "assembler/lexer.h"
+#include "assembler/object.h"
 #include "assembler/parser.h"
 #include "architecture/logger.h"
-#include "structures/list.h"
+#include "structures/arena.h"
+#include "structures/vector.h"
 #include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 
 void usage(const char *error) {
@@ -13,29 +23,116 @@ void usage(const char *error) {
         log_error("%s", error);
     }
 
-    printf("usage: assembler [-o path] [-v] path\n");
+    printf("usage: assembler [-c] [-o path] [-s scanner] [-j jobs] [-u] [-C dir] [-S] [-v] path\n");
     printf("\n");
     printf("options:\n");
-    printf("  -o path  specify the output path for the generated binary (default a.out)\n");
-    printf("  -v       verbosity level for log messages, can be specified multiple times\n");
+    printf("  -c          write a relocatable object for the linker instead of a binary\n");
+    printf("  -o path     specify the output path for the generated binary (default a.out)\n");
+    printf("  -s scanner  lexer whitespace scanner: scalar, vector, or checked (default vector)\n");
+    printf("  -j jobs     threads that lex included files ahead of the parser (default one per\n");
+    printf("              processor, up to %d; 0 lexes included files only when reached)\n",
+           INCLUDE_CACHE_MAX_WORKERS);
+    printf("  -u          include each file at most once, skipping later includes of it\n");
+    printf("  -C dir      reuse images assembled from the same sources, cached in a directory\n");
+    printf("  -S          print the hit and miss counts of the cache (path is optional)\n");
+    printf("  -v          verbosity level for log messages, can be specified multiple times\n");
     printf("\n");
     printf("argument:\n");
-    printf("  path     the path to the assembly source file\n");
+    printf("  path        the path to the assembly source file\n");
     exit(error != NULL);
 }
 
 
+/**
+ * Passes a semantic group from the parser straight to the encoder, so that groups are never
+ * stored.
+ *
+ * @see parser_group_callback
+ */
+static enum parser_status encode_group(void *data,
+                                       const struct parser_group *group,
+                                       const struct parser_directive *directive)
+{
+    struct encoder_context *encoder_context = (struct encoder_context *) data;
+    enum encoder_status encoder_status = encoder_encode_group(encoder_context, group, directive);
+    if (encoder_status != ENCODER_STATUS_SUCCESS) {
+        log_error("Encoder could not encode group of type %d (errno %d)",
+                  group->type, encoder_status);
+        return PARSER_STATUS_STOPPED;
+    }
+    return PARSER_STATUS_SUCCESS;
+}
+
+
+/**
+ * Prints the hit and miss counts of an image cache.
+ *
+ * @param image_cache  The image cache.
+ */
+static void print_cache_statistics(const struct image_cache *image_cache) {
+    uint64_t hits;
+    uint64_t misses;
+    if (image_cache_statistics(image_cache, &hits, &misses) != IMAGE_CACHE_STATUS_SUCCESS) {
+        log_error("Cannot read statistics of cache '%s'", image_cache->directory);
+        return;
+    }
+    uint64_t lookups = hits + misses;
+    printf("cache: %" PRIu64 " hits, %" PRIu64 " misses (%.1f%% hit rate)\n",
+           hits, misses, lookups > 0 ? 100.0 * (double) hits / (double) lookups : 0.0);
+}
+
+
 int main(int argc, char *argv[]) {
     char *output_path = "./a.out";
     char *input_path = NULL;
     enum logger_log_level verbosity = LOGGER_LEVEL_WARN;
+    enum lexer_scanner scanner = LEXER_SCANNER_VECTOR;
+    long num_processors = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t num_jobs = num_processors > 0 ? (uint32_t) num_processors : 1;
+    bool include_once = false;
+    bool relocatable = false;
+    char *cache_directory = NULL;
+    bool print_statistics = false;
 
     int flag;
-    while ((flag = getopt(argc, argv, "o:v")) != -1) {
+    char *end;
+    while ((flag = getopt(argc, argv, "co:s:j:uC:Sv")) != -1) {
         switch (flag) {
+        case 'c':
+            relocatable = true;
+            break;
         case 'o':
             output_path = optarg;
             break;
+        case 's':
+            if (strcmp(optarg, "scalar") == 0) {
+                scanner = LEXER_SCANNER_SCALAR;
+            }
+            else if (strcmp(optarg, "vector") == 0) {
+                scanner = LEXER_SCANNER_VECTOR;
+            }
+            else if (strcmp(optarg, "checked") == 0) {
+                scanner = LEXER_SCANNER_CHECKED;
+            }
+            else {
+                usage("unknown scanner");
+            }
+            break;
+        case 'j':
+            num_jobs = (uint32_t) strtoul(optarg, &end, 10);
+            if (*optarg == '\0' || *end != '\0') {
+                usage("invalid number of jobs");
+            }
+            break;
+        case 'u':
+            include_once = true;
+            break;
+        case 'C':
+            cache_directory = optarg;
+            break;
+        case 'S':
+            print_statistics = true;
+            break;
         case 'v':
             verbosity++;
             break;
@@ -47,25 +144,85 @@ int main(int argc, char *argv[]) {
 
     logger_set_level(verbosity);
 
+    struct image_cache *image_cache = NULL;
+    if (cache_directory != NULL) {
+        image_cache = create_image_cache(cache_directory);
+        if (image_cache == NULL) {
+            log_fatal("Cannot open cache directory '%s'", cache_directory);
+        }
+    }
+    else if (print_statistics) {
+        usage("-S requires a cache directory given with -C");
+    }
+
     if (optind >= argc || argv[optind] == NULL) {
+        if (print_statistics) {
+            print_cache_statistics(image_cache);
+            destroy_image_cache(image_cache);
+            return 0;
+        }
         usage("missing required 'path' argument");
     }
     input_path = argv[optind];
 
-    struct list *tokens;
-    enum lexer_status lex_status = lexer_lex_file(input_path, &tokens);
-    if (lex_status != LEXER_STATUS_SUCCESS) {
-        log_fatal("Lexer failed, will not proceed with parsing (errno %d)", lex_status);
+    // The key covers every input that changes the output, so a cached image is the same one that
+    // assembling would produce, and none of the lexer, parser, or encoder needs to run.
+    struct image_cache_key cache_key;
+    bool cacheable = false;
+    if (image_cache != NULL) {
+        uint8_t options[] = {relocatable, include_once};
+        cacheable = image_cache_compute_key(input_path, options, sizeof(options),
+                                            &cache_key) == IMAGE_CACHE_STATUS_SUCCESS;
+        if (cacheable &&
+            image_cache_fetch(image_cache, &cache_key, output_path) == IMAGE_CACHE_STATUS_SUCCESS)
+        {
+            log_info("Assembly cache hit for '%s'", input_path);
+            image_cache_record(image_cache, true);
+            if (print_statistics) {
+                print_cache_statistics(image_cache);
+            }
+            destroy_image_cache(image_cache);
+            return 0;
+        }
+        log_info("Assembly cache miss for '%s'", input_path);
     }
 
-    struct list *groups;
-    enum parser_status parse_status = parser_parse_tokens(tokens, &groups);
+    // Tokens are pulled from the lexer as the parser needs them, and each group is encoded as
+    // soon as it is parsed, so only the source text, label tables, and image grow with the input.
+    struct arena *source_arena = create_arena(0);
+    struct arena *encoder_arena = create_arena(0);
+    struct lexer_context *lexer_context = create_lexer_context();
+    struct parser_context *parser_context = create_parser_context(lexer_context);
+    lexer_set_scanner(lexer_context, scanner);
+    struct include_cache *include_cache = create_include_cache(num_jobs, scanner, include_once);
+    parser_set_include_cache(parser_context, include_cache);
+
+    struct encoder_image image;
+    struct encoder_context *encoder_context =
+        create_encoder_context(lexer_context->identifiers, encoder_arena, &image);
+    if (relocatable) {
+        encoder_set_relocatable(encoder_context);
+    }
+    enum parser_status parse_status = parser_stream_file(parser_context, input_path,
+                                                         source_arena, encode_group,
+                                                         encoder_context);
+    if (parse_status == PARSER_STATUS_LEXER_ERROR) {
+        log_fatal("Lexer failed, will not proceed with parsing");
+    }
+    if (parse_status == PARSER_STATUS_STOPPED) {
+        log_fatal("Encoder failed, will not proceed with output file writing");
+    }
     if (parse_status != PARSER_STATUS_SUCCESS) {
         log_fatal("Parser failed, will not proceed with encoding (errno %d)", parse_status);
     }
+    arena_reset(source_arena);
+    destroy_include_cache(include_cache);
 
-    struct list *bytes;
-    enum encoder_status encoder_status = encoder_encode_groups(groups, &bytes);
+    // Label references in an object are left for the linker, so only an image is finished here.
+    struct object object;
+    enum encoder_status encoder_status = relocatable ?
+        encoder_finish_object(encoder_context, encoder_arena, &object) :
+        encoder_finish(encoder_context);
     if (encoder_status != ENCODER_STATUS_SUCCESS) {
         log_fatal("Encoder failed, will not proceed with output file writing");
     }
@@ -75,18 +232,30 @@ int main(int argc, char *argv[]) {
         log_fatal("Cannot open output file '%s'", output_path);
     }
 
-    for (uint32_t i = 0; i < bytes->size; i++) {
-        void *data;
-        list_peek_at(bytes, i, &data);
-        uint8_t *byte = (uint8_t *) data;
-        if (fwrite(byte, sizeof(uint8_t), 1, out_file) != 1) {
-            log_fatal("Cannot write to output file '%s'", output_path);
-        }
+    bool written = relocatable ?
+        object_write(&object, out_file) == OBJECT_STATUS_SUCCESS :
+        encoder_write_image(&image, out_file);
+    if (!written) {
+        log_fatal("Cannot write to output file '%s'", output_path);
     }
 
     fclose(out_file);
-    destroy_list(tokens, &list_default_node_free_callback);
-    destroy_list(groups, &list_default_node_free_callback);
-    destroy_list(bytes, &list_default_node_free_callback);
+    if (image_cache != NULL) {
+        if (cacheable &&
+            image_cache_store(image_cache, &cache_key, output_path) != IMAGE_CACHE_STATUS_SUCCESS)
+        {
+            log_warn("Cannot store output file '%s' in the cache", output_path);
+        }
+        image_cache_record(image_cache, false);
+        if (print_statistics) {
+            print_cache_statistics(image_cache);
+        }
+        destroy_image_cache(image_cache);
+    }
+    destroy_encoder_context(encoder_context);
+    destroy_parser_context(parser_context);
+    destroy_lexer_context(lexer_context);
+    destroy_arena(source_arena);
+    destroy_arena(encoder_arena);
     return 0;
 }
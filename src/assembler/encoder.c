@@ -1,183 +1,590 @@
+#define _DEFAULT_SOURCE
+
+
 #include "assembler/encoder.h"
 #include "assembler/parser.h"
 #include "architecture/isa.h"
 #include "architecture/logger.h"
-#include "structures/list.h"
+#include "structures/intern_pool.h"
+#include "structures/vector.h"
+#include <errno.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+/** Zero bytes referenced by every gap in an image while it is written, so gaps use no memory. */
+static const uint8_t encoder_zero_block[ENCODER_ZERO_BLOCK_SIZE];
+
 
+/** The address of a label ID that has no declaration. */
+#define ENCODER_UNDECLARED_LABEL UINT32_MAX
 
-static enum encoder_status encoder_resolve_labels(struct list *groups) {
-    struct list *labels = create_list();
 
-    for (uint32_t i = 0; i < groups->size; i++) {
-        void *data;
-        list_peek_at(groups, i, &data);
-        struct parser_group *group = (struct parser_group *) data;
-        if (group->type == PARSER_GROUP_LABEL) {
-            log_trace("Encoder registered a new label '%s'", group->label.label);
-            list_pop_at(groups, i, &data);
-            i--;
-            list_add(labels, data);
+/**
+ * Gets the slot of a label in a table indexed by label ID, growing the table if the label has not
+ * been seen yet.
+ *
+ * @param table  The table to search (uint32_t elements).
+ * @param label  The ID of the label.
+ * @param fill   The value of the slots added to the table.
+ *
+ * @return Pointer to the slot, or NULL if the table could not grow.
+ */
+static uint32_t *encoder_label_slot(struct vector *table, uint32_t label, uint32_t fill) {
+    // Label IDs are dense, so label tables are arrays indexed by ID.
+    if (label >= table->size) {
+        if (label == UINT32_MAX || vector_reserve(table, label + 1) != VECTOR_STATUS_SUCCESS) {
+            return NULL;
+        }
+        while (table->size <= label) {
+            vector_add(table, &fill);
         }
     }
-    log_debug("Encoder registered %" PRIu32 " labels", labels->size);
+    return (uint32_t *) vector_at(table, label);
+}
 
-    for (uint32_t i = 0; i < groups->size; i++) {
-        void *data;
-        list_peek_at(groups, i, &data);
-        struct parser_group *group = (struct parser_group *) data;
-        if (strlen(group->instruction.label) == 0) {
-            continue;
+
+/**
+ * Gets the address slot of a label, growing the label table if the label has not been seen yet.
+ *
+ * @param context  The encoder context whose label table is searched.
+ * @param label    The ID of the label.
+ *
+ * @return Pointer to the address of the label (ENCODER_UNDECLARED_LABEL if it has no declaration
+ *         yet), or NULL if the table could not grow.
+ */
+static uint32_t *encoder_label_address(struct encoder_context *context, uint32_t label) {
+    return encoder_label_slot(context->addresses, label, ENCODER_UNDECLARED_LABEL);
+}
+
+
+/**
+ * Resolves a reference to a label from a field that is about to be emitted.
+ *
+ * @param context     The encoder context.
+ * @param label       The ID of the referenced label.
+ * @param type        The type of the referencing field.
+ * @param value[out]  A pointer to return the value of the field.
+ *
+ * @return The status of the reference.
+ */
+static enum encoder_status encoder_reference_label(struct encoder_context *context,
+                                                   uint32_t label,
+                                                   enum object_relocation_type type,
+                                                   uint16_t *value)
+{
+    uint32_t *address = encoder_label_address(context, label);
+    if (address == NULL) {
+        return ENCODER_STATUS_OUT_OF_MEMORY;
+    }
+
+    // A backward reference is resolved now. A forward reference is encoded with a zero value and
+    // patched once every label has been declared (or by the linker, in an object).
+    if (!context->relocatable && *address != ENCODER_UNDECLARED_LABEL) {
+        *value = *address;
+        return ENCODER_STATUS_SUCCESS;
+    }
+
+    struct encoder_fixup fixup = {
+        .offset = context->image->data->size,
+        .label = label,
+        .type = type
+    };
+    if (vector_add(context->fixups, &fixup) != VECTOR_STATUS_SUCCESS) {
+        return ENCODER_STATUS_OUT_OF_MEMORY;
+    }
+    *value = 0;
+    return ENCODER_STATUS_SUCCESS;
+}
+
+
+/**
+ * Starts a new segment of an image at its current position, even if it directly follows the last.
+ *
+ * @param image  The image to add to.
+ */
+static void encoder_start_segment(struct encoder_image *image) {
+    struct encoder_segment segment = {
+        .address = image->position,
+        .offset = image->data->size,
+        .length = 0
+    };
+    vector_add(image->segments, &segment);
+}
+
+
+/**
+ * Appends bytes to an image at its current position, extending the last segment if the bytes
+ * directly follow it.
+ *
+ * @param image  The image to add to.
+ * @param bytes  The bytes to add.
+ * @param count  The number of bytes to add.
+ */
+static void encoder_emit_bytes(struct encoder_image *image, const uint8_t *bytes, uint32_t count) {
+    struct encoder_segment *last = vector_at(image->segments, image->segments->size - 1);
+    if (last == NULL || last->address + last->length != image->position) {
+        encoder_start_segment(image);
+        last = vector_at(image->segments, image->segments->size - 1);
+    }
+
+    vector_insert_at(image->data, image->data->size, bytes, count);
+    last->length += count;
+    image->position += count;
+    if (image->position > image->size) {
+        image->size = image->position;
+    }
+}
+
+
+static void encoder_convert_instruction(struct encoder_image *image, uint32_t binary) {
+    uint8_t bytes[sizeof(uint32_t)];
+    for (uint32_t b = 0; b < sizeof(uint32_t); b++) {
+        bytes[b] = (binary >> (b * CHAR_BIT)) & UINT8_MAX;
+        log_trace("Encoder added instruction[%" PRIu32 "] = %02" PRIx8, b, bytes[b]);
+    }
+    encoder_emit_bytes(image, bytes, sizeof(bytes));
+}
+
+
+static enum encoder_status encoder_convert_directive(struct encoder_context *context,
+                                                     const struct parser_directive *directive)
+{
+    struct encoder_image *image = context->image;
+    switch (directive->type) {
+    case PARSER_DIRECTIVE_ORG:
+        // Padding is not stored; the gap is only produced (as zeros) when the image is written.
+        image->position += directive->org.num_pad_bytes;
+        if (image->position > image->size) {
+            image->size = image->position;
+        }
+        if (context->relocatable) {
+            encoder_start_segment(image);
+        }
+        return ENCODER_STATUS_SUCCESS;
+    case PARSER_DIRECTIVE_HALF: {
+        uint16_t element = directive->half.element;
+        if (directive->half.label != PARSER_NO_LABEL) {
+            enum encoder_status status = encoder_reference_label(context, directive->half.label,
+                                                                 OBJECT_RELOCATION_HALF, &element);
+            if (status != ENCODER_STATUS_SUCCESS) {
+                return status;
+            }
         }
 
-        uint32_t l;
-        for (l = 0; l < labels->size; l++) {
-            void *label_data;
-            list_peek_at(labels, l, &label_data);
-            struct parser_group *label = (struct parser_group *) label_data;
+        uint8_t bytes[sizeof(uint16_t)];
+        for (uint32_t b = 0; b < sizeof(uint16_t); b++) {
+            bytes[b] = (element >> (b * CHAR_BIT)) & UINT8_MAX;
+        }
+        encoder_emit_bytes(image, bytes, sizeof(bytes));
+        return ENCODER_STATUS_SUCCESS;
+    }
+    default:
+        log_fatal("Encoder found unexpected directive for conversion (type %d)", directive->type);
+        return ENCODER_STATUS_UNEXPECTED_GROUP;
+    }
+}
 
-            if (strncmp(label->label.label, group->instruction.label, LEXER_TOKEN_MAX_LENGTH) == 0)
-            {
-                group->instruction.immediate = label->label.immediate;
-                log_trace("Encoder resolved label '%s' to 0x%04" PRIx16,
-                          group->instruction.label, group->instruction.immediate);
-                break;
+
+/**
+ * Encodes the binary value of an instruction group.
+ *
+ * @param group        The instruction group, whose label (if any) has been resolved.
+ * @param binary[out]  A pointer to return the binary value of the instruction.
+ *
+ * @return Whether the instruction could be encoded.
+ */
+static enum encoder_status encoder_resolve_instruction(const struct parser_group *group,
+                                                       uint32_t *binary)
+{
+    const struct isa_opcode_map *opcode_map =
+        isa_get_opcode_map_from_opcode(group->instruction.opcode);
+    if (opcode_map == NULL) {
+        log_error("Encoder could not resolve instruction opcode %d", group->instruction.opcode);
+        return ENCODER_STATUS_UNEXPECTED_GROUP;
+    }
+
+    union isa_instruction instruction;
+    switch (opcode_map->format) {
+    case ISA_OPCODE_FORMAT_I:
+        instruction.i_type = (struct isa_i_format) {
+            .format = opcode_map->format,
+            .funct = opcode_map->funct,
+            .immediate = group->instruction.immediate
+        };
+        break;
+    case ISA_OPCODE_FORMAT_DSI:
+        instruction.dsi_type = (struct isa_dsi_format) {
+            .format = opcode_map->format,
+            .funct = opcode_map->funct,
+            .dest = group->instruction.dest,
+            .source1 = group->instruction.source1,
+            .immediate = group->instruction.immediate
+        };
+        break;
+    case ISA_OPCODE_FORMAT_DSS:
+        instruction.dss_type = (struct isa_dss_format) {
+            .format = opcode_map->format,
+            .funct = opcode_map->funct,
+            .dest = group->instruction.dest,
+            .source1 = group->instruction.source1,
+            .source2 = group->instruction.source2
+        };
+        break;
+    default:
+        log_error("Encoder found opcode %d with unexpected format %d",
+                  group->instruction.opcode, opcode_map->format);
+        return ENCODER_STATUS_UNEXPECTED_GROUP;
+    }
+
+    *binary = instruction.binary;
+    return ENCODER_STATUS_SUCCESS;
+}
+
+
+struct encoder_context *create_encoder_context(const struct intern_pool *labels,
+                                              struct arena *arena,
+                                              struct encoder_image *image)
+{
+    struct encoder_context *context =
+        (struct encoder_context *) malloc(sizeof(struct encoder_context));
+
+    image->data = create_vector_in_arena(arena, sizeof(uint8_t));
+    image->segments = create_vector_in_arena(arena, sizeof(struct encoder_segment));
+    image->position = 0;
+    image->size = 0;
+
+    context->image = image;
+    context->labels = labels;
+    context->addresses = create_vector_in_arena(arena, sizeof(uint32_t));
+    context->fixups = create_vector_in_arena(arena, sizeof(struct encoder_fixup));
+    context->relocatable = false;
+    context->label_segments = create_vector_in_arena(arena, sizeof(uint32_t));
+
+    return context;
+}
+
+
+void destroy_encoder_context(struct encoder_context *context) {
+    if (context == NULL) {
+        return;
+    }
+
+    destroy_vector(context->addresses);
+    destroy_vector(context->fixups);
+    destroy_vector(context->label_segments);
+    free(context);
+}
+
+
+void encoder_set_relocatable(struct encoder_context *context) {
+    if (context == NULL || context->relocatable) {
+        return;
+    }
+
+    // The relocatable segment exists even if it is empty, so that labels declared before the
+    // first .org directive have a section.
+    context->relocatable = true;
+    encoder_start_segment(context->image);
+}
+
+
+enum encoder_status encoder_encode_group(struct encoder_context *context,
+                                         const struct parser_group *group,
+                                         const struct parser_directive *directive)
+{
+    struct encoder_image *image = context->image;
+    switch (group->type) {
+    case PARSER_GROUP_LABEL: {
+        // If a label is declared more than once, the first declaration is used.
+        log_trace("Encoder registered a new label '%s'",
+                  intern_pool_text(context->labels, group->label.label));
+        uint32_t *address = encoder_label_address(context, group->label.label);
+        if (address == NULL) {
+            return ENCODER_STATUS_OUT_OF_MEMORY;
+        }
+        if (*address != ENCODER_UNDECLARED_LABEL) {
+            return ENCODER_STATUS_SUCCESS;
+        }
+        *address = group->label.immediate;
+
+        if (context->relocatable) {
+            uint32_t *segment = encoder_label_slot(context->label_segments, group->label.label,
+                                                   ENCODER_UNDECLARED_LABEL);
+            if (segment == NULL) {
+                return ENCODER_STATUS_OUT_OF_MEMORY;
+            }
+            *segment = image->segments->size - 1;
+        }
+        return ENCODER_STATUS_SUCCESS;
+    }
+    case PARSER_GROUP_INSTRUCTION: {
+        log_debug("Encoder found instruction group");
+        struct parser_group instruction = *group;
+        enum encoder_status status;
+        if (instruction.instruction.label != PARSER_NO_LABEL) {
+            uint16_t immediate;
+            status = encoder_reference_label(context, instruction.instruction.label,
+                                             OBJECT_RELOCATION_IMMEDIATE, &immediate);
+            if (status != ENCODER_STATUS_SUCCESS) {
+                return status;
             }
+            instruction.instruction.immediate = immediate;
         }
 
-        if (l >= labels->size) {
-            log_error("Use of undeclared label '%s'", group->instruction.label);
+        uint32_t binary;
+        status = encoder_resolve_instruction(&instruction, &binary);
+        if (status != ENCODER_STATUS_SUCCESS) {
+            return status;
+        }
+        encoder_convert_instruction(image, binary);
+        return ENCODER_STATUS_SUCCESS;
+    }
+    case PARSER_GROUP_DIRECTIVE:
+        log_debug("Encoder found directive group");
+        return encoder_convert_directive(context, directive);
+    default:
+        log_error("Encoder found unexpected semantic group of type %d", group->type);
+        return ENCODER_STATUS_UNEXPECTED_GROUP;
+    }
+}
+
+
+enum encoder_status encoder_finish(struct encoder_context *context) {
+    struct encoder_image *image = context->image;
+    uint8_t *data = (uint8_t *) image->data->data;
+
+    struct vector_iterator iterator = vector_iterate(context->fixups);
+    struct encoder_fixup *fixup;
+    while ((fixup = vector_iterator_next(&iterator)) != NULL) {
+        const char *name = intern_pool_text(context->labels, fixup->label);
+        uint32_t *address = encoder_label_address(context, fixup->label);
+        if (address == NULL || *address == ENCODER_UNDECLARED_LABEL) {
+            log_error("Use of undeclared label '%s'", name);
             return ENCODER_STATUS_UNKNOWN_LABEL;
         }
+
+        object_patch(data + fixup->offset, fixup->type, *address);
+        log_trace("Encoder resolved label '%s' to 0x%04" PRIx16, name, (uint16_t) *address);
     }
 
-    destroy_list(labels, &list_default_node_free_callback);
+    log_info("Encoder finished successfully (bytes encoded: %" PRIu32 ", image size: %" PRIu32
+             ", fixups: %" PRIu32 ")", image->data->size, image->size, context->fixups->size);
     return ENCODER_STATUS_SUCCESS;
 }
 
 
-static enum encoder_status encoder_resolve_instructions(struct list *groups) {
-    for (uint32_t i = 0; i < groups->size; i++) {
-        void *data;
-        list_peek_at(groups, i, &data);
-        struct parser_group *group = (struct parser_group *) data;
-        if (group->type != PARSER_GROUP_INSTRUCTION) {
-            continue;
+enum encoder_status encoder_finish_object(struct encoder_context *context,
+                                          struct arena *arena,
+                                          struct object *object)
+{
+    if (context == NULL || !context->relocatable || object == NULL) {
+        return ENCODER_STATUS_UNEXPECTED_GROUP;
+    }
+
+    struct encoder_image *image = context->image;
+    object_init(arena, object);
+    struct vector_iterator iterator = vector_iterate(image->segments);
+    struct encoder_segment *segment;
+    while ((segment = vector_iterator_next(&iterator)) != NULL) {
+        bool absolute = object->sections->size > 0;
+        struct object_section section = {
+            .address = absolute ? segment->address : 0,
+            .size = segment->length,
+            .absolute = absolute,
+            .data = (uint8_t *) image->data->data + segment->offset
+        };
+        if (vector_add(object->sections, &section) != VECTOR_STATUS_SUCCESS) {
+            return ENCODER_STATUS_OUT_OF_MEMORY;
         }
+    }
 
-        const struct isa_opcode_map *opcode_map =
-            isa_get_opcode_map_from_opcode(group->instruction.opcode);
-        if (opcode_map == NULL) {
-            log_error("Encoder could not resolve instruction opcode %d", group->instruction.opcode);
-            return ENCODER_STATUS_UNEXPECTED_GROUP;
+    // Only identifiers used as labels become symbols, so each label ID is mapped to the index of
+    // its symbol.
+    struct vector *symbol_indices = create_vector(sizeof(uint32_t));
+    enum encoder_status status = ENCODER_STATUS_SUCCESS;
+    const uint32_t *addresses = context->addresses->data;
+    for (uint32_t label = 0; label < context->addresses->size; label++) {
+        uint32_t *index = encoder_label_slot(symbol_indices, label, UINT32_MAX);
+        if (index == NULL) {
+            status = ENCODER_STATUS_OUT_OF_MEMORY;
+            break;
+        }
+        if (addresses[label] == ENCODER_UNDECLARED_LABEL) {
+            continue;
         }
 
-        union isa_instruction instruction;
-        switch (opcode_map->format) {
-        case ISA_OPCODE_FORMAT_I:
-            instruction.i_type = (struct isa_i_format) {
-                .format = opcode_map->format,
-                .funct = opcode_map->funct,
-                .immediate = group->instruction.immediate
-            };
+        uint32_t section = *(uint32_t *) vector_at(context->label_segments, label);
+        segment = vector_at(image->segments, section);
+        struct object_symbol symbol = {
+            .name = intern_pool_text(context->labels, label),
+            .section = section,
+            .offset = addresses[label] - segment->address
+        };
+        *index = object->symbols->size;
+        if (vector_add(object->symbols, &symbol) != VECTOR_STATUS_SUCCESS) {
+            status = ENCODER_STATUS_OUT_OF_MEMORY;
             break;
-        case ISA_OPCODE_FORMAT_DSI:
-            instruction.dsi_type = (struct isa_dsi_format) {
-                .format = opcode_map->format,
-                .funct = opcode_map->funct,
-                .dest = group->instruction.dest,
-                .source1 = group->instruction.source1,
-                .immediate = group->instruction.immediate
-            };
+        }
+    }
+
+    // Fixups are in the order their fields were emitted, so the segment holding each one is found
+    // by walking the segments alongside them.
+    uint32_t section = 0;
+    iterator = vector_iterate(context->fixups);
+    struct encoder_fixup *fixup;
+    while (status == ENCODER_STATUS_SUCCESS && (fixup = vector_iterator_next(&iterator)) != NULL) {
+        segment = vector_at(image->segments, section);
+        while (fixup->offset >= segment->offset + segment->length) {
+            segment = vector_at(image->segments, ++section);
+        }
+
+        uint32_t *index = encoder_label_slot(symbol_indices, fixup->label, UINT32_MAX);
+        if (index == NULL) {
+            status = ENCODER_STATUS_OUT_OF_MEMORY;
             break;
-        case ISA_OPCODE_FORMAT_DSS:
-            instruction.dss_type = (struct isa_dss_format) {
-                .format = opcode_map->format,
-                .funct = opcode_map->funct,
-                .dest = group->instruction.dest,
-                .source1 = group->instruction.source1,
-                .source2 = group->instruction.source2
+        }
+        if (*index == UINT32_MAX) {
+            struct object_symbol symbol = {
+                .name = intern_pool_text(context->labels, fixup->label),
+                .section = OBJECT_NO_SECTION,
+                .offset = 0
             };
-            break;
-        default:
-            continue;
+            *index = object->symbols->size;
+            if (vector_add(object->symbols, &symbol) != VECTOR_STATUS_SUCCESS) {
+                status = ENCODER_STATUS_OUT_OF_MEMORY;
+                break;
+            }
         }
 
-        group->instruction.binary = instruction.binary;
+        struct object_relocation relocation = {
+            .section = section,
+            .offset = fixup->offset - segment->offset,
+            .symbol = *index,
+            .type = fixup->type
+        };
+        if (vector_add(object->relocations, &relocation) != VECTOR_STATUS_SUCCESS) {
+            status = ENCODER_STATUS_OUT_OF_MEMORY;
+        }
     }
+    destroy_vector(symbol_indices);
 
-    return ENCODER_STATUS_SUCCESS;
+    if (status == ENCODER_STATUS_SUCCESS) {
+        log_info("Encoder finished object (sections: %" PRIu32 ", symbols: %" PRIu32
+                 ", relocations: %" PRIu32 ")", object->sections->size, object->symbols->size,
+                 object->relocations->size);
+    }
+    return status;
 }
 
 
-static void encoder_convert_instruction(struct list *bytes, struct parser_group *instruction) {
-    for (uint32_t b = 0; b < sizeof(uint32_t); b++) {
-        uint8_t *byte = (uint8_t *) malloc(sizeof(uint8_t));
-        *byte = (instruction->instruction.binary >> (b * CHAR_BIT)) & UINT8_MAX;
-        list_add(bytes, (void *) byte);
-        log_trace("Encoder added instruction[%" PRIu32 "] = %02" PRIx8, b, *byte);
+enum encoder_status encoder_encode_program(const struct parser_program *program,
+                                           struct arena *arena,
+                                           struct encoder_image *image)
+{
+    struct encoder_context *context = create_encoder_context(program->labels, arena, image);
+
+    enum encoder_status status = ENCODER_STATUS_SUCCESS;
+    struct vector_iterator iterator = vector_iterate(program->groups);
+    struct parser_group *group;
+    while (status == ENCODER_STATUS_SUCCESS && (group = vector_iterator_next(&iterator)) != NULL) {
+        const struct parser_directive *directive = NULL;
+        if (group->type == PARSER_GROUP_DIRECTIVE) {
+            directive = vector_at(program->directives, group->directive.index);
+        }
+        status = encoder_encode_group(context, group, directive);
     }
+    if (status == ENCODER_STATUS_SUCCESS) {
+        status = encoder_finish(context);
+    }
+
+    destroy_encoder_context(context);
+    return status;
 }
 
 
-static void encoder_convert_directive(struct list *bytes, struct parser_group *directive) {
-    switch (directive->directive.type) {
-    case PARSER_DIRECTIVE_ORG:
-        for (uint32_t b = 0; b < directive->directive.org.num_pad_bytes; b++) {
-            uint8_t *byte = (uint8_t *) calloc(1, sizeof(uint8_t));
-            list_add(bytes, (void *) byte);
-        }
-        break;
-    case PARSER_DIRECTIVE_HALF:   
-        for (uint32_t b = 0; b < sizeof(uint16_t); b++) {
-            uint8_t *byte = (uint8_t *) malloc(sizeof(uint8_t));
-            *byte = (directive->directive.half.element >> (b * CHAR_BIT)) & UINT8_MAX;
-            list_add(bytes, (void *) byte);
-        }
-        break;
-    default:
-        log_fatal("Encoder found unexpected directive for conversion (type %d)",
-                  directive->directive.type);
-        return;
+/**
+ * Adds I/O vectors that write a run of zero bytes.
+ *
+ * @param iovecs  The vector of struct iovec to add to.
+ * @param length  The number of zero bytes.
+ */
+static void encoder_add_gap(struct vector *iovecs, uint32_t length) {
+    while (length > 0) {
+        uint32_t chunk = length < ENCODER_ZERO_BLOCK_SIZE ? length : ENCODER_ZERO_BLOCK_SIZE;
+        struct iovec iovec = {.iov_base = (void *) encoder_zero_block, .iov_len = chunk};
+        vector_add(iovecs, &iovec);
+        length -= chunk;
     }
 }
 
 
-enum encoder_status encoder_encode_groups(struct list *groups, struct list **bytes) {
-    enum encoder_status label_resolution_status = encoder_resolve_labels(groups);
-    if (label_resolution_status != ENCODER_STATUS_SUCCESS) {
-        return label_resolution_status;
+bool encoder_write_image(const struct encoder_image *image, FILE *file) {
+    if (image == NULL || file == NULL || fflush(file) != 0) {
+        return false;
     }
 
-    enum encoder_status instruction_resolution_status = encoder_resolve_instructions(groups);
-    if (instruction_resolution_status != ENCODER_STATUS_SUCCESS) {
-        return instruction_resolution_status;
+    // The image is described as a list of I/O vectors, with gaps pointing at a shared block of
+    // zeros, and handed to the kernel in as few writev calls as possible.
+    struct vector *iovecs = create_vector(sizeof(struct iovec));
+    uint32_t address = 0;
+    struct vector_iterator iterator = vector_iterate(image->segments);
+    struct encoder_segment *segment;
+    while ((segment = vector_iterator_next(&iterator)) != NULL) {
+        encoder_add_gap(iovecs, segment->address - address);
+        struct iovec iovec = {
+            .iov_base = (uint8_t *) image->data->data + segment->offset,
+            .iov_len = segment->length
+        };
+        vector_add(iovecs, &iovec);
+        address = segment->address + segment->length;
     }
+    encoder_add_gap(iovecs, image->size - address);
 
-    *bytes = create_list();
-
-    for (uint32_t i = 0; i < groups->size; i++) {
-        void *data;
-        list_peek_at(groups, i, &data);
-        struct parser_group *group = (struct parser_group *) data;
+    long max_iovecs = sysconf(_SC_IOV_MAX);
+    if (max_iovecs <= 0) {
+        max_iovecs = 1;
+    }
 
-        switch (group->type) {
-        case PARSER_GROUP_INSTRUCTION:
-            log_debug("Encoder found instruction group");
-            encoder_convert_instruction(*bytes, group);
-            break;
-        case PARSER_GROUP_DIRECTIVE:
-            log_debug("Encoder found directive group");
-            encoder_convert_directive(*bytes, group);
-            break;
-        default:
-            log_fatal("Encoder found unexpected semantic group of type %d", group->type);
+    int fd = fileno(file);
+    uint32_t first = 0;
+    bool success = true;
+    while (first < iovecs->size) {
+        struct iovec *batch = vector_at(iovecs, first);
+        uint32_t count = iovecs->size - first;
+        if (count > (unsigned long) max_iovecs) {
+            count = max_iovecs;
+        }
+        ssize_t written = writev(fd, batch, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            success = false;
             break;
         }
+
+        // Skip the vectors that were fully written and adjust the first partially written one.
+        while (first < iovecs->size && written > 0) {
+            struct iovec *iovec = vector_at(iovecs, first);
+            if ((size_t) written < iovec->iov_len) {
+                iovec->iov_base = (uint8_t *) iovec->iov_base + written;
+                iovec->iov_len -= written;
+                written = 0;
+            }
+            else {
+                written -= iovec->iov_len;
+                first++;
+            }
+        }
     }
 
-    log_info("Encoder finished successfully (bytes encoded: %" PRIu32 ")", (*bytes)->size);
-    return ENCODER_STATUS_SUCCESS;
+    destroy_vector(iovecs);
+    return success;
 }
@@ -0,0 +1,541 @@
+#define _DEFAULT_SOURCE
+#include "assembler/image_cache.h"
+#include "assembler/lexer.h"
+#include "architecture/logger.h"
+#include "structures/arena.h"
+#include "structures/hash_map.h"
+#include "structures/sha256.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/** Written first into every key, so that keys change if the way they are computed changes. */
+#define IMAGE_CACHE_KEY_FORMAT "image-cache-1"
+
+
+/**
+ * The digest of one source file and the files it includes, computed once per key.
+ */
+struct image_cache_file {
+    /** Whether the digest is being computed, in which case the file includes itself. */
+    bool hashing;
+    /** Whether the file could be read. */
+    bool found;
+    /** The digest of the file, valid once hashing is false. */
+    uint8_t digest[SHA256_DIGEST_SIZE];
+};
+
+
+/**
+ * The files visited while a key is computed, so that a file included many times is read once.
+ */
+struct image_cache_hasher {
+    /** The files visited so far, keyed by their path as written in the source. */
+    struct hash_map *files;
+    /** The arena that the paths and file entries are allocated from. */
+    struct arena *arena;
+};
+
+
+/**
+ * Reads a whole file into memory.
+ *
+ * @param path         The path to the file.
+ * @param text[out]    A pointer to return the contents, which the caller must free.
+ * @param length[out]  A pointer to return the number of bytes read.
+ *
+ * @return Whether the file could be read.
+ */
+static bool image_cache_read_file(const char *path, char **text, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    size_t capacity = 4096;
+    size_t size = 0;
+    char *buffer = (char *) malloc(capacity);
+    while (buffer != NULL) {
+        size += fread(buffer + size, 1, capacity - size, file);
+        if (size < capacity) {
+            break;
+        }
+        capacity *= 2;
+        char *grown = (char *) realloc(buffer, capacity);
+        if (grown == NULL) {
+            free(buffer);
+        }
+        buffer = grown;
+    }
+
+    bool failed = buffer == NULL || ferror(file);
+    fclose(file);
+    if (failed) {
+        free(buffer);
+        return false;
+    }
+    *text = buffer;
+    *length = size;
+    return true;
+}
+
+
+/**
+ * Removes comments from source text and collapses each run of whitespace to a single space.
+ *
+ * Strings are copied unchanged. The result lexes to the same tokens as the original text, so two
+ * files that differ only in comments or layout assemble to the same image.
+ *
+ * @param text             The source text.
+ * @param length           The number of characters in the text.
+ * @param normalized[out]  The buffer to store the normalized text in, at least length bytes long.
+ *
+ * @return The number of characters in the normalized text.
+ */
+static size_t image_cache_normalize(const char *text, size_t length, char *normalized) {
+    size_t size = 0;
+    bool pending_space = false;
+    size_t position = 0;
+    while (position < length) {
+        char c = text[position];
+        if (c == ';') {
+            while (position < length && text[position] != '\n') {
+                position++;
+            }
+            pending_space = true;
+            continue;
+        }
+        if (c == ' ' || (c >= '\t' && c <= '\r')) {
+            pending_space = true;
+            position++;
+            continue;
+        }
+
+        if (pending_space && size > 0) {
+            normalized[size++] = ' ';
+        }
+        pending_space = false;
+
+        if (c == '"') {
+            // A string ends at its closing quote, or is unterminated at the end of the line.
+            normalized[size++] = text[position++];
+            while (position < length && text[position] != '\n') {
+                c = text[position++];
+                normalized[size++] = c;
+                if (c == '"') {
+                    break;
+                }
+            }
+            continue;
+        }
+        normalized[size++] = text[position++];
+    }
+    return size;
+}
+
+
+/**
+ * Finds the next include directive in normalized source text.
+ *
+ * @param text             The normalized source text.
+ * @param length           The number of characters in the text.
+ * @param position[inout]  The position to search from, advanced past the directive.
+ * @param file_name[out]   A buffer of LEXER_TOKEN_MAX_LENGTH + 1 characters to store the name of the
+ *                         included file in, truncated as the lexer would truncate it.
+ *
+ * @return Whether a directive was found.
+ */
+static bool image_cache_next_include(const char *text,
+                                     size_t length,
+                                     size_t *position,
+                                     char *file_name)
+{
+    static const char directive[] = "include";
+    size_t directive_length = sizeof(directive) - 1;
+
+    while (*position < length) {
+        char c = text[(*position)++];
+        if (c == '"') {
+            while (*position < length && text[*position] != '"' && text[*position] != '\n') {
+                (*position)++;
+            }
+            (*position)++;
+            continue;
+        }
+        if (c != '.') {
+            continue;
+        }
+
+        size_t start = *position;
+        if (start < length && text[start] == ' ') {
+            start++;
+        }
+        if (length - start < directive_length ||
+            memcmp(text + start, directive, directive_length) != 0)
+        {
+            continue;
+        }
+        start += directive_length;
+        if (start < length && text[start] == ' ') {
+            start++;
+        }
+        if (start >= length || text[start] != '"') {
+            continue;
+        }
+
+        const char *name = text + start + 1;
+        const char *end = memchr(name, '"', length - start - 1);
+        if (end == NULL) {
+            return false;
+        }
+        size_t name_length = (size_t) (end - name);
+        if (name_length > LEXER_TOKEN_MAX_LENGTH) {
+            name_length = LEXER_TOKEN_MAX_LENGTH;
+        }
+        memcpy(file_name, name, name_length);
+        file_name[name_length] = '\0';
+        *position = (size_t) (end - text) + 1;
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Computes the digest of a source file and the files it includes.
+ *
+ * A file that cannot be read is given a digest that marks it as missing, since assembling it fails
+ * now but may succeed once the file exists.
+ *
+ * @param hasher       The files visited so far.
+ * @param path         The path to the file.
+ * @param depth        The number of includes that led to the file.
+ * @param file[out]    A pointer to return the entry of the file.
+ *
+ * @return SUCCESS, or UNCACHEABLE if the file includes itself or includes nest too deeply.
+ */
+static enum image_cache_status image_cache_hash_file(struct image_cache_hasher *hasher,
+                                                     const char *path,
+                                                     uint32_t depth,
+                                                     struct image_cache_file **file)
+{
+    if (hash_map_get(hasher->files, path, (void **) file) == HASH_MAP_STATUS_SUCCESS) {
+        return (*file)->hashing ? IMAGE_CACHE_STATUS_UNCACHEABLE : IMAGE_CACHE_STATUS_SUCCESS;
+    }
+    if (depth > IMAGE_CACHE_MAX_INCLUDE_DEPTH) {
+        return IMAGE_CACHE_STATUS_UNCACHEABLE;
+    }
+
+    size_t path_length = strlen(path) + 1;
+    char *key = (char *) arena_allocate(hasher->arena, path_length);
+    *file = (struct image_cache_file *) arena_allocate(hasher->arena,
+                                                       sizeof(struct image_cache_file));
+    if (key == NULL || *file == NULL) {
+        return IMAGE_CACHE_STATUS_UNCACHEABLE;
+    }
+    memcpy(key, path, path_length);
+    **file = (struct image_cache_file) {.hashing = true};
+    if (hash_map_insert(hasher->files, key, *file) != HASH_MAP_STATUS_SUCCESS) {
+        return IMAGE_CACHE_STATUS_UNCACHEABLE;
+    }
+
+    struct sha256 hash;
+    sha256_init(&hash);
+
+    char *text;
+    size_t length;
+    (*file)->found = image_cache_read_file(path, &text, &length);
+    if (!(*file)->found) {
+        sha256_update(&hash, "missing", sizeof("missing"));
+        sha256_finish(&hash, (*file)->digest);
+        (*file)->hashing = false;
+        return IMAGE_CACHE_STATUS_SUCCESS;
+    }
+
+    // The text is normalized in place, since the normalized text is never longer.
+    length = image_cache_normalize(text, length, text);
+    uint64_t text_length = length;
+    sha256_update(&hash, &text_length, sizeof(text_length));
+    sha256_update(&hash, text, length);
+
+    enum image_cache_status status = IMAGE_CACHE_STATUS_SUCCESS;
+    size_t position = 0;
+    char file_name[LEXER_TOKEN_MAX_LENGTH + 1];
+    while (status == IMAGE_CACHE_STATUS_SUCCESS &&
+           image_cache_next_include(text, length, &position, file_name))
+    {
+        struct image_cache_file *included;
+        status = image_cache_hash_file(hasher, file_name, depth + 1, &included);
+        if (status == IMAGE_CACHE_STATUS_SUCCESS) {
+            sha256_update(&hash, file_name, strlen(file_name) + 1);
+            sha256_update(&hash, included->digest, SHA256_DIGEST_SIZE);
+        }
+    }
+    free(text);
+
+    sha256_finish(&hash, (*file)->digest);
+    (*file)->hashing = false;
+    return status;
+}
+
+
+/**
+ * Builds the path of a file in a cache directory.
+ *
+ * @param cache   The image cache.
+ * @param key     The key of the image, or NULL for a file that is not an image.
+ * @param suffix  The text after the key (or the whole file name if key is NULL).
+ *
+ * @return The path, which the caller must free, or NULL if the system is out of memory.
+ */
+static char *image_cache_path(const struct image_cache *cache,
+                              const struct image_cache_key *key,
+                              const char *suffix)
+{
+    char name[2 * SHA256_DIGEST_SIZE + 1] = "";
+    for (uint32_t i = 0; key != NULL && i < SHA256_DIGEST_SIZE; i++) {
+        snprintf(name + 2 * i, 3, "%02x", key->digest[i]);
+    }
+
+    size_t size = strlen(cache->directory) + 1 + strlen(name) + strlen(suffix) + 1;
+    char *path = (char *) malloc(size);
+    if (path != NULL) {
+        snprintf(path, size, "%s/%s%s", cache->directory, name, suffix);
+    }
+    return path;
+}
+
+
+/**
+ * Copies the contents of one file to another.
+ *
+ * @param from  The path of the file to copy.
+ * @param to    The path of the file to create or replace.
+ *
+ * @return MISS if from does not exist, IO_ERROR if the copy failed, otherwise SUCCESS.
+ */
+static enum image_cache_status image_cache_copy(const char *from, const char *to) {
+    FILE *in_file = fopen(from, "rb");
+    if (in_file == NULL) {
+        return errno == ENOENT ? IMAGE_CACHE_STATUS_MISS : IMAGE_CACHE_STATUS_IO_ERROR;
+    }
+    FILE *out_file = fopen(to, "wb");
+    if (out_file == NULL) {
+        fclose(in_file);
+        return IMAGE_CACHE_STATUS_IO_ERROR;
+    }
+
+    char buffer[65536];
+    size_t size;
+    bool failed = false;
+    while (!failed && (size = fread(buffer, 1, sizeof(buffer), in_file)) > 0) {
+        failed = fwrite(buffer, 1, size, out_file) != size;
+    }
+    failed |= ferror(in_file) != 0;
+    failed |= fclose(out_file) != 0;
+    fclose(in_file);
+    return failed ? IMAGE_CACHE_STATUS_IO_ERROR : IMAGE_CACHE_STATUS_SUCCESS;
+}
+
+
+/**
+ * Opens and locks the statistics file of a cache, and reads the counts from it.
+ *
+ * @param cache        The image cache.
+ * @param hits[out]    A pointer to return the number of hits.
+ * @param misses[out]  A pointer to return the number of misses.
+ *
+ * @return The locked file descriptor, which the caller must close, or -1 on error.
+ */
+static int image_cache_open_statistics(const struct image_cache *cache,
+                                       uint64_t *hits,
+                                       uint64_t *misses)
+{
+    char *path = image_cache_path(cache, NULL, IMAGE_CACHE_STATISTICS_FILE);
+    if (path == NULL) {
+        return -1;
+    }
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    free(path);
+    if (fd < 0) {
+        return -1;
+    }
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    char text[64];
+    ssize_t size = pread(fd, text, sizeof(text) - 1, 0);
+    text[size > 0 ? size : 0] = '\0';
+    if (sscanf(text, "%" SCNu64 " %" SCNu64, hits, misses) != 2) {
+        *hits = 0;
+        *misses = 0;
+    }
+    return fd;
+}
+
+
+struct image_cache *create_image_cache(const char *directory) {
+    if (directory == NULL) {
+        return NULL;
+    }
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        log_error("Cannot create cache directory '%s'", directory);
+        return NULL;
+    }
+
+    struct image_cache *cache = (struct image_cache *) malloc(sizeof(struct image_cache));
+    char *directory_copy = strdup(directory);
+    if (cache == NULL || directory_copy == NULL) {
+        free(cache);
+        free(directory_copy);
+        return NULL;
+    }
+    cache->directory = directory_copy;
+    return cache;
+}
+
+
+void destroy_image_cache(struct image_cache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    free(cache->directory);
+    free(cache);
+}
+
+
+enum image_cache_status image_cache_compute_key(const char *input_path,
+                                                const void *options,
+                                                size_t options_size,
+                                                struct image_cache_key *key)
+{
+    if (input_path == NULL || (options == NULL && options_size > 0) || key == NULL) {
+        return IMAGE_CACHE_STATUS_INVALID_ARGUMENT;
+    }
+
+    struct image_cache_hasher hasher = {
+        .files = create_hash_map(0),
+        .arena = create_arena(0)
+    };
+    struct image_cache_file *file;
+    enum image_cache_status status = IMAGE_CACHE_STATUS_UNCACHEABLE;
+    if (hasher.files != NULL && hasher.arena != NULL) {
+        status = image_cache_hash_file(&hasher, input_path, 0, &file);
+    }
+    if (status == IMAGE_CACHE_STATUS_SUCCESS && !file->found) {
+        status = IMAGE_CACHE_STATUS_UNCACHEABLE;
+    }
+
+    if (status == IMAGE_CACHE_STATUS_SUCCESS) {
+        struct sha256 hash;
+        sha256_init(&hash);
+        sha256_update(&hash, IMAGE_CACHE_KEY_FORMAT, sizeof(IMAGE_CACHE_KEY_FORMAT));
+        sha256_update(&hash, MICROPROCESSOR_VERSION, sizeof(MICROPROCESSOR_VERSION));
+        uint64_t size = options_size;
+        sha256_update(&hash, &size, sizeof(size));
+        sha256_update(&hash, options, options_size);
+        sha256_update(&hash, file->digest, SHA256_DIGEST_SIZE);
+        sha256_finish(&hash, key->digest);
+    }
+
+    destroy_hash_map(hasher.files);
+    destroy_arena(hasher.arena);
+    return status;
+}
+
+
+enum image_cache_status image_cache_fetch(const struct image_cache *cache,
+                                          const struct image_cache_key *key,
+                                          const char *output_path)
+{
+    if (cache == NULL || key == NULL || output_path == NULL) {
+        return IMAGE_CACHE_STATUS_INVALID_ARGUMENT;
+    }
+
+    char *path = image_cache_path(cache, key, ".bin");
+    if (path == NULL) {
+        return IMAGE_CACHE_STATUS_IO_ERROR;
+    }
+    enum image_cache_status status = image_cache_copy(path, output_path);
+    free(path);
+    return status;
+}
+
+
+enum image_cache_status image_cache_store(const struct image_cache *cache,
+                                          const struct image_cache_key *key,
+                                          const char *output_path)
+{
+    if (cache == NULL || key == NULL || output_path == NULL) {
+        return IMAGE_CACHE_STATUS_INVALID_ARGUMENT;
+    }
+
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long) getpid());
+    char *temporary_path = image_cache_path(cache, key, suffix);
+    char *path = image_cache_path(cache, key, ".bin");
+    enum image_cache_status status = IMAGE_CACHE_STATUS_IO_ERROR;
+    if (temporary_path != NULL && path != NULL) {
+        status = image_cache_copy(output_path, temporary_path);
+        if (status == IMAGE_CACHE_STATUS_SUCCESS && rename(temporary_path, path) != 0) {
+            status = IMAGE_CACHE_STATUS_IO_ERROR;
+        }
+        if (status != IMAGE_CACHE_STATUS_SUCCESS) {
+            remove(temporary_path);
+        }
+    }
+    free(temporary_path);
+    free(path);
+    return status;
+}
+
+
+enum image_cache_status image_cache_record(const struct image_cache *cache, bool hit) {
+    if (cache == NULL) {
+        return IMAGE_CACHE_STATUS_INVALID_ARGUMENT;
+    }
+
+    uint64_t hits;
+    uint64_t misses;
+    int fd = image_cache_open_statistics(cache, &hits, &misses);
+    if (fd < 0) {
+        return IMAGE_CACHE_STATUS_IO_ERROR;
+    }
+    hits += hit;
+    misses += !hit;
+
+    char text[64];
+    int size = snprintf(text, sizeof(text), "%" PRIu64 " %" PRIu64 "\n", hits, misses);
+    bool failed = ftruncate(fd, 0) != 0 || pwrite(fd, text, (size_t) size, 0) != size;
+    close(fd);
+    return failed ? IMAGE_CACHE_STATUS_IO_ERROR : IMAGE_CACHE_STATUS_SUCCESS;
+}
+
+
+enum image_cache_status image_cache_statistics(const struct image_cache *cache,
+                                               uint64_t *hits,
+                                               uint64_t *misses)
+{
+    if (cache == NULL || hits == NULL || misses == NULL) {
+        return IMAGE_CACHE_STATUS_INVALID_ARGUMENT;
+    }
+
+    int fd = image_cache_open_statistics(cache, hits, misses);
+    if (fd < 0) {
+        return IMAGE_CACHE_STATUS_IO_ERROR;
+    }
+    close(fd);
+    return IMAGE_CACHE_STATUS_SUCCESS;
+}
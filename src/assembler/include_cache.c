@@ -0,0 +1,534 @@
+#define _DEFAULT_SOURCE
+#include "assembler/include_cache.h"
+#include "assembler/lexer.h"
+#include "architecture/logger.h"
+#include "structures/arena.h"
+#include "structures/hash_map.h"
+#include "structures/vector.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+
+/**
+ * Finds the canonical path and modification time of a file.
+ *
+ * @param file_name   The path to the file.
+ * @param path[out]   A pointer to return the canonical path, which the caller must free.
+ * @param mtime[out]  A pointer to return the modification time.
+ *
+ * @return Whether the file exists and its path could be resolved.
+ */
+static bool include_cache_resolve(const char *file_name, char **path, struct timespec *mtime) {
+    *path = realpath(file_name, NULL);
+    if (*path == NULL) {
+        return false;
+    }
+
+    struct stat file_stat;
+    if (stat(*path, &file_stat) != 0) {
+        free(*path);
+        return false;
+    }
+    *mtime = file_stat.st_mtim;
+    return true;
+}
+
+
+/**
+ * Finds the entry for a file, adding an UNLOADED entry if the file is not in the cache.
+ *
+ * The cache must be locked.
+ *
+ * @param cache      The include cache.
+ * @param path       The canonical path of the file, which is owned (and freed) by the cache.
+ * @param file_name  The path to the file as it was written.
+ * @param mtime      The modification time of the file.
+ *
+ * @return Pointer to the entry, or NULL if the system is out of memory.
+ */
+static struct include_cache_entry *include_cache_find(struct include_cache *cache,
+                                                     char *path,
+                                                     const char *file_name,
+                                                     struct timespec mtime)
+{
+    struct include_cache_entry *entry;
+    if (hash_map_get(cache->entries, path, (void **) &entry) == HASH_MAP_STATUS_SUCCESS) {
+        free(path);
+        return entry;
+    }
+
+    entry = (struct include_cache_entry *) malloc(sizeof(struct include_cache_entry));
+    char *name = strdup(file_name);
+    if (entry == NULL || name == NULL) {
+        free(entry);
+        free(name);
+        free(path);
+        return NULL;
+    }
+    *entry = (struct include_cache_entry) {
+        .path = path,
+        .name = name,
+        .mtime = mtime,
+        .state = INCLUDE_CACHE_STATE_UNLOADED
+    };
+
+    if (vector_add(cache->all_entries, &entry) != VECTOR_STATUS_SUCCESS) {
+        free(entry->name);
+        free(entry->path);
+        free(entry);
+        return NULL;
+    }
+    if (hash_map_insert(cache->entries, entry->path, entry) != HASH_MAP_STATUS_SUCCESS) {
+        // The entry is freed with the others when the cache is destroyed.
+        return NULL;
+    }
+    return entry;
+}
+
+
+/**
+ * Checks whether a file changed since it was lexed.
+ *
+ * @param entry  The entry of the file.
+ * @param mtime  The modification time of the file now.
+ *
+ * @return Whether the tokens in the entry are out of date.
+ */
+static bool include_cache_is_stale(const struct include_cache_entry *entry, struct timespec mtime)
+{
+    if (entry->state != INCLUDE_CACHE_STATE_READY && entry->state != INCLUDE_CACHE_STATE_FAILED) {
+        return false;
+    }
+    return entry->mtime.tv_sec != mtime.tv_sec || entry->mtime.tv_nsec != mtime.tv_nsec;
+}
+
+
+/**
+ * Lexes a file into a new arena.
+ *
+ * The cache does not need to be locked, since only the thread that set the entry to LEXING reads
+ * or writes the file.
+ *
+ * @param lexer        The lexer context to use.
+ * @param file_name    The path to the file.
+ * @param arena[out]   A pointer to return the arena that owns the text and tokens of the file.
+ * @param tokens[out]  A pointer to return the tokens of the file.
+ *
+ * @return READY if the file was lexed, otherwise FAILED.
+ */
+static enum include_cache_state include_cache_lex(struct lexer_context *lexer,
+                                                  const char *file_name,
+                                                  struct arena **arena,
+                                                  struct vector **tokens)
+{
+    *arena = create_arena(0);
+    if (lexer_lex_file(lexer, file_name, *arena, tokens) != LEXER_STATUS_SUCCESS) {
+        destroy_arena(*arena);
+        *arena = NULL;
+        *tokens = NULL;
+        return INCLUDE_CACHE_STATE_FAILED;
+    }
+    return INCLUDE_CACHE_STATE_READY;
+}
+
+
+/**
+ * Stores the result of lexing a file in its entry and wakes any thread waiting for it.
+ *
+ * The cache must be locked.
+ *
+ * @param cache   The include cache.
+ * @param entry   The entry of the file, which must be LEXING.
+ * @param state   The result of lexing the file.
+ * @param arena   The arena that owns the text and tokens of the file.
+ * @param tokens  The tokens of the file.
+ */
+static void include_cache_store(struct include_cache *cache,
+                                struct include_cache_entry *entry,
+                                enum include_cache_state state,
+                                struct arena *arena,
+                                struct vector *tokens)
+{
+    // Tokens of the previous version of the file may be spliced into a token stream that is
+    // still being parsed, so they are kept until the cache is destroyed.
+    if (entry->arena != NULL &&
+        vector_add(cache->retired_arenas, &entry->arena) != VECTOR_STATUS_SUCCESS)
+    {
+        log_warn("Include cache could not retire tokens of '%s'", entry->name);
+    }
+
+    entry->state = state;
+    entry->arena = arena;
+    entry->tokens = tokens;
+    pthread_cond_broadcast(&cache->job_done);
+}
+
+
+static void *include_cache_work(void *data);
+
+
+/**
+ * Queues a file to be lexed by a worker, if it is not in the cache or has changed.
+ *
+ * @param cache      The include cache, which must not be locked.
+ * @param file_name  The path to the file.
+ */
+static void include_cache_prefetch(struct include_cache *cache, const char *file_name) {
+    char *path;
+    struct timespec mtime;
+    if (cache->max_workers == 0 || !include_cache_resolve(file_name, &path, &mtime)) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    struct include_cache_entry *entry = include_cache_find(cache, path, file_name, mtime);
+    if (entry != NULL && (entry->state == INCLUDE_CACHE_STATE_UNLOADED ||
+                          include_cache_is_stale(entry, mtime)))
+    {
+        entry->state = INCLUDE_CACHE_STATE_QUEUED;
+        entry->mtime = mtime;
+        if (vector_add(cache->jobs, &entry) != VECTOR_STATUS_SUCCESS) {
+            entry->state = INCLUDE_CACHE_STATE_UNLOADED;
+        }
+        else {
+            log_debug("Include cache queued '%s'", entry->name);
+            pthread_cond_signal(&cache->job_queued);
+        }
+    }
+
+    // Workers are only started once there is something for them to do, so that assembling a file
+    // without includes does not pay for them.
+    while (cache->num_workers < cache->max_workers) {
+        pthread_t *worker = &cache->workers[cache->num_workers];
+        if (pthread_create(worker, NULL, &include_cache_work, cache) != 0) {
+            break;
+        }
+        cache->num_workers++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+
+/**
+ * Queues the files included by a run of tokens to be lexed.
+ *
+ * @param cache       The include cache, which must not be locked.
+ * @param tokens      The tokens to search for include directives.
+ * @param num_tokens  The number of tokens.
+ */
+static void include_cache_prefetch_tokens(struct include_cache *cache,
+                                          const struct lexer_token *tokens,
+                                          uint32_t num_tokens)
+{
+    for (uint32_t i = 0; i + 2 < num_tokens; i++) {
+        if (tokens[i].type == LEXER_TOKEN_PERIOD &&
+            tokens[i + 1].type == LEXER_TOKEN_IDENTIFIER &&
+            lexer_token_equals(&tokens[i + 1], "include") &&
+            tokens[i + 2].type == LEXER_TOKEN_STRING)
+        {
+            char file_name[LEXER_TOKEN_MAX_LENGTH + 1];
+            lexer_token_copy_text(&tokens[i + 2], file_name, sizeof(file_name));
+            include_cache_prefetch(cache, file_name);
+        }
+    }
+}
+
+
+/**
+ * Queues the files included by source text that has not been lexed yet to be lexed.
+ *
+ * The text is searched for include directives that are not commented out, without lexing it, so
+ * that the workers can start before the parser reaches the first include.
+ *
+ * @param cache          The include cache, which must not be locked.
+ * @param source         The text to search for include directives.
+ * @param source_length  The number of characters in the text.
+ */
+static void include_cache_prefetch_text(struct include_cache *cache,
+                                        const char *source,
+                                        size_t source_length)
+{
+    static const char directive[] = ".include";
+    size_t directive_length = sizeof(directive) - 1;
+
+    size_t position = 0;
+    const char *period;
+    while (position < source_length &&
+           (period = memchr(source + position, '.', source_length - position)) != NULL)
+    {
+        size_t start = (size_t) (period - source);
+        position = start + 1;
+        if (source_length - start < directive_length ||
+            memcmp(period, directive, directive_length) != 0)
+        {
+            continue;
+        }
+
+        bool commented = false;
+        for (size_t i = start; i > 0 && source[i - 1] != '\n'; i--) {
+            commented |= source[i - 1] == ';';
+        }
+        if (commented) {
+            continue;
+        }
+
+        position = start + directive_length;
+        while (position < source_length && (source[position] == ' ' || source[position] == '\t')) {
+            position++;
+        }
+        if (position >= source_length || source[position] != '"') {
+            continue;
+        }
+
+        const char *name = source + position + 1;
+        const char *end = memchr(name, '"', source_length - position - 1);
+        if (end == NULL) {
+            return;
+        }
+        position = (size_t) (end - source) + 1;
+
+        char file_name[LEXER_TOKEN_MAX_LENGTH + 1];
+        size_t name_length = (size_t) (end - name);
+        if (name_length < sizeof(file_name)) {
+            memcpy(file_name, name, name_length);
+            file_name[name_length] = '\0';
+            include_cache_prefetch(cache, file_name);
+        }
+    }
+}
+
+
+/**
+ * Lexes queued files until the cache is destroyed.
+ *
+ * @param data  The include cache.
+ *
+ * @return NULL.
+ */
+static void *include_cache_work(void *data) {
+    struct include_cache *cache = (struct include_cache *) data;
+
+    // Errors are reported by the parser when it lexes a failed file itself.
+    struct lexer_context *lexer = create_lexer_context();
+    lexer_set_scanner(lexer, cache->scanner);
+    lexer->report_errors = false;
+
+    pthread_mutex_lock(&cache->lock);
+    while (true) {
+        while (!cache->stopping && cache->next_job == cache->jobs->size) {
+            pthread_cond_wait(&cache->job_queued, &cache->lock);
+        }
+        if (cache->stopping) {
+            break;
+        }
+
+        struct include_cache_entry *entry =
+            *(struct include_cache_entry **) vector_at(cache->jobs, cache->next_job++);
+        if (cache->next_job == cache->jobs->size) {
+            vector_truncate(cache->jobs, 0);
+            cache->next_job = 0;
+        }
+        // The thread that requested the file may have taken it off the queue to lex it itself.
+        if (entry->state != INCLUDE_CACHE_STATE_QUEUED) {
+            continue;
+        }
+        entry->state = INCLUDE_CACHE_STATE_LEXING;
+        pthread_mutex_unlock(&cache->lock);
+
+        struct arena *arena;
+        struct vector *tokens;
+        enum include_cache_state state = include_cache_lex(lexer, entry->name, &arena, &tokens);
+        log_debug("Include cache worker lexed '%s' (state %d)", entry->name, state);
+
+        pthread_mutex_lock(&cache->lock);
+        include_cache_store(cache, entry, state, arena, tokens);
+        pthread_mutex_unlock(&cache->lock);
+
+        if (state == INCLUDE_CACHE_STATE_READY) {
+            include_cache_prefetch_tokens(cache, tokens->data, tokens->size);
+        }
+        pthread_mutex_lock(&cache->lock);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    destroy_lexer_context(lexer);
+    return NULL;
+}
+
+
+struct include_cache *create_include_cache(uint32_t max_workers,
+                                           enum lexer_scanner scanner,
+                                           bool once)
+{
+    struct include_cache *cache = (struct include_cache *) malloc(sizeof(struct include_cache));
+
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->job_queued, NULL);
+    pthread_cond_init(&cache->job_done, NULL);
+    cache->entries = create_hash_map(0);
+    cache->all_entries = create_vector(sizeof(struct include_cache_entry *));
+    cache->jobs = create_vector(sizeof(struct include_cache_entry *));
+    cache->next_job = 0;
+    cache->max_workers = max_workers < INCLUDE_CACHE_MAX_WORKERS ?
+        max_workers : INCLUDE_CACHE_MAX_WORKERS;
+    cache->workers = (pthread_t *) calloc(INCLUDE_CACHE_MAX_WORKERS, sizeof(pthread_t));
+    cache->num_workers = 0;
+    cache->stopping = false;
+    cache->once = once;
+    cache->scanner = scanner;
+    cache->lexer = create_lexer_context();
+    lexer_set_scanner(cache->lexer, scanner);
+    cache->lexer->report_errors = false;
+    cache->retired_arenas = create_vector(sizeof(struct arena *));
+
+    return cache;
+}
+
+
+void destroy_include_cache(struct include_cache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache->stopping = true;
+    pthread_cond_broadcast(&cache->job_queued);
+    pthread_mutex_unlock(&cache->lock);
+    for (uint32_t i = 0; i < cache->num_workers; i++) {
+        pthread_join(cache->workers[i], NULL);
+    }
+
+    struct vector_iterator iterator = vector_iterate(cache->all_entries);
+    struct include_cache_entry **entry;
+    while ((entry = vector_iterator_next(&iterator)) != NULL) {
+        destroy_arena((*entry)->arena);
+        free((*entry)->path);
+        free((*entry)->name);
+        free(*entry);
+    }
+    iterator = vector_iterate(cache->retired_arenas);
+    struct arena **arena;
+    while ((arena = vector_iterator_next(&iterator)) != NULL) {
+        destroy_arena(*arena);
+    }
+
+    destroy_vector(cache->retired_arenas);
+    destroy_lexer_context(cache->lexer);
+    free(cache->workers);
+    destroy_vector(cache->jobs);
+    destroy_vector(cache->all_entries);
+    destroy_hash_map(cache->entries);
+    pthread_cond_destroy(&cache->job_done);
+    pthread_cond_destroy(&cache->job_queued);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+
+void include_cache_start_run(struct include_cache *cache,
+                             const char *file_name,
+                             const char *source,
+                             size_t source_length)
+{
+    if (cache == NULL || file_name == NULL || (source == NULL && source_length > 0)) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    struct vector_iterator iterator = vector_iterate(cache->all_entries);
+    struct include_cache_entry **entry;
+    while ((entry = vector_iterator_next(&iterator)) != NULL) {
+        (*entry)->included = false;
+    }
+
+    // The file being assembled counts as included, so that it is skipped if it includes itself.
+    char *path;
+    struct timespec mtime;
+    if (include_cache_resolve(file_name, &path, &mtime)) {
+        struct include_cache_entry *main_entry = include_cache_find(cache, path, file_name, mtime);
+        if (main_entry != NULL) {
+            main_entry->included = true;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    include_cache_prefetch_text(cache, source, source_length);
+}
+
+
+enum include_cache_status include_cache_get(struct include_cache *cache,
+                                            const char *file_name,
+                                            const struct lexer_token **tokens,
+                                            uint32_t *num_tokens)
+{
+    if (cache == NULL || file_name == NULL || tokens == NULL || num_tokens == NULL) {
+        return INCLUDE_CACHE_STATUS_INVALID_ARGUMENT;
+    }
+
+    char *path;
+    struct timespec mtime;
+    if (!include_cache_resolve(file_name, &path, &mtime)) {
+        return INCLUDE_CACHE_STATUS_NOT_FOUND;
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    struct include_cache_entry *entry = include_cache_find(cache, path, file_name, mtime);
+    if (entry == NULL) {
+        pthread_mutex_unlock(&cache->lock);
+        return INCLUDE_CACHE_STATUS_OUT_OF_MEMORY;
+    }
+    if (cache->once && entry->included) {
+        pthread_mutex_unlock(&cache->lock);
+        return INCLUDE_CACHE_STATUS_SKIPPED;
+    }
+
+    while (entry->state == INCLUDE_CACHE_STATE_LEXING) {
+        pthread_cond_wait(&cache->job_done, &cache->lock);
+    }
+    if (include_cache_is_stale(entry, mtime)) {
+        log_debug("Include cache found '%s' changed since it was lexed", entry->name);
+        entry->state = INCLUDE_CACHE_STATE_UNLOADED;
+    }
+
+    // A file that no worker has started on is lexed here rather than waiting for one.
+    if (entry->state == INCLUDE_CACHE_STATE_UNLOADED ||
+        entry->state == INCLUDE_CACHE_STATE_QUEUED)
+    {
+        entry->state = INCLUDE_CACHE_STATE_LEXING;
+        entry->mtime = mtime;
+        pthread_mutex_unlock(&cache->lock);
+
+        struct arena *arena;
+        struct vector *lexed_tokens;
+        enum include_cache_state state =
+            include_cache_lex(cache->lexer, entry->name, &arena, &lexed_tokens);
+
+        pthread_mutex_lock(&cache->lock);
+        include_cache_store(cache, entry, state, arena, lexed_tokens);
+        pthread_mutex_unlock(&cache->lock);
+
+        if (state == INCLUDE_CACHE_STATE_READY) {
+            include_cache_prefetch_tokens(cache, lexed_tokens->data, lexed_tokens->size);
+        }
+        pthread_mutex_lock(&cache->lock);
+    }
+    else {
+        log_debug("Include cache hit for '%s'", entry->name);
+    }
+
+    entry->included = true;
+    enum include_cache_status status = INCLUDE_CACHE_STATUS_LEXER_ERROR;
+    if (entry->state == INCLUDE_CACHE_STATE_READY) {
+        *tokens = entry->tokens->data;
+        *num_tokens = entry->tokens->size;
+        status = INCLUDE_CACHE_STATUS_SUCCESS;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return status;
+}
@@ -5,101 +5,162 @@
  */
 
 
+#define _DEFAULT_SOURCE
 #include "assembler/lexer.h"
+#include "assembler/scanner.h"
 #include "architecture/isa.h"
 #include "architecture/logger.h"
-#include "structures/list.h"
+#include "structures/arena.h"
+#include "structures/intern_pool.h"
+#include "structures/vector.h"
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 
-/** The current line number of the lexer across all calls for the same file. */
-static uint32_t lexer_current_line = 1;
-/** The current column number of the lexer across all calls for the same file. */
-static uint32_t lexer_current_column = 0;
+/** The number of bytes first reserved when a source file has to be read instead of mapped. */
+#define LEXER_READ_INITIAL_SIZE 4096
 
 
 /**
- * Skips all whitespace in the specified file starting at the current read pointer.
+ * A memory mapping of a source file, released when the arena it was registered with is reset.
+ */
+struct lexer_mapping {
+    /** The start of the mapping. */
+    void *address;
+    /** The number of bytes mapped. */
+    size_t length;
+};
+
+
+/**
+ * Gets the column of the next character to lex.
  *
- * @param[inout] file  The file to skip whitespace in.
+ * @param context  The lexer context.
  *
- * @return Whether whitespace was successfully skipped without reaching the end of the file.
+ * @return The zero-indexed column of the lexer on the current line.
  */
-static bool lexer_skip_whitespace(FILE *file) {
-    int c;
-    do {
-        c = fgetc(file);
-        lexer_current_column++;
+static uint32_t lexer_current_column(const struct lexer_context *context) {
+    return (uint32_t) (context->position - context->line_start);
+}
 
-        if (c == '\n') {
-            lexer_current_line++;
-            lexer_current_column = 0;
-        }
-    } while (isspace(c));
 
-    if (c != EOF) {
-        ungetc(c, file);
-        lexer_current_column--;
-        return true;
+/**
+ * Gets a character from the source text without consuming it.
+ *
+ * @param context  The lexer context.
+ * @param offset   The number of characters past the current position to look.
+ *
+ * @return The character as an unsigned char, or EOF if the offset is past the end of the file.
+ */
+static int lexer_peek(const struct lexer_context *context, size_t offset) {
+    if (offset >= context->source_length - context->position) {
+        return EOF;
     }
-    return false;
+    return (unsigned char) context->source[context->position + offset];
 }
 
 
 /**
- * Checks whether the read pointer in the specified file is currently pointing at the start of
- * a comment, and skips that comment if available.
+ * Fills in the text of a token as a slice of the source text.
  *
- * @param[inout] file  The file to skip comments in.
+ * @param      context  The lexer context.
+ * @param[out] token    The token to fill in.
+ * @param      start    The offset of the first character of the token in the source text.
+ * @param      length   The number of characters in the token.
+ */
+static void lexer_set_text(const struct lexer_context *context,
+                           struct lexer_token *token,
+                           size_t start,
+                           size_t length)
+{
+    token->text = context->source + start;
+    token->length = (uint32_t) length;
+}
+
+
+/**
+ * Skips all whitespace and comments (from the ; symbol to end of line) starting at the current
+ * position with the selected scanner.
+ *
+ * @param[inout] context  The lexer context.
  *
- * @return Whether a comment was successfully skipped.
+ * @return The status of the skip. If SUCCESS, the current position is at a real token. If EOF,
+ *         the end of the file was reached. If CHECK_FAILED, the scanners did not agree.
  */
-static bool lexer_skip_comments(FILE *file) {
-    int c = fgetc(file);
-    if (c != ';') {
-        ungetc(c, file);
-        return false;
+static enum lexer_status lexer_skip_whitespace_and_comments(struct lexer_context *context) {
+    uint32_t num_newlines = 0;
+    size_t line_start = context->line_start;
+    size_t position;
+
+    switch (context->scanner) {
+    case LEXER_SCANNER_SCALAR:
+        position = scanner_skip_scalar(context->source, context->source_length, context->position,
+                                       &num_newlines, &line_start);
+        break;
+    case LEXER_SCANNER_CHECKED: {
+        uint32_t expected_num_newlines = 0;
+        size_t expected_line_start = context->line_start;
+        size_t expected_position = scanner_skip_scalar(context->source, context->source_length,
+                                                       context->position, &expected_num_newlines,
+                                                       &expected_line_start);
+        position = scanner_skip_vector(context->source, context->source_length, context->position,
+                                       &num_newlines, &line_start);
+        if (position != expected_position || num_newlines != expected_num_newlines ||
+            line_start != expected_line_start)
+        {
+            log_error("Lexer scanner check failed at offset %zu (skipped to %zu, expected %zu)",
+                      context->position, position, expected_position);
+            return LEXER_STATUS_CHECK_FAILED;
+        }
+        break;
     }
-
-    while (c != '\n') {
-        c = fgetc(file);
-        lexer_current_column++;
+    case LEXER_SCANNER_VECTOR:
+    default:
+        position = scanner_skip_vector(context->source, context->source_length, context->position,
+                                       &num_newlines, &line_start);
+        break;
     }
-    return true;
+
+    context->position = position;
+    context->line += num_newlines;
+    context->line_start = line_start;
+    return position < context->source_length ? LEXER_STATUS_SUCCESS : LEXER_STATUS_EOF;
 }
 
 
 /**
- * Checks whether the read pointer in the specified file is currently pointing at a punctuation
- * token, and parses that token if possible.
+ * Checks whether the current position is at a punctuation token, and parses that token if
+ * possible.
  *
- * @param[inout] file   The file to parse from.
- * @param[out]   token  A pointer to store token information.
+ * @param[inout] context  The lexer context.
+ * @param[out]   token    A pointer to store token information.
  *
- * @return Whether a punctuation token was parsed from the file.
+ * @return Whether a punctuation token was parsed.
  */
-static bool lexer_check_punctuation(FILE *file, struct lexer_token *token) {
-    int c = fgetc(file);
+static bool lexer_check_punctuation(struct lexer_context *context, struct lexer_token *token) {
+    int c = lexer_peek(context, 0);
 
     switch (c) {
     case LEXER_TOKEN_COMMA:
     case LEXER_TOKEN_COLON:
     case LEXER_TOKEN_PERIOD:
         token->type = c;
-        token->text[0] = c;
-        token->text[1] = '\0';
-        lexer_current_column++;
+        lexer_set_text(context, token, context->position, 1);
+        context->position++;
         return true;
     default:
-        if (c != EOF) {
-            ungetc(c, file);
-        }
         return false;
     }
 }
@@ -108,82 +169,72 @@ static bool lexer_check_punctuation(FILE *file, struct lexer_token *token) {
 /**
  * Checks for a doble-quoted string and stores the content (without quotes) in the token.
  *
- * @param[inout] file   The file to parse from.
- * @param[out]   token  A pointer to store token information.
+ * @param[inout] context  The lexer context.
+ * @param[out]   token    A pointer to store token information.
  *
- * @return Whether a string was found.
+ * @return Whether a string was found. An unterminated string is not consumed.
  */
-static bool lexer_check_string(FILE *file, struct lexer_token *token) {
-    int c = fgetc(file);
-    if (c != '"') {
-        ungetc(c, file);
+static bool lexer_check_string(struct lexer_context *context, struct lexer_token *token) {
+    if (lexer_peek(context, 0) != '"') {
         return false;
     }
 
-    uint32_t i = 0;
+    size_t length = 0;
     while (true) {
-        c = fgetc(file);
+        int c = lexer_peek(context, length + 1);
         if (c == '"') {
             break;
         }
         else if (c == EOF || c == '\n') {
             return false;
         }
-        else if (i < LEXER_TOKEN_MAX_LENGTH) {
-            token->text[i++] = (char) c;
-            lexer_current_column++;
-        }
+        length++;
     }
-    token->text[i] = '\0';
+
+    lexer_set_text(context, token, context->position + 1, length);
+    context->position += length + 2;
     token->type = LEXER_TOKEN_STRING;
     return true;
 }
 
 
 /**
- * Checks whether the read pointer in the specified file is currently pointing at a number token,
- * and parses that token if possible.
+ * Checks whether the current position is at a number token, and parses that token if possible.
  *
- * @param[inout] file   The file to parse from.
- * @param[out]   token  A pointer to store token information.
+ * @param[inout] context  The lexer context.
+ * @param[out]   token    A pointer to store token information.
  *
+ * @return Whether a number token was parsed.
  */
-static bool lexer_check_number(FILE *file, struct lexer_token *token) {
-    // If the first character we read isn't a digit (any digit for decimal, and '0' for the '0x' in
-    // hex specifically), it cannot possibly be a number.
-    int c = fgetc(file);
-    if (!isdigit(c)) {
-        ungetc(c, file);
+static bool lexer_check_number(struct lexer_context *context, struct lexer_token *token) {
+    // If the first character isn't a digit (any digit for decimal, and '0' for the '0x' in hex
+    // specifically), it cannot possibly be a number.
+    int c = lexer_peek(context, 0);
+    if (c == EOF || !isdigit(c)) {
         return false;
     }
 
-    // Determine the base. If the digit we read above is a '0' and the next is an 'x', we know the
-    // number is hexadecimal.
+    // Determine the base. If the first digit is a '0' and the next is an 'x', we know the number
+    // is hexadecimal.
+    size_t start = context->position;
     uint32_t base = 10;
     uint32_t value = 0;
 
-    int peekc = fgetc(file);
-    if (c == '0' && tolower(peekc) == 'x') {
+    int peekc = lexer_peek(context, 1);
+    if (c == '0' && peekc != EOF && tolower(peekc) == 'x') {
         base = 16;
-        c = fgetc(file);
-        lexer_current_column++;
-    }
-    else {
-        if (peekc != EOF) {
-            ungetc(peekc, file);
-        }
+        context->position += 2;
+        c = lexer_peek(context, 0);
     }
 
     // Read the rest of the digits (hex or dec) and construct the number in-place.
-    while ((base == 10 && isdigit(c)) || (base == 16 && isxdigit(c))) {
+    while (c != EOF && ((base == 10 && isdigit(c)) || (base == 16 && isxdigit(c)))) {
         value = value * base + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
-        c = fgetc(file);
-        lexer_current_column++;
+        context->position++;
+        c = lexer_peek(context, 0);
     }
 
-    if (c != EOF) {
-        ungetc(c, file);
-    }
+    lexer_set_text(context, token, start, context->position - start);
     token->type = LEXER_TOKEN_NUMBER;
     token->value = value;
     return true;
@@ -191,176 +242,529 @@ static bool lexer_check_number(FILE *file, struct lexer_token *token) {
 
 
 /**
- * Checks whether the read pointer in the specified file is currently pointing at an identifier
- * or register token, and parses that token if possible.
+ * Checks whether the current position is at an identifier or register token, and parses that
+ * token if possible.
  *
- * @param[inout] file   The file to parse from.
- * @param[out]   token  A pointer to store token information.
+ * @param[inout] context  The lexer context.
+ * @param[out]   token    A pointer to store token information.
  *
- * @return Whether an identifier or register token was parsed from the file.
+ * @return Whether an identifier or register token was parsed.
  */
-static bool lexer_check_identifier(FILE *file, struct lexer_token *token) {
+static bool lexer_check_identifier(struct lexer_context *context, struct lexer_token *token) {
     // Check for the first character, which is C-style (alpha + _ but no numbers)
-    int c = fgetc(file);
-    if (!isalpha(c) && c != '_') {
-        ungetc(c, file);
+    int c = lexer_peek(context, 0);
+    if (c == EOF || (!isalpha(c) && c != '_')) {
         return false;
     }
 
     // Read additional characters until we find one that doesn't belong in an identifier.
-    uint32_t i = 0;
+    size_t start = context->position;
     do {
-        token->text[i++] = c;
-        c = fgetc(file);
-        lexer_current_column++;
-    } while ((isalnum(c) || c == '_') && i < LEXER_TOKEN_MAX_LENGTH);
-
-    token->text[i] = '\0';
-    if (c != EOF) {
-        ungetc(c, file);
-    }
-
-    // At this point, we have a full identifier (null terminated) in token->text. Since labels,
-    // opcodes, and register names all fit the definition of an "identifier", we need to determine
-    // if the identifier is a register and get its encoded value.
-    const struct isa_register_map *register_name = isa_get_register_map_from_symbol(token->text);
+        context->position++;
+        c = lexer_peek(context, 0);
+    } while (c != EOF && (isalnum(c) || c == '_'));
+    lexer_set_text(context, token, start, context->position - start);
+
+    // At this point, we have a full identifier in the token text. Since labels, opcodes, and
+    // register names all fit the definition of an "identifier", we need to determine if the
+    // identifier is a register and get its encoded value.
+    const struct isa_register_map *register_name =
+        isa_get_register_map_from_text(token->text, token->length);
     if (register_name != NULL) {
         token->type = LEXER_TOKEN_REGISTER;
         token->value = register_name->index;
     }
     else {
+        // Identifiers are interned so that later phases can compare them by ID.
         token->type = LEXER_TOKEN_IDENTIFIER;
+        if (intern_pool_intern(context->identifiers, token->text, token->length, &token->value) !=
+            INTERN_POOL_STATUS_SUCCESS)
+        {
+            log_error("Lexer could not intern identifier");
+            return false;
+        }
     }
     return true;
 }
 
 
 /**
- * Runs the lexer on the provided input file to get the next token.
+ * Runs the lexer on the current source text to get the next token.
  *
- * Lexing will continue at wherever the read pointer is in the file. This function will advance
- * the read pointer of the file while processing characters; if the lexer is called again, the
- * file pointer should not be changed between calls.
+ * Lexing will continue at the current position in the source text, which is advanced past the
+ * token that is returned.
  *
- * @param[inout] file   The file to read a token from.
- * @param[out]   token  A pointer to store the token information.
+ * @param[inout] context  The lexer context.
+ * @param[out]   token    A pointer to store the token information.
  *
  * @return The status of the lexer call. If SUCCESS, the lexer can be called again to get another
  *         token. If EOF, the lexer exited normally but should not be called again. Otherwise, the
  *         lexer exited with an error (the line, column, and offending character are stored in the
  *         token pointer).
  */
-static enum lexer_status lexer_next_token(FILE *file, struct lexer_token *token) {
+static enum lexer_status lexer_scan_token(struct lexer_context *context,
+                                          struct lexer_token *token)
+{
     // At this point we know that the arguments are at least valid and parsing can be attempted.
     // We clear the token parameters and fill them as we encounter tokens.
     token->type = LEXER_TOKEN_EOF;
-    memset(&token->text, 0, sizeof(token->text));
+    token->text = NULL;
+    token->length = 0;
     token->value = 0;
     token->line = 0;
     token->column = 0;
 
-    // Skip whitespace from the current file read pointer. If this returns false, that means the
-    // end of the file was reached while skipping whitespace. In that case, we reset the global
-    // line/column counters (for the next file) and return EOF.
-    log_trace("Lexer checking for whitespace to skip (%" PRIu32 ":%" PRIu32 ")",
-              lexer_current_line, lexer_current_column);
-    if (!lexer_skip_whitespace(file)) {
-        return LEXER_STATUS_EOF;
-    }
-
-    // Skip comments from the current file pointer. If this returns true, that means a comment
-    // was skipped (from the ; symbol to end of line) and so we want to continue to get the next
-    // real token on the start of the next line.
-    log_trace("Lexer checking for comments to skip (%" PRIu32 ":%" PRIu32 ")",
-              lexer_current_line, lexer_current_column);
-    if (lexer_skip_comments(file)) {
-        lexer_current_line++;
-        lexer_current_column = 0;
-        return lexer_next_token(file, token);
+    // Skip whitespace and comments until a real token or the end of the file is reached.
+    log_trace("Lexer checking for whitespace and comments to skip (%" PRIu32 ":%" PRIu32 ")",
+              context->line, lexer_current_column(context));
+    enum lexer_status skip_status = lexer_skip_whitespace_and_comments(context);
+    if (skip_status != LEXER_STATUS_SUCCESS) {
+        return skip_status;
     }
 
     // At this point we have reached a real (non-whitespace, non-comment) character to parse.
     // We go through all the token parsers in order trying to find a lexical match.
+    token->line = context->line;
+    token->column = lexer_current_column(context);
 
     log_trace("Lexer checking for punctuation (%" PRIu32 ":%" PRIu32 ")",
-              lexer_current_line, lexer_current_column);
-    token->line = lexer_current_line;
-    token->column = lexer_current_column;
-    if (lexer_check_punctuation(file, token)) {
+              token->line, token->column);
+    if (lexer_check_punctuation(context, token)) {
         return LEXER_STATUS_SUCCESS;
     }
 
-    log_trace("Lexer checking for string (%" PRIu32 ":%" PRIu32 ")",
-              lexer_current_line, lexer_current_column);
-    token->line = lexer_current_line;
-    token->column = lexer_current_column;
-    if (lexer_check_string(file, token)) {
+    log_trace("Lexer checking for string (%" PRIu32 ":%" PRIu32 ")", token->line, token->column);
+    if (lexer_check_string(context, token)) {
         return LEXER_STATUS_SUCCESS;
     }
 
-    log_trace("Lexer checking for number (%" PRIu32 ":%" PRIu32 ")",
-              lexer_current_line, lexer_current_column);
-    token->line = lexer_current_line;
-    token->column = lexer_current_column;
-    if (lexer_check_number(file, token)) {
+    log_trace("Lexer checking for number (%" PRIu32 ":%" PRIu32 ")", token->line, token->column);
+    if (lexer_check_number(context, token)) {
         return LEXER_STATUS_SUCCESS;
     }
 
     log_trace("Lexer checking for identifier (%" PRIu32 ":%" PRIu32 ")",
-              lexer_current_line, lexer_current_column);
-    token->line = lexer_current_line;
-    token->column = lexer_current_column;
-    if (lexer_check_identifier(file, token)) {
+              token->line, token->column);
+    if (lexer_check_identifier(context, token)) {
         return LEXER_STATUS_SUCCESS;
     }
 
     // At this point all of the parsers have failed. That means we have an unrecognized token
     // and parsing the file cannot continue.
     log_trace("Lexer did not identify any known token (%" PRIu32 ":%" PRIu32 ")",
-              lexer_current_line, lexer_current_column);
-    token->text[0] = fgetc(file);
-    token->text[1] = '\0';
+              token->line, token->column);
+    lexer_set_text(context, token, context->position, 1);
     return LEXER_STATUS_LEXICAL_ERROR;
 }
 
 
-enum lexer_status lexer_lex_file(const char *file_name, struct list **tokens) {
-    if (file_name == NULL || tokens == NULL) {
+/**
+ * Unmaps a source file mapping. Registered as an arena cleanup callback.
+ *
+ * @param data  The struct lexer_mapping to release.
+ */
+static void lexer_unmap_source(void *data) {
+    struct lexer_mapping *mapping = (struct lexer_mapping *) data;
+    munmap(mapping->address, mapping->length);
+}
+
+
+/**
+ * Maps a regular, non-empty file into memory for the lifetime of an arena.
+ *
+ * @param      fd      The open file to map.
+ * @param      size    The size of the file in bytes.
+ * @param      arena   The arena whose reset releases the mapping.
+ * @param[out] source  A pointer to return the start of the mapping.
+ *
+ * @return Whether the file was mapped.
+ */
+static bool lexer_map_source(int fd, size_t size, struct arena *arena, const char **source) {
+    void *address = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED) {
+        return false;
+    }
+
+    struct lexer_mapping *mapping =
+        (struct lexer_mapping *) arena_allocate(arena, sizeof(struct lexer_mapping));
+    if (mapping == NULL) {
+        munmap(address, size);
+        return false;
+    }
+    mapping->address = address;
+    mapping->length = size;
+    if (!arena_add_cleanup(arena, lexer_unmap_source, mapping)) {
+        munmap(address, size);
+        return false;
+    }
+
+    // The lexer makes a single forward pass over the file.
+    madvise(address, size, MADV_SEQUENTIAL);
+    *source = (const char *) address;
+    return true;
+}
+
+
+/**
+ * Reads the remainder of a file into memory allocated from an arena.
+ *
+ * @param      fd      The open file to read.
+ * @param      arena   The arena to allocate from.
+ * @param[out] source  A pointer to return the start of the text.
+ * @param[out] length  A pointer to return the number of characters read.
+ *
+ * @return Whether the file was read.
+ */
+static bool lexer_read_source(int fd, struct arena *arena, const char **source, size_t *length) {
+    char *buffer = NULL;
+    size_t capacity = 0;
+    size_t used = 0;
+
+    while (true) {
+        if (used == capacity) {
+            size_t new_capacity = capacity > 0 ? capacity * 2 : LEXER_READ_INITIAL_SIZE;
+            char *new_buffer = (char *) arena_reallocate(arena, buffer, capacity, new_capacity);
+            if (new_buffer == NULL) {
+                return false;
+            }
+            buffer = new_buffer;
+            capacity = new_capacity;
+        }
+
+        ssize_t num_read = read(fd, buffer + used, capacity - used);
+        if (num_read < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (num_read < 0) {
+            return false;
+        }
+        else if (num_read == 0) {
+            break;
+        }
+        used += (size_t) num_read;
+    }
+
+    *source = buffer;
+    *length = used;
+    return true;
+}
+
+
+/**
+ * Makes the text of a file available in memory for the lifetime of an arena.
+ *
+ * @param      file_name  The path to the file to load.
+ * @param      arena      The arena that owns the text.
+ * @param[out] source     A pointer to return the start of the text.
+ * @param[out] length     A pointer to return the number of characters in the text.
+ *
+ * @return Whether the file was loaded.
+ */
+static bool lexer_load_source(const char *file_name,
+                              struct arena *arena,
+                              const char **source,
+                              size_t *length)
+{
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat file_stat;
+    bool loaded = false;
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+        *length = (size_t) file_stat.st_size;
+        loaded = lexer_map_source(fd, *length, arena, source);
+    }
+    if (!loaded) {
+        loaded = lexer_read_source(fd, arena, source, length);
+    }
+
+    close(fd);
+    return loaded;
+}
+
+
+/**
+ * Makes a file the one being lexed, starting at its first character.
+ *
+ * @param[inout] context    The lexer context, whose arena owns the text and name of the file.
+ * @param        file_name  The path to the file to lex.
+ *
+ * @return The status of loading the file.
+ */
+static enum lexer_status lexer_start_file(struct lexer_context *context, const char *file_name) {
+    // Tokens keep a pointer to the name of their file, which must live as long as they do.
+    size_t file_name_length = strlen(file_name);
+    char *token_file = (char *) arena_allocate(context->arena, file_name_length + 1);
+    if (token_file == NULL) {
         return LEXER_STATUS_INVALID_ARGUMENT;
     }
+    memcpy(token_file, file_name, file_name_length + 1);
 
-    FILE *file = fopen(file_name, "r");
-    if (file == NULL) {
-        log_error("Lexer cannot open file '%s'", file_name);
+    const char *source;
+    size_t source_length;
+    if (!lexer_load_source(file_name, context->arena, &source, &source_length)) {
+        if (context->report_errors) {
+            log_error("Lexer cannot open file '%s'", file_name);
+        }
         return LEXER_STATUS_INVALID_ARGUMENT;
     }
 
-    lexer_current_line = 1;
-    lexer_current_column = 0;
-    *tokens = create_list();
+    context->file_name = token_file;
+    context->source = source;
+    context->source_length = source_length;
+    context->position = 0;
+    context->line = 1;
+    context->line_start = 0;
+    context->replay = NULL;
+    context->replay_size = 0;
+    context->replay_index = 0;
+    return LEXER_STATUS_SUCCESS;
+}
+
+
+/**
+ * Suspends the file being lexed so that an included file can be lexed in its place.
+ *
+ * The including file is saved rather than copied, so an include costs the same no matter how much
+ * of either file remains.
+ *
+ * @param[inout] context  The lexer context.
+ *
+ * @return Whether the file was suspended. If false, the system is out of memory.
+ */
+static bool lexer_suspend_includer(struct lexer_context *context) {
+    struct lexer_file includer = {
+        .name = context->file_name,
+        .source = context->source,
+        .source_length = context->source_length,
+        .position = context->position,
+        .line = context->line,
+        .line_start = context->line_start,
+        .replay = context->replay,
+        .replay_size = context->replay_size,
+        .replay_index = context->replay_index
+    };
+    return vector_add(context->includers, &includer) == VECTOR_STATUS_SUCCESS;
+}
+
+
+/**
+ * Continues lexing the most recently suspended including file where it left off.
+ *
+ * @param[inout] context  The lexer context, which must have at least one suspended file.
+ */
+static void lexer_resume_includer(struct lexer_context *context) {
+    const struct lexer_file *includer = vector_at(context->includers,
+                                                  context->includers->size - 1);
+    context->file_name = includer->name;
+    context->source = includer->source;
+    context->source_length = includer->source_length;
+    context->position = includer->position;
+    context->line = includer->line;
+    context->line_start = includer->line_start;
+    context->replay = includer->replay;
+    context->replay_size = includer->replay_size;
+    context->replay_index = includer->replay_index;
+    vector_truncate(context->includers, context->includers->size - 1);
+}
+
+
+/**
+ * Gets the next token of a run of tokens that is being replayed.
+ *
+ * @param[inout] context  The lexer context, which must be replaying a run.
+ * @param[out]   token    A pointer to store the token information.
+ *
+ * @return The status of the lexer call. EOF at the end of the run.
+ */
+static enum lexer_status lexer_replay_token(struct lexer_context *context,
+                                            struct lexer_token *token)
+{
+    if (context->replay_index >= context->replay_size) {
+        return LEXER_STATUS_EOF;
+    }
+
+    // The run may have been lexed with a different identifier pool, so identifiers are interned
+    // again to get their IDs in this context.
+    *token = context->replay[context->replay_index++];
+    if (token->type == LEXER_TOKEN_IDENTIFIER &&
+        intern_pool_intern(context->identifiers, token->text, token->length, &token->value) !=
+            INTERN_POOL_STATUS_SUCCESS)
+    {
+        return LEXER_STATUS_LEXICAL_ERROR;
+    }
+    return LEXER_STATUS_SUCCESS;
+}
+
+
+struct lexer_context *create_lexer_context(void) {
+    struct lexer_context *context = (struct lexer_context *) malloc(sizeof(struct lexer_context));
+
+    context->file_name = NULL;
+    context->source = NULL;
+    context->source_length = 0;
+    context->position = 0;
+    context->line = 1;
+    context->line_start = 0;
+    context->scanner = LEXER_SCANNER_VECTOR;
+    context->identifiers = create_intern_pool();
+    context->arena = NULL;
+    context->includers = create_vector(sizeof(struct lexer_file));
+    context->replay = NULL;
+    context->replay_size = 0;
+    context->replay_index = 0;
+    context->report_errors = true;
+
+    return context;
+}
+
+
+void destroy_lexer_context(struct lexer_context *context) {
+    if (context == NULL) {
+        return;
+    }
+
+    destroy_intern_pool(context->identifiers);
+    destroy_vector(context->includers);
+    free(context);
+}
+
+
+void lexer_set_scanner(struct lexer_context *context, enum lexer_scanner scanner) {
+    context->scanner = scanner;
+}
+
+
+bool lexer_token_equals(const struct lexer_token *token, const char *text) {
+    return strncmp(token->text, text, token->length) == 0 && text[token->length] == '\0';
+}
+
+
+size_t lexer_token_copy_text(const struct lexer_token *token, char *buffer, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+
+    size_t length = token->length < size - 1 ? token->length : size - 1;
+    memcpy(buffer, token->text, length);
+    buffer[length] = '\0';
+    return length;
+}
+
+
+enum lexer_status lexer_open_file(struct lexer_context *context,
+                                  const char *file_name,
+                                  struct arena *arena)
+{
+    if (context == NULL || file_name == NULL || arena == NULL) {
+        return LEXER_STATUS_INVALID_ARGUMENT;
+    }
+
+    context->arena = arena;
+    vector_truncate(context->includers, 0);
+    return lexer_start_file(context, file_name);
+}
+
+
+enum lexer_status lexer_include_file(struct lexer_context *context, const char *file_name) {
+    if (context == NULL || file_name == NULL || context->arena == NULL) {
+        return LEXER_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (!lexer_suspend_includer(context)) {
+        return LEXER_STATUS_INVALID_ARGUMENT;
+    }
+
+    enum lexer_status status = lexer_start_file(context, file_name);
+    if (status != LEXER_STATUS_SUCCESS) {
+        lexer_resume_includer(context);
+    }
+    return status;
+}
+
+
+enum lexer_status lexer_include_tokens(struct lexer_context *context,
+                                       const struct lexer_token *tokens,
+                                       uint32_t num_tokens)
+{
+    if (context == NULL || (tokens == NULL && num_tokens > 0)) {
+        return LEXER_STATUS_INVALID_ARGUMENT;
+    }
+    if (!lexer_suspend_includer(context)) {
+        return LEXER_STATUS_INVALID_ARGUMENT;
+    }
+
+    context->replay = tokens;
+    context->replay_size = num_tokens;
+    context->replay_index = 0;
+    return LEXER_STATUS_SUCCESS;
+}
+
+
+enum lexer_status lexer_next_token(struct lexer_context *context, struct lexer_token *token) {
+    if (context == NULL || context->source == NULL || token == NULL) {
+        return LEXER_STATUS_INVALID_ARGUMENT;
+    }
 
     while (true) {
-        struct lexer_token *token = (struct lexer_token *) calloc(1, sizeof(struct lexer_token));
-        token->file = file_name;
-        enum lexer_status lex_status = lexer_next_token(file, token);
+        enum lexer_status status;
+        if (context->replay != NULL) {
+            status = lexer_replay_token(context, token);
+        }
+        else {
+            status = lexer_scan_token(context, token);
+            token->file = context->file_name;
+        }
 
-        switch (lex_status) {
+        switch (status) {
         case LEXER_STATUS_SUCCESS:
             log_debug("Lexer found token of type '%c'", token->type);
-            list_add(*tokens, (void *) token);
-            break;
+            return status;
         case LEXER_STATUS_EOF:
-            log_info("Lexer finished successfully (tokens found: %" PRIu32 ")", (*tokens)->size);
-            free(token);
-            fclose(file);
-            return LEXER_STATUS_SUCCESS;
+            log_debug("Lexer reached the end of '%s'",
+                      context->replay != NULL ? "(replayed tokens)" : context->file_name);
+            if (context->includers->size == 0) {
+                return status;
+            }
+            lexer_resume_includer(context);
+            break;
         default:
-            log_error("%s (%" PRIu32 ":%" PRIu32 "): Lexer could not parse token (errno %d)",
-                      file_name, lexer_current_line, lexer_current_column, lex_status);
-            destroy_list(*tokens, &list_default_node_free_callback);
-            free(token);
-            fclose(file);
-            return lex_status;
+            if (context->report_errors) {
+                log_error("%s (%" PRIu32 ":%" PRIu32 "): Lexer could not parse token (errno %d)",
+                          token->file, token->line, token->column, status);
+            }
+            return status;
         }
     }
 }
+
+
+enum lexer_status lexer_lex_file(struct lexer_context *context,
+                                 const char *file_name,
+                                 struct arena *arena,
+                                 struct vector **tokens)
+{
+    if (tokens == NULL) {
+        return LEXER_STATUS_INVALID_ARGUMENT;
+    }
+
+    enum lexer_status open_status = lexer_open_file(context, file_name, arena);
+    if (open_status != LEXER_STATUS_SUCCESS) {
+        return open_status;
+    }
+
+    *tokens = create_vector_in_arena(arena, sizeof(struct lexer_token));
+    struct lexer_token token;
+    enum lexer_status lex_status;
+    while ((lex_status = lexer_next_token(context, &token)) == LEXER_STATUS_SUCCESS) {
+        vector_add(*tokens, &token);
+    }
+
+    if (lex_status != LEXER_STATUS_EOF) {
+        return lex_status;
+    }
+    log_info("Lexer finished successfully (tokens found: %" PRIu32 ")", (*tokens)->size);
+    return LEXER_STATUS_SUCCESS;
+}
@@ -0,0 +1,335 @@
+#include "assembler/object.h"
+#include "architecture/isa.h"
+#include "structures/arena.h"
+#include "structures/vector.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/** The flag of a section header that marks the section as absolute. */
+#define OBJECT_SECTION_ABSOLUTE 0x1
+
+
+/** The number of 32-bit fields in the header of an object file. */
+#define OBJECT_HEADER_FIELDS 6
+/** The number of 32-bit fields in each section header. */
+#define OBJECT_SECTION_FIELDS 3
+/** The number of 32-bit fields in each symbol. */
+#define OBJECT_SYMBOL_FIELDS 3
+/** The number of 32-bit fields in each relocation. */
+#define OBJECT_RELOCATION_FIELDS 4
+
+
+/**
+ * Writes 32-bit fields to a file in little-endian order.
+ *
+ * @param file        The file to write to.
+ * @param fields      The fields to write.
+ * @param num_fields  The number of fields.
+ *
+ * @return Whether the fields were written.
+ */
+static bool object_write_fields(FILE *file, const uint32_t *fields, uint32_t num_fields) {
+    for (uint32_t i = 0; i < num_fields; i++) {
+        uint8_t bytes[sizeof(uint32_t)];
+        for (uint32_t b = 0; b < sizeof(uint32_t); b++) {
+            bytes[b] = (fields[i] >> (b * CHAR_BIT)) & UINT8_MAX;
+        }
+        if (fwrite(bytes, sizeof(bytes), 1, file) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Reads 32-bit fields written by object_write_fields from a file.
+ *
+ * @param file        The file to read from.
+ * @param fields      The array to read the fields into.
+ * @param num_fields  The number of fields.
+ *
+ * @return Whether the fields were read.
+ */
+static bool object_read_fields(FILE *file, uint32_t *fields, uint32_t num_fields) {
+    for (uint32_t i = 0; i < num_fields; i++) {
+        uint8_t bytes[sizeof(uint32_t)];
+        if (fread(bytes, sizeof(bytes), 1, file) != 1) {
+            return false;
+        }
+        fields[i] = 0;
+        for (uint32_t b = 0; b < sizeof(uint32_t); b++) {
+            fields[i] |= (uint32_t) bytes[b] << (b * CHAR_BIT);
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Gets the number of bytes from the position of a file to its end.
+ *
+ * @param file       The file, whose position is not changed.
+ * @param size[out]  A pointer to return the number of bytes.
+ *
+ * @return Whether the size of the file could be found.
+ */
+static bool object_remaining_size(FILE *file, uint64_t *size) {
+    long position = ftell(file);
+    if (position < 0 || fseek(file, 0, SEEK_END) != 0) {
+        return false;
+    }
+    long end = ftell(file);
+    if (end < position || fseek(file, position, SEEK_SET) != 0) {
+        return false;
+    }
+    *size = (uint64_t) (end - position);
+    return true;
+}
+
+
+void object_init(struct arena *arena, struct object *object) {
+    object->sections = create_vector_in_arena(arena, sizeof(struct object_section));
+    object->symbols = create_vector_in_arena(arena, sizeof(struct object_symbol));
+    object->relocations = create_vector_in_arena(arena, sizeof(struct object_relocation));
+}
+
+
+enum object_status object_write(const struct object *object, FILE *file) {
+    if (object == NULL || file == NULL) {
+        return OBJECT_STATUS_INVALID_ARGUMENT;
+    }
+
+    // Names are stored in a string table after the relocations, and symbols refer to them by
+    // offset, so every record has a fixed size.
+    uint32_t strings_size = 0;
+    struct vector_iterator iterator = vector_iterate(object->symbols);
+    struct object_symbol *symbol;
+    while ((symbol = vector_iterator_next(&iterator)) != NULL) {
+        strings_size += strlen(symbol->name) + 1;
+    }
+
+    uint32_t header[OBJECT_HEADER_FIELDS] = {
+        OBJECT_MAGIC,
+        OBJECT_VERSION,
+        object->sections->size,
+        object->symbols->size,
+        object->relocations->size,
+        strings_size
+    };
+    if (!object_write_fields(file, header, OBJECT_HEADER_FIELDS)) {
+        return OBJECT_STATUS_IO_ERROR;
+    }
+
+    iterator = vector_iterate(object->sections);
+    struct object_section *section;
+    while ((section = vector_iterator_next(&iterator)) != NULL) {
+        uint32_t fields[OBJECT_SECTION_FIELDS] = {
+            section->absolute ? OBJECT_SECTION_ABSOLUTE : 0,
+            section->address,
+            section->size
+        };
+        if (!object_write_fields(file, fields, OBJECT_SECTION_FIELDS)) {
+            return OBJECT_STATUS_IO_ERROR;
+        }
+    }
+
+    uint32_t name_offset = 0;
+    iterator = vector_iterate(object->symbols);
+    while ((symbol = vector_iterator_next(&iterator)) != NULL) {
+        uint32_t fields[OBJECT_SYMBOL_FIELDS] = {name_offset, symbol->section, symbol->offset};
+        if (!object_write_fields(file, fields, OBJECT_SYMBOL_FIELDS)) {
+            return OBJECT_STATUS_IO_ERROR;
+        }
+        name_offset += strlen(symbol->name) + 1;
+    }
+
+    iterator = vector_iterate(object->relocations);
+    struct object_relocation *relocation;
+    while ((relocation = vector_iterator_next(&iterator)) != NULL) {
+        uint32_t fields[OBJECT_RELOCATION_FIELDS] = {
+            relocation->section,
+            relocation->offset,
+            relocation->symbol,
+            relocation->type
+        };
+        if (!object_write_fields(file, fields, OBJECT_RELOCATION_FIELDS)) {
+            return OBJECT_STATUS_IO_ERROR;
+        }
+    }
+
+    iterator = vector_iterate(object->symbols);
+    while ((symbol = vector_iterator_next(&iterator)) != NULL) {
+        if (fwrite(symbol->name, strlen(symbol->name) + 1, 1, file) != 1) {
+            return OBJECT_STATUS_IO_ERROR;
+        }
+    }
+
+    iterator = vector_iterate(object->sections);
+    while ((section = vector_iterator_next(&iterator)) != NULL) {
+        if (section->size > 0 && fwrite(section->data, section->size, 1, file) != 1) {
+            return OBJECT_STATUS_IO_ERROR;
+        }
+    }
+    return OBJECT_STATUS_SUCCESS;
+}
+
+
+enum object_status object_read(FILE *file, struct arena *arena, struct object *object) {
+    if (file == NULL || arena == NULL || object == NULL) {
+        return OBJECT_STATUS_INVALID_ARGUMENT;
+    }
+
+    uint32_t header[OBJECT_HEADER_FIELDS];
+    if (!object_read_fields(file, header, OBJECT_HEADER_FIELDS)) {
+        return OBJECT_STATUS_INVALID_FORMAT;
+    }
+    if (header[0] != OBJECT_MAGIC || header[1] != OBJECT_VERSION) {
+        return OBJECT_STATUS_INVALID_FORMAT;
+    }
+    uint32_t num_sections = header[2];
+    uint32_t num_symbols = header[3];
+    uint32_t num_relocations = header[4];
+    uint32_t strings_size = header[5];
+
+    // Every count is checked against the size of the file before anything is allocated, so that a
+    // corrupt object cannot request more memory than the file could fill.
+    uint64_t table_size = ((uint64_t) num_sections * OBJECT_SECTION_FIELDS +
+                           (uint64_t) num_symbols * OBJECT_SYMBOL_FIELDS +
+                           (uint64_t) num_relocations * OBJECT_RELOCATION_FIELDS) *
+        sizeof(uint32_t) + strings_size;
+    uint64_t file_size;
+    if (!object_remaining_size(file, &file_size) || table_size > file_size) {
+        return OBJECT_STATUS_INVALID_FORMAT;
+    }
+    uint64_t data_size = file_size - table_size;
+
+    object_init(arena, object);
+    for (uint32_t i = 0; i < num_sections; i++) {
+        uint32_t fields[OBJECT_SECTION_FIELDS];
+        if (!object_read_fields(file, fields, OBJECT_SECTION_FIELDS)) {
+            return OBJECT_STATUS_INVALID_FORMAT;
+        }
+        struct object_section section = {
+            .absolute = (fields[0] & OBJECT_SECTION_ABSOLUTE) != 0,
+            .address = fields[1],
+            .size = fields[2]
+        };
+        if (section.size > data_size || section.address > UINT32_MAX - section.size) {
+            return OBJECT_STATUS_INVALID_FORMAT;
+        }
+        data_size -= section.size;
+        if (vector_add(object->sections, &section) != VECTOR_STATUS_SUCCESS) {
+            return OBJECT_STATUS_INVALID_FORMAT;
+        }
+    }
+
+    // Name offsets are checked once the string table has been read.
+    struct vector *name_offsets = create_vector_in_arena(arena, sizeof(uint32_t));
+    for (uint32_t i = 0; i < num_symbols; i++) {
+        uint32_t fields[OBJECT_SYMBOL_FIELDS];
+        if (!object_read_fields(file, fields, OBJECT_SYMBOL_FIELDS)) {
+            return OBJECT_STATUS_INVALID_FORMAT;
+        }
+        struct object_symbol symbol = {.section = fields[1], .offset = fields[2]};
+        if (symbol.section != OBJECT_NO_SECTION) {
+            const struct object_section *section = vector_at(object->sections, symbol.section);
+            if (section == NULL || symbol.offset > section->size) {
+                return OBJECT_STATUS_INVALID_FORMAT;
+            }
+        }
+        if (vector_add(object->symbols, &symbol) != VECTOR_STATUS_SUCCESS ||
+            vector_add(name_offsets, &fields[0]) != VECTOR_STATUS_SUCCESS)
+        {
+            return OBJECT_STATUS_INVALID_FORMAT;
+        }
+    }
+
+    for (uint32_t i = 0; i < num_relocations; i++) {
+        uint32_t fields[OBJECT_RELOCATION_FIELDS];
+        if (!object_read_fields(file, fields, OBJECT_RELOCATION_FIELDS)) {
+            return OBJECT_STATUS_INVALID_FORMAT;
+        }
+        struct object_relocation relocation = {
+            .section = fields[0],
+            .offset = fields[1],
+            .symbol = fields[2],
+            .type = (enum object_relocation_type) fields[3]
+        };
+        const struct object_section *section = vector_at(object->sections, relocation.section);
+        uint32_t size = object_relocation_size(relocation.type);
+        if (section == NULL || size == 0 || relocation.symbol >= num_symbols ||
+            relocation.offset > section->size || section->size - relocation.offset < size)
+        {
+            return OBJECT_STATUS_INVALID_FORMAT;
+        }
+        if (vector_add(object->relocations, &relocation) != VECTOR_STATUS_SUCCESS) {
+            return OBJECT_STATUS_INVALID_FORMAT;
+        }
+    }
+
+    char *strings = (char *) arena_allocate(arena, (size_t) strings_size + 1);
+    if (strings == NULL || (strings_size > 0 && fread(strings, strings_size, 1, file) != 1)) {
+        return OBJECT_STATUS_INVALID_FORMAT;
+    }
+    strings[strings_size] = '\0';
+    for (uint32_t i = 0; i < num_symbols; i++) {
+        uint32_t name_offset = *(uint32_t *) vector_at(name_offsets, i);
+        if (name_offset >= strings_size) {
+            return OBJECT_STATUS_INVALID_FORMAT;
+        }
+        ((struct object_symbol *) vector_at(object->symbols, i))->name = strings + name_offset;
+    }
+
+    struct vector_iterator iterator = vector_iterate(object->sections);
+    struct object_section *section;
+    while ((section = vector_iterator_next(&iterator)) != NULL) {
+        section->data = (uint8_t *) arena_allocate(arena, section->size);
+        if (section->data == NULL ||
+            (section->size > 0 && fread(section->data, section->size, 1, file) != 1))
+        {
+            return OBJECT_STATUS_INVALID_FORMAT;
+        }
+    }
+    return OBJECT_STATUS_SUCCESS;
+}
+
+
+void object_patch(uint8_t *field, enum object_relocation_type type, uint32_t address) {
+    switch (type) {
+    case OBJECT_RELOCATION_IMMEDIATE: {
+        // Only the Immediate field is rewritten, which is at the same bits in every Format that
+        // can reference a label.
+        union isa_instruction instruction = {.binary = 0};
+        for (uint32_t b = 0; b < sizeof(uint32_t); b++) {
+            instruction.binary |= (uint32_t) field[b] << (b * CHAR_BIT);
+        }
+        instruction.i_type.immediate = address;
+        for (uint32_t b = 0; b < sizeof(uint32_t); b++) {
+            field[b] = (instruction.binary >> (b * CHAR_BIT)) & UINT8_MAX;
+        }
+        break;
+    }
+    case OBJECT_RELOCATION_HALF:
+        for (uint32_t b = 0; b < sizeof(uint16_t); b++) {
+            field[b] = (address >> (b * CHAR_BIT)) & UINT8_MAX;
+        }
+        break;
+    }
+}
+
+
+uint32_t object_relocation_size(enum object_relocation_type type) {
+    switch (type) {
+    case OBJECT_RELOCATION_IMMEDIATE:
+        return sizeof(uint32_t);
+    case OBJECT_RELOCATION_HALF:
+        return sizeof(uint16_t);
+    default:
+        return 0;
+    }
+}
@@ -2,756 +2,642 @@
 #include "assembler/lexer.h"
 #include "architecture/isa.h"
 #include "architecture/logger.h"
-#include "structures/list.h"
+#include "structures/vector.h"
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-
-
-static uint32_t parser_pc = 0;
-static struct lexer_token *parser_last_token = NULL;
-
-
-static enum parser_status parser_expect_sequence(struct list *tokens, struct list *sequence) {
-    for (uint32_t i = 0; i < sequence->size; i++) {
-        void *token_data;
-        void *type_data;
-        enum list_status list_status;
-
-        list_status = list_peek_at(tokens, i, &token_data);
-        if (list_status != LIST_STATUS_SUCCESS) {
-            return PARSER_STATUS_SEMANTIC_ERROR;
+#include <string.h>
+
+
+/** The maximum number of comma-separated operands of any instruction. */
+#define PARSER_MAX_OPERANDS 3
+
+
+/**
+ * The field of an instruction group that an operand sets.
+ */
+enum parser_operand {
+    /** A register token that sets the destination register. */
+    PARSER_OPERAND_DEST,
+    /** A register token that sets the source1 register. */
+    PARSER_OPERAND_SOURCE1,
+    /** A register token that sets the source2 register. */
+    PARSER_OPERAND_SOURCE2,
+    /** A number token that sets the immediate, or an identifier token that sets the label. */
+    PARSER_OPERAND_IMMEDIATE
+};
+
+
+/**
+ * The shape of an instruction's operands, and the values of the fields its operands do not set.
+ */
+struct parser_pattern {
+    /** The number of operands, which are separated by commas. */
+    uint8_t num_operands;
+    /** The field that each operand sets, in the order the operands appear. */
+    enum parser_operand operands[PARSER_MAX_OPERANDS];
+    /** The destination register if no operand sets it. */
+    enum isa_register dest;
+    /** The source1 register if no operand sets it. */
+    enum isa_register source1;
+    /** The source2 register if no operand sets it. */
+    enum isa_register source2;
+    /** The immediate if no operand sets it. */
+    uint16_t immediate;
+};
+
+
+/**
+ * The operand pattern of a pseudo-instruction.
+ */
+struct parser_pseudo_pattern {
+    /** The symbolic name of the pseudo-instruction. */
+    const char *symbol;
+    /** The operands of the pseudo-instruction and the fields it implies. */
+    struct parser_pattern pattern;
+};
+
+
+/**
+ * The argument pattern of a directive.
+ */
+struct parser_directive_pattern {
+    /** The name of the directive (after the period). */
+    const char *name;
+    /** The type of the directive. */
+    enum parser_directive_type type;
+    /** The type of the token that follows the name. */
+    enum lexer_token_type argument;
+    /** Whether an identifier naming a label can follow the name instead. */
+    bool label_argument;
+};
+
+
+/** The operand patterns of real instructions, indexed by Format. */
+static const struct parser_pattern parser_format_patterns[] = {
+    [ISA_OPCODE_FORMAT_I] = {
+        .num_operands = 1,
+        .operands = {PARSER_OPERAND_IMMEDIATE}
+    },
+    [ISA_OPCODE_FORMAT_DSI] = {
+        .num_operands = 3,
+        .operands = {PARSER_OPERAND_DEST, PARSER_OPERAND_SOURCE1, PARSER_OPERAND_IMMEDIATE}
+    },
+    [ISA_OPCODE_FORMAT_DSS] = {
+        .num_operands = 3,
+        .operands = {PARSER_OPERAND_DEST, PARSER_OPERAND_SOURCE1, PARSER_OPERAND_SOURCE2}
+    }
+};
+
+
+/** The operand patterns of pseudo-instructions. Registers not set by an operand default to ZERO. */
+static const struct parser_pseudo_pattern parser_pseudo_patterns[] = {
+    {"j",    {.num_operands = 1, .operands = {PARSER_OPERAND_IMMEDIATE}}},
+    {"jl",   {.num_operands = 2, .operands = {PARSER_OPERAND_DEST, PARSER_OPERAND_IMMEDIATE}}},
+    {"jlr",  {.num_operands = 2, .operands = {PARSER_OPERAND_DEST, PARSER_OPERAND_SOURCE2}}},
+    {"j1",   {.num_operands = 2, .operands = {PARSER_OPERAND_SOURCE1, PARSER_OPERAND_IMMEDIATE}}},
+    {"j0",   {.num_operands = 2, .operands = {PARSER_OPERAND_SOURCE1, PARSER_OPERAND_IMMEDIATE}}},
+    {"call", {.num_operands = 1, .operands = {PARSER_OPERAND_IMMEDIATE}, .dest = RA}},
+    {"li",   {.num_operands = 2, .operands = {PARSER_OPERAND_DEST, PARSER_OPERAND_IMMEDIATE}}},
+    {"mv",   {.num_operands = 2, .operands = {PARSER_OPERAND_DEST, PARSER_OPERAND_SOURCE1}}},
+    {"nop",  {.num_operands = 0}},
+    {"not",  {.num_operands = 2, .operands = {PARSER_OPERAND_DEST, PARSER_OPERAND_SOURCE1},
+              .immediate = 0xFFFF}},
+    {"ret",  {.num_operands = 0, .source2 = RA}}
+};
+
+
+/** The argument patterns of directives. */
+static const struct parser_directive_pattern parser_directive_patterns[] = {
+    {"org",     PARSER_DIRECTIVE_ORG,     LEXER_TOKEN_NUMBER, false},
+    {"half",    PARSER_DIRECTIVE_HALF,    LEXER_TOKEN_NUMBER, true},
+    {"include", PARSER_DIRECTIVE_INCLUDE, LEXER_TOKEN_STRING, false}
+};
+
+
+/**
+ * Gets the token at an offset from the current position in the token stream, lexing more tokens
+ * into the lookahead window if needed.
+ *
+ * @param context  The parser context whose token stream is read.
+ * @param offset   The number of tokens past the current position (less than PARSER_LOOKAHEAD).
+ *
+ * @return Pointer to the token, which is valid until the token is consumed, or NULL if the
+ *         stream ends (or the lexer fails) before that many tokens.
+ */
+static struct lexer_token *parser_peek_token(struct parser_context *context, uint32_t offset) {
+    while (context->window_size <= offset) {
+        if (context->lexer_status != LEXER_STATUS_SUCCESS) {
+            return NULL;
         }
 
-        list_status = list_peek_at(sequence, i, &type_data);
-        if (list_status != LIST_STATUS_SUCCESS) {
-            return PARSER_STATUS_SEMANTIC_ERROR;
+        uint32_t end = (context->window_start + context->window_size) % PARSER_LOOKAHEAD;
+        context->lexer_status = lexer_next_token(context->lexer, &context->window[end]);
+        if (context->lexer_status != LEXER_STATUS_SUCCESS) {
+            return NULL;
         }
-
-        struct lexer_token *token = (struct lexer_token *) token_data;
-        enum lexer_token_type *type = (enum lexer_token_type *) type_data;
-        log_trace("Parser checking sequence[%" PRIu32 "] = '%c' vs '%c'", i, *type, token->type);
-        parser_last_token = token;
-        if (token->type != *type) {
-            return PARSER_STATUS_SEMANTIC_ERROR;
-        }
-    }
-
-    return PARSER_STATUS_SUCCESS;
-}
-
-
-static enum parser_status parser_expect_blank_instruction(struct list *tokens) {
-    log_debug("Parser checking for blank instruction");
-
-    enum lexer_token_type identifier = LEXER_TOKEN_IDENTIFIER;
-
-    struct list *sequence = create_list();
-    list_add(sequence, &identifier);
-
-    enum parser_status match_status = parser_expect_sequence(tokens, sequence);
-    destroy_list(sequence, NULL);
-    if (match_status != PARSER_STATUS_SUCCESS) {
-        return PARSER_STATUS_SEMANTIC_ERROR;
+        context->window_size++;
     }
-
-    void *data;
-    struct lexer_token *token;
-
-    // Identifier
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-
-    return PARSER_STATUS_SUCCESS;
+    return &context->window[(context->window_start + offset) % PARSER_LOOKAHEAD];
 }
 
 
-static enum parser_status parser_expect_i_instruction(struct list *tokens,
-                                                      struct parser_group *group)
+/**
+ * Consumes the token at the current position in the token stream if it has the expected type.
+ *
+ * The token is remembered as the last token examined, so that errors are reported at it.
+ *
+ * @param context  The parser context whose token stream is read.
+ * @param type     The expected type of the token.
+ *
+ * @return Pointer to the consumed token, which is valid until the next token is peeked, or NULL if
+ *         the stream is empty or the token has a different type.
+ */
+static struct lexer_token *parser_expect_token(struct parser_context *context,
+                                               enum lexer_token_type type)
 {
-    log_debug("Parser checking for I-type instruction");
-
-    enum lexer_token_type identifier = LEXER_TOKEN_IDENTIFIER;
-    enum lexer_token_type number = LEXER_TOKEN_NUMBER;
-
-    struct list *label_sequence = create_list();
-    list_add(label_sequence, &identifier);
-    list_add(label_sequence, &identifier);
-    struct list *const_sequence = create_list();
-    list_add(const_sequence, &identifier);
-    list_add(const_sequence, &number);
-
-    enum parser_status label_match_status = parser_expect_sequence(tokens, label_sequence);
-    enum parser_status const_match_status = parser_expect_sequence(tokens, const_sequence);
-    destroy_list(label_sequence, NULL);
-    destroy_list(const_sequence, NULL);
-    if (label_match_status != PARSER_STATUS_SUCCESS && const_match_status != PARSER_STATUS_SUCCESS)
-    {
-        return PARSER_STATUS_SEMANTIC_ERROR;
+    struct lexer_token *token = parser_peek_token(context, 0);
+    if (token == NULL) {
+        return NULL;
     }
 
-    void *data;
-    struct lexer_token *token;
-
-    // Identifier
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Identifier or number
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    if (label_match_status == PARSER_STATUS_SUCCESS) {
-        memcpy(group->instruction.label, token->text, LEXER_TOKEN_MAX_LENGTH);
-        group->instruction.label[LEXER_TOKEN_MAX_LENGTH] = '\0';
-    }
-    else {
-        group->instruction.immediate = token->value;
+    log_trace("Parser expecting '%c', found '%c'", type, token->type);
+    context->last_token = *token;
+    if (token->type != type) {
+        return NULL;
     }
-    free(token);
 
-    return PARSER_STATUS_SUCCESS;
+    context->window_start = (context->window_start + 1) % PARSER_LOOKAHEAD;
+    context->window_size--;
+    return token;
 }
 
 
-static enum parser_status parser_expect_di_instruction(struct list *tokens,
-                                                       struct parser_group *group)
+/**
+ * Parses the operands of an instruction according to a pattern.
+ *
+ * @param context  The parser context whose token stream is read.
+ * @param pattern  The pattern of the operands.
+ * @param group    The instruction group to fill in.
+ *
+ * @return The status of the parse.
+ */
+static enum parser_status parser_expect_operands(struct parser_context *context,
+                                                 const struct parser_pattern *pattern,
+                                                 struct parser_group *group)
 {
-    log_debug("Parser checking for DI-type pseudo-instruction");
-
-    enum lexer_token_type identifier = LEXER_TOKEN_IDENTIFIER;
-    enum lexer_token_type destination = LEXER_TOKEN_REGISTER;
-    enum lexer_token_type number = LEXER_TOKEN_NUMBER;
-    enum lexer_token_type comma = LEXER_TOKEN_COMMA;
-
-    struct list *label_sequence = create_list();
-    list_add(label_sequence, &identifier);
-    list_add(label_sequence, &destination);
-    list_add(label_sequence, &comma);
-    list_add(label_sequence, &identifier);
-    struct list *const_sequence = create_list();
-    list_add(const_sequence, &identifier);
-    list_add(const_sequence, &destination);
-    list_add(const_sequence, &comma);
-    list_add(const_sequence, &number);
-
-    enum parser_status label_match_status = parser_expect_sequence(tokens, label_sequence);
-    enum parser_status const_match_status = parser_expect_sequence(tokens, const_sequence);
-    destroy_list(label_sequence, NULL);
-    destroy_list(const_sequence, NULL);
-    if (label_match_status != PARSER_STATUS_SUCCESS && const_match_status != PARSER_STATUS_SUCCESS)
-    {
-        return PARSER_STATUS_SEMANTIC_ERROR;
-    }
+    group->instruction.dest = pattern->dest;
+    group->instruction.source1 = pattern->source1;
+    group->instruction.source2 = pattern->source2;
+    group->instruction.immediate = pattern->immediate;
+    group->instruction.label = PARSER_NO_LABEL;
+
+    for (uint8_t i = 0; i < pattern->num_operands; i++) {
+        if (i > 0 && parser_expect_token(context, LEXER_TOKEN_COMMA) == NULL) {
+            return PARSER_STATUS_SEMANTIC_ERROR;
+        }
 
-    void *data;
-    struct lexer_token *token;
-
-    // Identifier
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Destination
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    group->instruction.dest = token->value;
-    free(token);
-    // Comma
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Identifier or number
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    if (label_match_status == PARSER_STATUS_SUCCESS) {
-        memcpy(group->instruction.label, token->text, LEXER_TOKEN_MAX_LENGTH);
-        group->instruction.label[LEXER_TOKEN_MAX_LENGTH] = '\0';
-    }
-    else {
-        group->instruction.immediate = token->value;
+        struct lexer_token *token;
+        switch (pattern->operands[i]) {
+        case PARSER_OPERAND_DEST:
+        case PARSER_OPERAND_SOURCE1:
+        case PARSER_OPERAND_SOURCE2:
+            token = parser_expect_token(context, LEXER_TOKEN_REGISTER);
+            if (token == NULL) {
+                return PARSER_STATUS_SEMANTIC_ERROR;
+            }
+            if (pattern->operands[i] == PARSER_OPERAND_DEST) {
+                group->instruction.dest = token->value;
+            }
+            else if (pattern->operands[i] == PARSER_OPERAND_SOURCE1) {
+                group->instruction.source1 = token->value;
+            }
+            else {
+                group->instruction.source2 = token->value;
+            }
+            break;
+        case PARSER_OPERAND_IMMEDIATE:
+            // A single token of lookahead decides between a constant and a label reference.
+            token = parser_peek_token(context, 0);
+            if (token != NULL && token->type == LEXER_TOKEN_IDENTIFIER) {
+                // The lexer interned the identifier, so its ID is also the label ID.
+                token = parser_expect_token(context, LEXER_TOKEN_IDENTIFIER);
+                group->instruction.label = token->value;
+            }
+            else {
+                token = parser_expect_token(context, LEXER_TOKEN_NUMBER);
+                if (token == NULL) {
+                    return PARSER_STATUS_SEMANTIC_ERROR;
+                }
+                group->instruction.immediate = token->value;
+            }
+            break;
+        }
     }
-    free(token);
 
     return PARSER_STATUS_SUCCESS;
 }
 
 
-static enum parser_status parser_expect_ds_instruction(struct list *tokens,
-                                                       struct parser_group *group)
-{
-    log_debug("Parser checking for DS-type pseudo-instruction");
-
-    enum lexer_token_type identifier = LEXER_TOKEN_IDENTIFIER;
-    enum lexer_token_type destination = LEXER_TOKEN_REGISTER;
-    enum lexer_token_type source = LEXER_TOKEN_REGISTER;
-    enum lexer_token_type comma = LEXER_TOKEN_COMMA;
-
-    struct list *sequence = create_list();
-    list_add(sequence, &identifier);
-    list_add(sequence, &destination);
-    list_add(sequence, &comma);
-    list_add(sequence, &source);
-
-    enum parser_status match_status = parser_expect_sequence(tokens, sequence);
-    destroy_list(sequence, NULL);
-    if (match_status != PARSER_STATUS_SUCCESS) {
-        return PARSER_STATUS_SEMANTIC_ERROR;
+/**
+ * Gets the operand pattern of an instruction.
+ *
+ * @param opcode_map  The opcode mapping of the instruction's mnemonic.
+ *
+ * @return The pattern of the instruction's operands, or NULL if the instruction is unknown.
+ */
+static const struct parser_pattern *parser_get_pattern(const struct isa_opcode_map *opcode_map) {
+    if (opcode_map->format != ISA_OPCODE_FORMAT_PSEUDO) {
+        switch (opcode_map->format) {
+        case ISA_OPCODE_FORMAT_I:
+        case ISA_OPCODE_FORMAT_DSI:
+        case ISA_OPCODE_FORMAT_DSS:
+            return &parser_format_patterns[opcode_map->format];
+        default:
+            return NULL;
+        }
     }
 
-    void *data;
-    struct lexer_token *token;
-
-    // Identifier
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Destination
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    group->instruction.dest = token->value;
-    free(token);
-    // Comma
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Source
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    group->instruction.source1 = token->value;
-    free(token);
-
-    return PARSER_STATUS_SUCCESS;
+    size_t num_pseudo_patterns = sizeof(parser_pseudo_patterns) / sizeof(parser_pseudo_patterns[0]);
+    for (size_t i = 0; i < num_pseudo_patterns; i++) {
+        if (strcmp(parser_pseudo_patterns[i].symbol, opcode_map->symbol) == 0) {
+            return &parser_pseudo_patterns[i].pattern;
+        }
+    }
+    return NULL;
 }
 
 
-static enum parser_status parser_expect_dsi_instruction(struct list *tokens,
-                                                        struct parser_group *group)
+/**
+ * Parses an instruction, whose first token is known to be an identifier.
+ *
+ * @param context  The parser context whose token stream is read.
+ * @param group    The group to fill in.
+ *
+ * @return The status of the parse.
+ */
+static enum parser_status parser_expect_instruction(struct parser_context *context,
+                                                    struct parser_group *group)
 {
-    log_debug("Parser checking for DSI-type instruction");
-
-    enum lexer_token_type identifier = LEXER_TOKEN_IDENTIFIER;
-    enum lexer_token_type destination = LEXER_TOKEN_REGISTER;
-    enum lexer_token_type source = LEXER_TOKEN_REGISTER;
-    enum lexer_token_type number = LEXER_TOKEN_NUMBER;
-    enum lexer_token_type comma = LEXER_TOKEN_COMMA;
-
-    struct list *label_sequence = create_list();
-    list_add(label_sequence, &identifier);
-    list_add(label_sequence, &destination);
-    list_add(label_sequence, &comma);
-    list_add(label_sequence, &source);
-    list_add(label_sequence, &comma);
-    list_add(label_sequence, &identifier);
-    struct list *const_sequence = create_list();
-    list_add(const_sequence, &identifier);
-    list_add(const_sequence, &destination);
-    list_add(const_sequence, &comma);
-    list_add(const_sequence, &source);
-    list_add(const_sequence, &comma);
-    list_add(const_sequence, &number);
-
-    enum parser_status label_match_status = parser_expect_sequence(tokens, label_sequence);
-    enum parser_status const_match_status = parser_expect_sequence(tokens, const_sequence);
-    destroy_list(label_sequence, NULL);
-    destroy_list(const_sequence, NULL);
-    if (label_match_status != PARSER_STATUS_SUCCESS && const_match_status != PARSER_STATUS_SUCCESS)
-    {
+    log_debug("Parser checking for instruction");
+    group->type = PARSER_GROUP_INSTRUCTION;
+
+    struct lexer_token *token = parser_expect_token(context, LEXER_TOKEN_IDENTIFIER);
+    const struct isa_opcode_map *opcode_map =
+        isa_get_opcode_map_from_text(token->text, token->length);
+    if (opcode_map == NULL) {
         return PARSER_STATUS_SEMANTIC_ERROR;
     }
 
-    void *data;
-    struct lexer_token *token;
-
-    // Identifier
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Destination
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    group->instruction.dest = token->value;
-    free(token);
-    // Comma
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Destination
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    group->instruction.source1 = token->value;
-    free(token);
-    // Comma
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Identifier or number
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    if (label_match_status == PARSER_STATUS_SUCCESS) {
-        memcpy(group->instruction.label, token->text, LEXER_TOKEN_MAX_LENGTH);
-        group->instruction.label[LEXER_TOKEN_MAX_LENGTH] = '\0';
-    }
-    else {
-        group->instruction.immediate = token->value;
+    const struct parser_pattern *pattern = parser_get_pattern(opcode_map);
+    if (pattern == NULL) {
+        return PARSER_STATUS_SEMANTIC_ERROR;
     }
-    free(token);
-
-    return PARSER_STATUS_SUCCESS;
 
+    group->instruction.opcode = opcode_map->opcode;
+    return parser_expect_operands(context, pattern, group);
 }
 
 
-static enum parser_status parser_expect_dss_instruction(struct list *tokens,
-                                                        struct parser_group *group)
+/**
+ * Parses a label definition, whose first two tokens are known to be an identifier and a colon.
+ *
+ * @param context  The parser context whose token stream is read.
+ * @param group    The group to fill in.
+ *
+ * @return The status of the parse.
+ */
+static enum parser_status parser_expect_label(struct parser_context *context,
+                                              struct parser_group *group)
 {
-    log_debug("Parser checking for DSS-type instruction");
-
-    enum lexer_token_type identifier = LEXER_TOKEN_IDENTIFIER;
-    enum lexer_token_type destination = LEXER_TOKEN_REGISTER;
-    enum lexer_token_type source = LEXER_TOKEN_REGISTER;
-    enum lexer_token_type comma = LEXER_TOKEN_COMMA;
-
-    struct list *sequence = create_list();
-    list_add(sequence, &identifier);
-    list_add(sequence, &destination);
-    list_add(sequence, &comma);
-    list_add(sequence, &source);
-    list_add(sequence, &comma);
-    list_add(sequence, &source);
-
-    enum parser_status match_status = parser_expect_sequence(tokens, sequence);
-    destroy_list(sequence, NULL);
-    if (match_status != PARSER_STATUS_SUCCESS) {
-        return PARSER_STATUS_SEMANTIC_ERROR;
-    }
+    log_debug("Parser checking for label");
+    group->type = PARSER_GROUP_LABEL;
 
-    void *data;
-    struct lexer_token *token;
-
-    // Identifier
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Destination
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    group->instruction.dest = token->value;
-    free(token);
-    // Comma
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Source
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    group->instruction.source1 = token->value;
-    free(token);
-    // Comma
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Source
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    group->instruction.source2 = token->value;
-    free(token);
+    struct lexer_token *token = parser_expect_token(context, LEXER_TOKEN_IDENTIFIER);
+    group->label.label = token->value;
+    group->label.immediate = context->pc;
+    parser_expect_token(context, LEXER_TOKEN_COLON);
 
     return PARSER_STATUS_SUCCESS;
 }
 
 
-static enum parser_status parser_expect_pseudo_instruction(struct list *tokens,
-                                                           struct parser_group *group)
+/**
+ * Lexes an included file and splices its tokens into the token stream at the current position.
+ *
+ * @param context  The parser context whose token stream is extended.
+ * @param token    The string token holding the path of the file to include.
+ *
+ * @return The status of the include.
+ */
+static enum parser_status parser_include_file(struct parser_context *context,
+                                              const struct lexer_token *token)
 {
-    log_debug("Parser checking for pseudo-instruction");
-
-    void *data;
-    list_peek_at(tokens, 0, &data);
-    struct lexer_token *token = (struct lexer_token *) data;
+    char include_path[LEXER_TOKEN_MAX_LENGTH + 1];
+    lexer_token_copy_text(token, include_path, sizeof(include_path));
 
-    enum parser_status parse_status;
-    if (strncmp(token->text, "j", ISA_OPCODE_SYMBOL_MAX_LENGTH) == 0) {
-        parse_status = parser_expect_i_instruction(tokens, group);
-        group->instruction.dest = ZERO;
-        group->instruction.source1 = ZERO;
-    }
-    else if (strncmp(token->text, "jl", ISA_OPCODE_SYMBOL_MAX_LENGTH) == 0) {
-        parse_status = parser_expect_di_instruction(tokens, group);
-        group->instruction.source1 = ZERO;
-    }
-    else if (strncmp(token->text, "jlr", ISA_OPCODE_SYMBOL_MAX_LENGTH) == 0) {
-        parse_status = parser_expect_ds_instruction(tokens, group);
-        group->instruction.source2 = group->instruction.source1;
-        group->instruction.source1 = ZERO;
-    }
-    else if (strncmp(token->text, "j1", ISA_OPCODE_SYMBOL_MAX_LENGTH) == 0) {
-        parse_status = parser_expect_di_instruction(tokens, group);
-        group->instruction.source1 = group->instruction.dest;
-        group->instruction.dest = ZERO;
-    }
-    else if (strncmp(token->text, "j0", ISA_OPCODE_SYMBOL_MAX_LENGTH) == 0) {
-        parse_status = parser_expect_di_instruction(tokens, group);
-        group->instruction.source1 = group->instruction.dest;
-        group->instruction.dest = ZERO;
-    }
-    else if (strncmp(token->text, "call", ISA_OPCODE_SYMBOL_MAX_LENGTH) == 0) {
-        parse_status = parser_expect_i_instruction(tokens, group);
-        group->instruction.dest = RA;
-        group->instruction.source1 = ZERO;
-    }
-    else if (strncmp(token->text, "li", ISA_OPCODE_SYMBOL_MAX_LENGTH) == 0) {
-        parse_status = parser_expect_di_instruction(tokens, group);
-        group->instruction.source1 = ZERO;
-    }
-    else if (strncmp(token->text, "mv", ISA_OPCODE_SYMBOL_MAX_LENGTH) == 0) {
-        parse_status = parser_expect_ds_instruction(tokens, group);
-        group->instruction.source2 = ZERO;
-    }
-    else if (strncmp(token->text, "nop", ISA_OPCODE_SYMBOL_MAX_LENGTH) == 0) {
-        parse_status = parser_expect_blank_instruction(tokens);
-        group->instruction.dest = ZERO;
-        group->instruction.source1 = ZERO;
-        group->instruction.source2 = ZERO;
+    // The included file is lexed next, so no token after the include can have been read yet.
+    if (context->window_size != 0) {
+        return PARSER_STATUS_SEMANTIC_ERROR;
     }
-    else if (strncmp(token->text, "not", ISA_OPCODE_SYMBOL_MAX_LENGTH) == 0) {
-        parse_status = parser_expect_ds_instruction(tokens, group);
-        group->instruction.immediate = 0xFFFF;
+
+    // Files that are not in the cache are lexed directly, which also reports why they failed.
+    const struct lexer_token *tokens;
+    uint32_t num_tokens;
+    enum include_cache_status cache_status = INCLUDE_CACHE_STATUS_NOT_FOUND;
+    if (context->includes != NULL) {
+        cache_status = include_cache_get(context->includes, include_path, &tokens, &num_tokens);
     }
-    else if (strncmp(token->text, "ret", ISA_OPCODE_SYMBOL_MAX_LENGTH) == 0) {
-        parse_status = parser_expect_blank_instruction(tokens);
-        group->instruction.dest = ZERO;
-        group->instruction.source1 = ZERO;
-        group->instruction.source2 = RA;
+
+    enum lexer_status include_status;
+    switch (cache_status) {
+    case INCLUDE_CACHE_STATUS_SKIPPED:
+        log_debug("Parser skipped include '%s' (already included)", include_path);
+        return PARSER_STATUS_SUCCESS;
+    case INCLUDE_CACHE_STATUS_SUCCESS:
+        include_status = lexer_include_tokens(context->lexer, tokens, num_tokens);
+        break;
+    default:
+        include_status = lexer_include_file(context->lexer, include_path);
+        break;
     }
-    else {
+    if (include_status != LEXER_STATUS_SUCCESS) {
+        log_error("Lexer failed to process included file '%s' (errno %d)",
+                  include_path, include_status);
         return PARSER_STATUS_SEMANTIC_ERROR;
     }
 
-    return parse_status;
+    log_debug("Parser expanded include '%s'", include_path);
+    return PARSER_STATUS_SUCCESS;
 }
 
 
-static enum parser_status parser_expect_instruction(struct list *tokens, struct parser_group *group)
+/**
+ * Parses a directive, whose first token is known to be a period.
+ *
+ * @param context         The parser context whose token stream is read.
+ * @param group           The group to fill in.
+ * @param directive[out]  A pointer to return the operands of the directive.
+ *
+ * @return The status of the parse.
+ */
+static enum parser_status parser_expect_directive(struct parser_context *context,
+                                                  struct parser_group *group,
+                                                  struct parser_directive *directive)
 {
-    log_debug("Parser checking for instruction");
-    group->type = PARSER_GROUP_INSTRUCTION;
+    log_debug("Parser checking for directive");
+    group->type = PARSER_GROUP_DIRECTIVE;
 
-    void *data;
-    enum list_status list_status = list_peek_at(tokens, 0, &data);
-    struct lexer_token *token = (struct lexer_token *) data;
-    if (list_status != LIST_STATUS_SUCCESS || token->type != LEXER_TOKEN_IDENTIFIER) {
+    parser_expect_token(context, LEXER_TOKEN_PERIOD);
+    struct lexer_token *token = parser_expect_token(context, LEXER_TOKEN_IDENTIFIER);
+    if (token == NULL) {
         return PARSER_STATUS_SEMANTIC_ERROR;
     }
 
-    const struct isa_opcode_map *opcode_map = isa_get_opcode_map_from_symbol(token->text);
-    if (opcode_map == NULL) {
+    const struct parser_directive_pattern *pattern = NULL;
+    size_t num_directive_patterns =
+        sizeof(parser_directive_patterns) / sizeof(parser_directive_patterns[0]);
+    for (size_t i = 0; i < num_directive_patterns; i++) {
+        if (lexer_token_equals(token, parser_directive_patterns[i].name)) {
+            pattern = &parser_directive_patterns[i];
+            break;
+        }
+    }
+    if (pattern == NULL) {
         return PARSER_STATUS_SEMANTIC_ERROR;
     }
 
-    group->instruction.opcode = opcode_map->opcode;
-    switch (opcode_map->format) {
-    case ISA_OPCODE_FORMAT_PSEUDO:
-        return parser_expect_pseudo_instruction(tokens, group);
-    case ISA_OPCODE_FORMAT_I:
-        return parser_expect_i_instruction(tokens, group);
-    case ISA_OPCODE_FORMAT_DSI:
-        return parser_expect_dsi_instruction(tokens, group);
-    case ISA_OPCODE_FORMAT_DSS:
-        return parser_expect_dss_instruction(tokens, group);
-    default:
+    enum lexer_token_type argument = pattern->argument;
+    struct lexer_token *next = parser_peek_token(context, 0);
+    if (pattern->label_argument && next != NULL && next->type == LEXER_TOKEN_IDENTIFIER) {
+        argument = LEXER_TOKEN_IDENTIFIER;
+    }
+    token = parser_expect_token(context, argument);
+    if (token == NULL) {
         return PARSER_STATUS_SEMANTIC_ERROR;
     }
-}
-
-static enum parser_status parser_expect_label(struct list *tokens, struct parser_group *group) {
-    log_debug("Parser checking for label");
-    group->type = PARSER_GROUP_LABEL;
 
-    enum lexer_token_type identifier = LEXER_TOKEN_IDENTIFIER;
-    enum lexer_token_type colon = LEXER_TOKEN_COLON;
-    struct list *sequence = create_list();
-    list_add(sequence, &identifier);
-    list_add(sequence, &colon);
-
-    enum parser_status match_status = parser_expect_sequence(tokens, sequence);
-    destroy_list(sequence, NULL);
-    if (match_status != PARSER_STATUS_SUCCESS) {
-        return match_status;
+    *directive = (struct parser_directive) {.type = pattern->type};
+    switch (pattern->type) {
+    case PARSER_DIRECTIVE_ORG:
+        if (token->value < context->pc) {
+            log_fatal(".org 0x%04" PRIx16 " directive is before pc (0x%04" PRIx16 ")",
+                      token->value, context->pc);
+        }
+        directive->org.num_pad_bytes = token->value - context->pc;
+        context->pc = token->value;
+        return PARSER_STATUS_SUCCESS;
+    case PARSER_DIRECTIVE_HALF:
+        if (argument == LEXER_TOKEN_IDENTIFIER) {
+            directive->half.label = token->value;
+        }
+        else {
+            directive->half.element = token->value;
+            directive->half.label = PARSER_NO_LABEL;
+        }
+        context->pc += sizeof(uint16_t);
+        return PARSER_STATUS_SUCCESS;
+    case PARSER_DIRECTIVE_INCLUDE:
+        return parser_include_file(context, token);
+    default:
+        return PARSER_STATUS_SEMANTIC_ERROR;
     }
-
-    void *data;
-    struct lexer_token *token;
-
-    // Identifier
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    memcpy(group->label.label, token->text, LEXER_TOKEN_MAX_LENGTH);
-    group->label.label[LEXER_TOKEN_MAX_LENGTH] = '\0';
-    group->label.immediate = parser_pc;
-    free(token);
-    // Colon
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-
-    return PARSER_STATUS_SUCCESS;
 }
 
 
-static enum parser_status parser_expect_org_directive(struct list *tokens,
-                                                      struct parser_group *group)
+/**
+ * Parses the next semantic group from the token stream.
+ *
+ * The type of the group is decided from the first token (and the second, to tell a label from an
+ * instruction), so each group is parsed in a single pass with no backtracking. Include directives
+ * are expanded in place and never returned as groups.
+ *
+ * @param context         The parser context whose token stream is read.
+ * @param group           The group to fill in.
+ * @param directive[out]  A pointer to return the operands of the group if it is a directive.
+ *
+ * @return The status of the parse. EOF if no tokens remain.
+ */
+static enum parser_status parser_next_group(struct parser_context *context,
+                                            struct parser_group *group,
+                                            struct parser_directive *directive)
 {
-    log_debug("Parser checking for .org directive");
-
-    enum lexer_token_type period = LEXER_TOKEN_PERIOD;
-    enum lexer_token_type identifier = LEXER_TOKEN_IDENTIFIER;
-    enum lexer_token_type number = LEXER_TOKEN_NUMBER;
-
-    struct list *sequence = create_list();
-    list_add(sequence, &period);
-    list_add(sequence, &identifier);
-    list_add(sequence, &number);
+    while (true) {
+        struct lexer_token *first = parser_peek_token(context, 0);
+        if (first == NULL) {
+            return PARSER_STATUS_EOF;
+        }
 
-    enum parser_status match_status = parser_expect_sequence(tokens, sequence);
-    destroy_list(sequence, NULL);
-    if (match_status != PARSER_STATUS_SUCCESS) {
-        return PARSER_STATUS_SEMANTIC_ERROR;
-    }
+        *group = (struct parser_group) {0};
+        enum parser_status parse_status;
+        if (first->type == LEXER_TOKEN_IDENTIFIER) {
+            struct lexer_token *second = parser_peek_token(context, 1);
+            if (second != NULL && second->type == LEXER_TOKEN_COLON) {
+                parse_status = parser_expect_label(context, group);
+                log_debug("Parser found a label (ID %" PRIu32 ") at 0x%04" PRIx16,
+                          (uint32_t) group->label.label, context->pc);
+            }
+            else {
+                parse_status = parser_expect_instruction(context, group);
+                context->pc += sizeof(uint32_t);
+            }
+        }
+        else if (first->type == LEXER_TOKEN_PERIOD) {
+            parse_status = parser_expect_directive(context, group, directive);
+            if (parse_status == PARSER_STATUS_SUCCESS &&
+                directive->type == PARSER_DIRECTIVE_INCLUDE)
+            {
+                continue;  // Include processed, emit next real group
+            }
+        }
+        else {
+            context->last_token = *first;
+            parse_status = PARSER_STATUS_SEMANTIC_ERROR;
+        }
 
-    void *data;
-    struct lexer_token *token;
-
-    // Period
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Identifier
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Number
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    if (token->value < parser_pc) {
-        log_fatal(".org 0x%04" PRIx16 " directive is before pc (0x%04" PRIx16 ")",
-                  token->value, parser_pc);
+        if (parse_status != PARSER_STATUS_SUCCESS) {
+            group->type = PARSER_GROUP_EOF;
+        }
+        return parse_status;
     }
-    group->directive.org.num_pad_bytes = token->value - parser_pc;
-    parser_pc = token->value;
-    free(token);
-
-    return PARSER_STATUS_SUCCESS;
 }
 
 
-static enum parser_status parser_expect_half_directive(struct list *tokens,
-                                                       struct parser_group *group)
+/**
+ * Adds a semantic group to a program. This is the group callback used by parser_parse_file.
+ *
+ * @see parser_group_callback
+ */
+static enum parser_status parser_add_group(void *data,
+                                           const struct parser_group *group,
+                                           const struct parser_directive *directive)
 {
-    log_debug("Parser checking for .half directive");
-
-    enum lexer_token_type period = LEXER_TOKEN_PERIOD;
-    enum lexer_token_type identifier = LEXER_TOKEN_IDENTIFIER;
-    enum lexer_token_type number = LEXER_TOKEN_NUMBER;
-
-    struct list *sequence = create_list();
-    list_add(sequence, &period);
-    list_add(sequence, &identifier);
-    list_add(sequence, &number);
-
-    enum parser_status match_status = parser_expect_sequence(tokens, sequence);
-    destroy_list(sequence, NULL);
-    if (match_status != PARSER_STATUS_SUCCESS) {
-        return PARSER_STATUS_SEMANTIC_ERROR;
+    struct parser_program *program = (struct parser_program *) data;
+
+    // Only the index of the operands is stored in the group, so that groups stay small.
+    struct parser_group added = *group;
+    if (directive != NULL) {
+        added.directive.index = program->directives->size;
+        if (vector_add(program->directives, directive) != VECTOR_STATUS_SUCCESS) {
+            return PARSER_STATUS_OUT_OF_MEMORY;
+        }
     }
 
-    void *data;
-    struct lexer_token *token;
-
-    // Period
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Identifier
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Number
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    group->directive.half.element = token->value;
-    free(token);
-
+    if (vector_add(program->groups, &added) != VECTOR_STATUS_SUCCESS) {
+        return PARSER_STATUS_OUT_OF_MEMORY;
+    }
     return PARSER_STATUS_SUCCESS;
 }
 
 
-static enum parser_status parser_expect_include_directive(struct list *tokens) {
-    log_debug("Parser checking for .include directive");
+struct parser_context *create_parser_context(struct lexer_context *lexer) {
+    struct parser_context *context =
+        (struct parser_context *) malloc(sizeof(struct parser_context));
 
-    enum lexer_token_type period = LEXER_TOKEN_PERIOD;
-    enum lexer_token_type identifier = LEXER_TOKEN_IDENTIFIER;
-    enum lexer_token_type string = LEXER_TOKEN_STRING;
+    context->lexer = lexer;
+    context->window_start = 0;
+    context->window_size = 0;
+    context->lexer_status = LEXER_STATUS_EOF;
+    context->pc = 0x0000;
+    context->last_token = (struct lexer_token) {0};
+    context->includes = NULL;
 
-    struct list *sequence = create_list();
-    list_add(sequence, &period);
-    list_add(sequence, &identifier);
-    list_add(sequence, &string);
+    return context;
+}
 
-    enum parser_status match_status = parser_expect_sequence(tokens, sequence);
-    destroy_list(sequence, NULL);
-    if (match_status != PARSER_STATUS_SUCCESS) {
-        return PARSER_STATUS_SEMANTIC_ERROR;
-    }
 
-    void *data;
-    struct lexer_token *token;
-
-    // Period
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // Identifier
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    free(token);
-    // String
-    list_pop_front(tokens, &data);
-    token = (struct lexer_token *) data;
-    char include_path[LEXER_TOKEN_MAX_LENGTH + 1];
-    strncpy(include_path, token->text, LEXER_TOKEN_MAX_LENGTH - 1);
-    include_path[LEXER_TOKEN_MAX_LENGTH] = '\0';
-    free(token);
+void destroy_parser_context(struct parser_context *context) {
+    free(context);
+}
 
-    struct list *include_tokens;
-    enum lexer_status include_status = lexer_lex_file(include_path, &include_tokens);
-    if (include_status != LEXER_STATUS_SUCCESS) {
-        log_error("Lexer failed to process included file '%s' (errno %d)",
-                  include_path, include_status);
-        return PARSER_STATUS_SEMANTIC_ERROR;
-    }
 
-    uint32_t tokens_added = 0;
-    while (include_tokens->size > 0) {
-        void *include_token;
-        list_pop_front(include_tokens, &include_token);
-        list_add_at(tokens, tokens_added++, include_token);
+void parser_set_include_cache(struct parser_context *context, struct include_cache *includes) {
+    if (context == NULL) {
+        return;
     }
-    destroy_list(include_tokens, NULL);
-
-    log_debug("Parser expanded include '%s' (added %" PRIu32 " tokens)",
-              include_path, tokens_added);
-    return PARSER_STATUS_SUCCESS;
+    context->includes = includes;
 }
 
 
-static enum parser_status parser_expect_directive(struct list *tokens, struct parser_group *group) {
-    log_debug("Parser checking for directive");
-    group->type = PARSER_GROUP_DIRECTIVE;
-
-    void *data;
-    enum list_status list_status;
-    struct lexer_token *token;
-
-    list_status = list_peek_at(tokens, 0, &data);
-    token = (struct lexer_token *) data;
-    if (list_status != LIST_STATUS_SUCCESS || token->type != LEXER_TOKEN_PERIOD) {
-        return PARSER_STATUS_SEMANTIC_ERROR;
-    }
-
-    list_status = list_peek_at(tokens, 1, &data);
-    token = (struct lexer_token *) data;
-    if (list_status != LIST_STATUS_SUCCESS || token->type != LEXER_TOKEN_IDENTIFIER) {
-        return PARSER_STATUS_SEMANTIC_ERROR;
+enum parser_status parser_stream_file(struct parser_context *context,
+                                      const char *file_name,
+                                      struct arena *arena,
+                                      parser_group_callback callback,
+                                      void *data)
+{
+    if (context == NULL || context->lexer == NULL || file_name == NULL || callback == NULL) {
+        return PARSER_STATUS_INVALID_ARGUMENT;
     }
 
-    enum parser_status parse_status;
-    if (strncmp(token->text, "org", LEXER_TOKEN_MAX_LENGTH) == 0) {
-        group->directive.type = PARSER_DIRECTIVE_ORG;
-        parse_status = parser_expect_org_directive(tokens, group);
-    }
-    else if (strncmp(token->text, "half", LEXER_TOKEN_MAX_LENGTH) == 0) {
-        group->directive.type = PARSER_DIRECTIVE_HALF;
-        parse_status = parser_expect_half_directive(tokens, group);
+    context->window_start = 0;
+    context->window_size = 0;
+    context->lexer_status = lexer_open_file(context->lexer, file_name, arena);
+    context->pc = 0x0000;
+    context->last_token = (struct lexer_token) {0};
+    if (context->lexer_status != LEXER_STATUS_SUCCESS) {
+        return PARSER_STATUS_LEXER_ERROR;
     }
-    else if (strncmp(token->text, "include", LEXER_TOKEN_MAX_LENGTH) == 0) {
-        group->directive.type = PARSER_DIRECTIVE_INCLUDE;
-        parse_status = parser_expect_include_directive(tokens);
+    if (context->includes != NULL) {
+        include_cache_start_run(context->includes, file_name, context->lexer->source,
+                                context->lexer->source_length);
     }
-    else {
-        return PARSER_STATUS_SEMANTIC_ERROR;
-    }
-    return parse_status;
-}
-
 
-static enum parser_status parser_next_group(struct list *tokens, struct parser_group *group) {
-    if (tokens->size == 0) {
-        return PARSER_STATUS_EOF;
+    uint32_t num_groups = 0;
+    struct parser_group group;
+    struct parser_directive directive;
+    enum parser_status status;
+    while ((status = parser_next_group(context, &group, &directive)) == PARSER_STATUS_SUCCESS) {
+        log_debug("Parser found semantic group of type %d", group.type);
+        num_groups++;
+        status = callback(data, &group, group.type == PARSER_GROUP_DIRECTIVE ? &directive : NULL);
+        if (status != PARSER_STATUS_SUCCESS) {
+            break;
+        }
     }
 
-    if (parser_expect_label(tokens, group) == PARSER_STATUS_SUCCESS) {
-        log_debug("Parser found a label '%s' at 0x%04" PRIx16, group->label.label, parser_pc);
-        return PARSER_STATUS_SUCCESS;
-    }
-    else if (parser_expect_instruction(tokens, group) == PARSER_STATUS_SUCCESS) {
-        log_debug("Parser found an instruction");
-        parser_pc += sizeof(uint32_t);
-        return PARSER_STATUS_SUCCESS;
+    // A token missing because the lexer failed is the lexer's error, which it already reported.
+    if (context->lexer_status != LEXER_STATUS_SUCCESS &&
+        context->lexer_status != LEXER_STATUS_EOF)
+    {
+        return PARSER_STATUS_LEXER_ERROR;
     }
-    else if (parser_expect_directive(tokens, group) == PARSER_STATUS_SUCCESS) {
-        log_debug("Parser found a directive");
-        switch (group->directive.type) {
-        case PARSER_DIRECTIVE_HALF:
-            parser_pc += sizeof(uint16_t);
-            break;
-        case PARSER_DIRECTIVE_INCLUDE:
-            return parser_next_group(tokens, group);  // Include processed, emit next real group
-        default:
-            break;  // No special operations for other directive types
-        }
+
+    switch (status) {
+    case PARSER_STATUS_EOF:
+        log_info("Parser finished successfully (groups found: %" PRIu32 ")", num_groups);
         return PARSER_STATUS_SUCCESS;
-    }
-    else {
-        group->type = PARSER_GROUP_EOF;
-        return PARSER_STATUS_SEMANTIC_ERROR;
+    case PARSER_STATUS_SEMANTIC_ERROR:
+        log_error("%s (%" PRIu32 ":%" PRIu32 "): Parser could not parse token (errno %d)",
+                  context->last_token.file != NULL ? context->last_token.file : "nil",
+                  context->last_token.line, context->last_token.column, status);
+        return status;
+    default:
+        log_error("Parser stopped after %" PRIu32 " groups (errno %d)", num_groups, status);
+        return status;
     }
 }
 
 
-enum parser_status parser_parse_tokens(struct list *tokens, struct list **groups) {
-    if (tokens == NULL || groups == NULL) {
+enum parser_status parser_parse_file(struct parser_context *context,
+                                     const char *file_name,
+                                     struct arena *arena,
+                                     struct parser_program *program)
+{
+    if (context == NULL || context->lexer == NULL || file_name == NULL || program == NULL) {
         return PARSER_STATUS_INVALID_ARGUMENT;
     }
 
-    parser_pc = 0x0000;
-    *groups = create_list();
-
-    uint32_t num_groups = 0;
-    while (true) {
-        num_groups++;
-        struct parser_group *group = (struct parser_group *) calloc(1, sizeof(struct parser_group));
-        enum parser_status parse_status = parser_next_group(tokens, group);
+    program->groups = create_vector_in_arena(arena, sizeof(struct parser_group));
+    program->directives = create_vector_in_arena(arena, sizeof(struct parser_directive));
+    program->labels = context->lexer->identifiers;
 
-        switch (parse_status) {
-        case PARSER_STATUS_SUCCESS:
-            log_debug("Parser found semantic group of type %d", group->type);
-            list_add(*groups, (void *) group);
-            break;
-        case PARSER_STATUS_EOF:
-            log_info("Parser finished successfully (groups found: %" PRIu32 ")", (*groups)->size);
-            free(group);
-            return PARSER_STATUS_SUCCESS;
-        default:
-            log_error("%s (%" PRIu32 ":%" PRIu32 "): Parser could not parse token (errno %d)",
-                      parser_last_token != NULL ? parser_last_token->file : "nil",
-                      parser_last_token != NULL ? parser_last_token->line : 0,
-                      parser_last_token != NULL ? parser_last_token->column : 0,
-                      parse_status);
-            destroy_list(*groups, &list_default_node_free_callback);
-            free(group);
-            return parse_status;
-        }
+    enum parser_status status =
+        parser_stream_file(context, file_name, arena, parser_add_group, program);
+    if (status != PARSER_STATUS_SUCCESS) {
+        destroy_vector(program->groups);
+        destroy_vector(program->directives);
     }
+    return status;
 }
@@ -0,0 +1,253 @@
+#include "assembler/scanner.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+#if defined(__x86_64__)
+#define SCANNER_X86
+#include <immintrin.h>
+#endif
+
+
+size_t scanner_skip_scalar(const char *text,
+                           size_t length,
+                           size_t position,
+                           uint32_t *num_newlines,
+                           size_t *line_start)
+{
+    while (position < length) {
+        unsigned char c = (unsigned char) text[position];
+        if (c == ';') {
+            // The newline that ends the comment is skipped as whitespace on the next iteration.
+            while (position < length && text[position] != '\n') {
+                position++;
+            }
+        }
+        else if (isspace(c)) {
+            position++;
+            if (c == '\n') {
+                (*num_newlines)++;
+                *line_start = position;
+            }
+        }
+        else {
+            break;
+        }
+    }
+    return position;
+}
+
+
+#ifdef SCANNER_X86
+
+
+/** The number of characters classified at a time by the widest scanner. */
+#define SCANNER_MAX_WIDTH 32
+
+
+/**
+ * Blocks of the constant characters compared against by the vector scanners. These are loaded
+ * rather than built with _mm_set1_epi8, which is expensive in unoptimized builds.
+ */
+static const char scanner_spaces[SCANNER_MAX_WIDTH + 1] = "                                ";
+static const char scanner_newlines[SCANNER_MAX_WIDTH + 1] =
+    "\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n" "\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n";
+static const char scanner_tabs[SCANNER_MAX_WIDTH + 1] =
+    "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t" "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+static const char scanner_num_controls[SCANNER_MAX_WIDTH + 1] =
+    "\4\4\4\4\4\4\4\4\4\4\4\4\4\4\4\4" "\4\4\4\4\4\4\4\4\4\4\4\4\4\4\4\4";
+
+
+/**
+ * Advances over the whitespace and comment characters at the start of a classified block.
+ *
+ * The characters before the first non-whitespace character are skipped at once, and the newlines
+ * among them are counted with a single popcount.
+ *
+ * @param text                 The source text.
+ * @param width                The number of characters in the block (16 or 32).
+ * @param whitespace           Mask of the characters in the block for which isspace is true.
+ * @param newlines             Mask of the newline characters in the block.
+ * @param position[inout]      The offset of the block, advanced past the skipped characters.
+ * @param in_comment[inout]    Whether the block starts inside a comment.
+ * @param num_newlines[inout]  Incremented by the number of newlines skipped.
+ * @param line_start[inout]    Set to the offset after the last newline skipped, if any.
+ *
+ * @return Whether the new position is at a real token.
+ */
+static inline bool scanner_advance_block(const char *text,
+                                         size_t width,
+                                         uint32_t whitespace,
+                                         uint32_t newlines,
+                                         size_t *position,
+                                         bool *in_comment,
+                                         uint32_t *num_newlines,
+                                         size_t *line_start)
+{
+    // Inside a comment only the newline that ends it matters. The block is classified again from
+    // that newline, which is skipped as whitespace.
+    if (*in_comment) {
+        if (newlines == 0) {
+            *position += width;
+        }
+        else {
+            *position += (size_t) __builtin_ctz(newlines);
+            *in_comment = false;
+        }
+        return false;
+    }
+
+    uint32_t full_block = width == 32 ? UINT32_MAX : (UINT32_C(1) << width) - 1;
+    uint32_t other = ~whitespace & full_block;
+    uint32_t skipped = other != 0 ? (UINT32_C(1) << __builtin_ctz(other)) - 1 : full_block;
+
+    newlines &= skipped;
+    if (newlines != 0) {
+        *num_newlines += (uint32_t) __builtin_popcount(newlines);
+        *line_start = *position + (size_t) (32 - __builtin_clz(newlines));
+    }
+
+    if (other == 0) {
+        *position += width;
+        return false;
+    }
+
+    *position += (size_t) __builtin_ctz(other);
+    if (text[*position] != ';') {
+        return true;
+    }
+    *in_comment = true;
+    return false;
+}
+
+
+/**
+ * Finishes skipping the last partial block of the source text with the scalar scanner.
+ *
+ * @param text                 The source text.
+ * @param length               The number of characters in the source text.
+ * @param position             The offset to start skipping at.
+ * @param in_comment           Whether the position is inside a comment.
+ * @param num_newlines[inout]  Incremented by the number of newlines skipped.
+ * @param line_start[inout]    Set to the offset after the last newline skipped, if any.
+ *
+ * @return The offset of the first character that is not whitespace or part of a comment.
+ */
+static size_t scanner_skip_tail(const char *text,
+                                size_t length,
+                                size_t position,
+                                bool in_comment,
+                                uint32_t *num_newlines,
+                                size_t *line_start)
+{
+    if (in_comment) {
+        const char *newline = memchr(text + position, '\n', length - position);
+        position = newline != NULL ? (size_t) (newline - text) : length;
+    }
+    return scanner_skip_scalar(text, length, position, num_newlines, line_start);
+}
+
+
+/**
+ * Skips whitespace and comments 16 characters at a time with SSE2.
+ *
+ * @see scanner_skip_vector
+ */
+static size_t scanner_skip_sse2(const char *text,
+                                size_t length,
+                                size_t position,
+                                uint32_t *num_newlines,
+                                size_t *line_start)
+{
+    const __m128i space = _mm_loadu_si128((const __m128i *) scanner_spaces);
+    const __m128i newline = _mm_loadu_si128((const __m128i *) scanner_newlines);
+    const __m128i tab = _mm_loadu_si128((const __m128i *) scanner_tabs);
+    const __m128i num_controls = _mm_loadu_si128((const __m128i *) scanner_num_controls);
+
+    bool in_comment = false;
+    while (length - position >= 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i *) (text + position));
+        // '\t', '\n', '\v', '\f' and '\r' are the range 9-13. Subtracting 9 maps them to 0-4,
+        // and maps every character below 9 to 247 or more.
+        __m128i offset = _mm_sub_epi8(chars, tab);
+        __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(offset, num_controls), offset);
+        __m128i spaces = _mm_or_si128(_mm_cmpeq_epi8(chars, space), controls);
+        uint32_t whitespace = (uint32_t) _mm_movemask_epi8(spaces);
+        uint32_t newlines = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(chars, newline));
+
+        if (scanner_advance_block(text, 16, whitespace, newlines, &position, &in_comment,
+                                  num_newlines, line_start))
+        {
+            return position;
+        }
+    }
+    return scanner_skip_tail(text, length, position, in_comment, num_newlines, line_start);
+}
+
+
+/**
+ * Skips whitespace and comments 32 characters at a time with AVX2.
+ *
+ * @see scanner_skip_vector
+ */
+__attribute__((target("avx2")))
+static size_t scanner_skip_avx2(const char *text,
+                                size_t length,
+                                size_t position,
+                                uint32_t *num_newlines,
+                                size_t *line_start)
+{
+    const __m256i space = _mm256_loadu_si256((const __m256i *) scanner_spaces);
+    const __m256i newline = _mm256_loadu_si256((const __m256i *) scanner_newlines);
+    const __m256i tab = _mm256_loadu_si256((const __m256i *) scanner_tabs);
+    const __m256i num_controls = _mm256_loadu_si256((const __m256i *) scanner_num_controls);
+
+    bool in_comment = false;
+    while (length - position >= 32) {
+        __m256i chars = _mm256_loadu_si256((const __m256i *) (text + position));
+        __m256i offset = _mm256_sub_epi8(chars, tab);
+        __m256i controls = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, num_controls), offset);
+        __m256i spaces = _mm256_or_si256(_mm256_cmpeq_epi8(chars, space), controls);
+        uint32_t whitespace = (uint32_t) _mm256_movemask_epi8(spaces);
+        uint32_t newlines = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, newline));
+
+        if (scanner_advance_block(text, 32, whitespace, newlines, &position, &in_comment,
+                                  num_newlines, line_start))
+        {
+            return position;
+        }
+    }
+    return scanner_skip_tail(text, length, position, in_comment, num_newlines, line_start);
+}
+
+
+#endif  // SCANNER_X86
+
+
+size_t scanner_skip_vector(const char *text,
+                           size_t length,
+                           size_t position,
+                           uint32_t *num_newlines,
+                           size_t *line_start)
+{
+    // Most gaps between tokens are a single space, which is cheaper to skip directly than to
+    // classify a whole block.
+    if (position < length && text[position] == ' ') {
+        position++;
+    }
+    if (position < length && text[position] != ';' && !isspace((unsigned char) text[position])) {
+        return position;
+    }
+
+#ifdef SCANNER_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return scanner_skip_avx2(text, length, position, num_newlines, line_start);
+    }
+    return scanner_skip_sse2(text, length, position, num_newlines, line_start);
+#else
+    return scanner_skip_scalar(text, length, position, num_newlines, line_start);
+#endif
+}
@@ -0,0 +1,575 @@
+#define _DEFAULT_SOURCE
+#include "assembler/encoder.h"
+#include "assembler/object.h"
+#include "architecture/logger.h"
+#include "structures/arena.h"
+#include "structures/hash_map.h"
+#include "structures/vector.h"
+#include <ctype.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * An object being linked.
+ */
+struct linker_input {
+    /** The path of the object file. */
+    const char *path;
+    /** The contents of the object file. */
+    struct object object;
+    /** The address each section is placed at, indexed like the sections (uint32_t elements). */
+    struct vector *addresses;
+    /** Whether the relocatable sections of the object have been placed. */
+    bool placed;
+};
+
+
+/**
+ * A range of addresses taken by a placed section.
+ */
+struct linker_range {
+    /** The first address of the range. */
+    uint32_t address;
+    /** The number of bytes in the range. */
+    uint32_t size;
+    /** The bytes of the section. */
+    const uint8_t *data;
+    /** The path of the object the section belongs to. */
+    const char *path;
+};
+
+
+/**
+ * The definition of a symbol, by name, across all objects.
+ */
+struct linker_symbol {
+    /** The address of the symbol. */
+    uint32_t address;
+    /** The path of the object that declares the symbol. */
+    const char *path;
+};
+
+
+void usage(const char *error) {
+    if (error != NULL) {
+        log_error("%s", error);
+    }
+
+    printf("usage: linker [-o path] [-T script] [-v] object...\n");
+    printf("\n");
+    printf("options:\n");
+    printf("  -o path    specify the output path for the linked binary (default a.out)\n");
+    printf("  -T script  layout script that places objects (by default, objects are placed in\n");
+    printf("             order in the first gap after the previous object that fits them)\n");
+    printf("  -v         verbosity level for log messages, can be specified multiple times\n");
+    printf("\n");
+    printf("argument:\n");
+    printf("  object     the paths to the objects written by assembler -c\n");
+    exit(error != NULL);
+}
+
+
+/**
+ * Reads an object to link.
+ *
+ * @param path        The path of the object file.
+ * @param arena       The arena to allocate the object from.
+ * @param input[out]  A pointer to return the object.
+ *
+ * @return Whether the object was read.
+ */
+static bool linker_read_input(const char *path, struct arena *arena, struct linker_input *input) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        log_error("Linker cannot open object '%s'", path);
+        return false;
+    }
+    enum object_status status = object_read(file, arena, &input->object);
+    fclose(file);
+    if (status != OBJECT_STATUS_SUCCESS) {
+        log_error("Linker cannot read object '%s' (errno %d)", path, status);
+        return false;
+    }
+
+    input->path = path;
+    input->placed = false;
+    input->addresses = create_vector_in_arena(arena, sizeof(uint32_t));
+    struct vector_iterator iterator = vector_iterate(input->object.sections);
+    struct object_section *section;
+    while ((section = vector_iterator_next(&iterator)) != NULL) {
+        vector_add(input->addresses, &section->address);
+    }
+    return true;
+}
+
+
+/**
+ * Finds the lowest address at or after a starting address where a section fits between the ranges
+ * already taken.
+ *
+ * @param ranges   The ranges taken by placed sections (struct linker_range elements).
+ * @param address  The lowest address to consider.
+ * @param size     The number of bytes in the section.
+ *
+ * @return The address to place the section at.
+ */
+static uint32_t linker_first_fit(const struct vector *ranges, uint32_t address, uint32_t size) {
+    bool moved = true;
+    while (moved) {
+        moved = false;
+        struct vector_iterator iterator = vector_iterate(ranges);
+        struct linker_range *range;
+        while ((range = vector_iterator_next(&iterator)) != NULL) {
+            if (address < range->address + range->size && range->address < address + size) {
+                address = range->address + range->size;
+                moved = true;
+            }
+        }
+    }
+    return address;
+}
+
+
+/**
+ * Places the relocatable sections of an object one after another.
+ *
+ * @param input           The object to place.
+ * @param ranges          The ranges taken by placed sections, which the object's sections are added
+ *                        to.
+ * @param address[inout]  The address to place the object at, advanced past its sections.
+ * @param fit             Whether each section is moved to the first gap that fits it, rather than
+ *                        placed at the address even if it overlaps another section.
+ *
+ * @return Whether every section fits below the largest address.
+ */
+static bool linker_place_input(struct linker_input *input,
+                               struct vector *ranges,
+                               uint32_t *address,
+                               bool fit)
+{
+    for (uint32_t i = 0; i < input->object.sections->size; i++) {
+        const struct object_section *section = vector_at(input->object.sections, i);
+        if (section->absolute) {
+            continue;
+        }
+
+        uint32_t section_address = *address;
+        if (fit) {
+            section_address = linker_first_fit(ranges, *address, section->size);
+        }
+        if (section_address > UINT32_MAX - section->size) {
+            log_error("Section %" PRIu32 " of '%s' does not fit at 0x%" PRIx32,
+                      i, input->path, section_address);
+            return false;
+        }
+        *(uint32_t *) vector_at(input->addresses, i) = section_address;
+        if (section->size > 0) {
+            struct linker_range range = {
+                .address = section_address,
+                .size = section->size,
+                .data = section->data,
+                .path = input->path
+            };
+            vector_add(ranges, &range);
+            *address = section_address + section->size;
+        }
+        log_debug("Linker placed '%s' section %" PRIu32 " at 0x%04" PRIx32,
+                  input->path, i, section_address);
+    }
+    input->placed = true;
+    return true;
+}
+
+
+/**
+ * Parses a number written in decimal or (with a 0x prefix) hexadecimal.
+ *
+ * @param text         The text of the number.
+ * @param number[out]  A pointer to return the number.
+ *
+ * @return Whether the whole text is a number.
+ */
+static bool linker_parse_number(const char *text, uint32_t *number) {
+    int base = 10;
+    if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        base = 16;
+        text += 2;
+    }
+
+    char *end;
+    unsigned long value = strtoul(text, &end, base);
+    if (*text == '\0' || *end != '\0' || value > UINT32_MAX) {
+        return false;
+    }
+    *number = (uint32_t) value;
+    return true;
+}
+
+
+/**
+ * Places objects as directed by a layout script.
+ *
+ * Each line of the script is either ".org address", which moves the location counter to the
+ * address, or the path of an object (as given on the command line), whose relocatable sections are
+ * placed at the location counter. Text after a semicolon is a comment.
+ *
+ * @param script_path     The path of the layout script.
+ * @param inputs          The objects being linked.
+ * @param num_inputs      The number of objects.
+ * @param ranges          The ranges taken by placed sections.
+ * @param address[inout]  The location counter, left after the last placed object.
+ *
+ * @return Whether the script was valid.
+ */
+static bool linker_run_script(const char *script_path,
+                              struct linker_input *inputs,
+                              uint32_t num_inputs,
+                              struct vector *ranges,
+                              uint32_t *address)
+{
+    FILE *script = fopen(script_path, "r");
+    if (script == NULL) {
+        log_error("Linker cannot open layout script '%s'", script_path);
+        return false;
+    }
+
+    bool success = true;
+    char *line = NULL;
+    size_t line_capacity = 0;
+    uint32_t line_number = 0;
+    while (success && getline(&line, &line_capacity, script) != -1) {
+        line_number++;
+        char *comment = strchr(line, ';');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+
+        char *start = line;
+        while (isspace((unsigned char) *start)) {
+            start++;
+        }
+        char *end = start + strlen(start);
+        while (end > start && isspace((unsigned char) end[-1])) {
+            *--end = '\0';
+        }
+        if (*start == '\0') {
+            continue;
+        }
+
+        if (strncmp(start, ".org", 4) == 0 && isspace((unsigned char) start[4])) {
+            char *operand = start + 5;
+            while (isspace((unsigned char) *operand)) {
+                operand++;
+            }
+            if (!linker_parse_number(operand, address)) {
+                log_error("%s (%" PRIu32 "): Invalid .org address '%s'",
+                          script_path, line_number, operand);
+                success = false;
+            }
+            continue;
+        }
+
+        struct linker_input *input = NULL;
+        for (uint32_t i = 0; i < num_inputs && input == NULL; i++) {
+            if (strcmp(inputs[i].path, start) == 0) {
+                input = &inputs[i];
+            }
+        }
+        if (input == NULL || input->placed) {
+            log_error("%s (%" PRIu32 "): '%s' is not an unplaced object being linked",
+                      script_path, line_number, start);
+            success = false;
+            continue;
+        }
+        success = linker_place_input(input, ranges, address, false);
+    }
+
+    free(line);
+    fclose(script);
+    return success;
+}
+
+
+/**
+ * Compares two ranges by address, for qsort.
+ *
+ * @param a  The first range.
+ * @param b  The second range.
+ *
+ * @return Negative, zero, or positive if the first range starts before, with, or after the second.
+ */
+static int linker_compare_ranges(const void *a, const void *b) {
+    uint32_t address_a = ((const struct linker_range *) a)->address;
+    uint32_t address_b = ((const struct linker_range *) b)->address;
+    return (address_a > address_b) - (address_a < address_b);
+}
+
+
+/**
+ * Sorts the ranges taken by placed sections and checks that no two overlap.
+ *
+ * @param ranges  The ranges taken by placed sections.
+ *
+ * @return Whether no two ranges overlap.
+ */
+static bool linker_check_overlaps(struct vector *ranges) {
+    qsort(ranges->data, ranges->size, sizeof(struct linker_range), &linker_compare_ranges);
+
+    bool success = true;
+    for (uint32_t i = 1; i < ranges->size; i++) {
+        const struct linker_range *previous = vector_at(ranges, i - 1);
+        const struct linker_range *range = vector_at(ranges, i);
+        if (previous->address + previous->size > range->address) {
+            log_error("Section of '%s' at 0x%04" PRIx32 " overlaps section of '%s' at 0x%04" PRIx32,
+                      range->path, range->address, previous->path, previous->address);
+            success = false;
+        }
+    }
+    return success;
+}
+
+
+/**
+ * Records the address of every symbol declared by the objects.
+ *
+ * @param inputs      The placed objects.
+ * @param num_inputs  The number of objects.
+ * @param arena       The arena to allocate the symbol definitions from.
+ * @param symbols     The map to add the symbols to (struct linker_symbol * values).
+ *
+ * @return Whether every symbol is declared by only one object.
+ */
+static bool linker_define_symbols(const struct linker_input *inputs,
+                                  uint32_t num_inputs,
+                                  struct arena *arena,
+                                  struct hash_map *symbols)
+{
+    bool success = true;
+    for (uint32_t i = 0; i < num_inputs; i++) {
+        struct vector_iterator iterator = vector_iterate(inputs[i].object.symbols);
+        struct object_symbol *symbol;
+        while ((symbol = vector_iterator_next(&iterator)) != NULL) {
+            if (symbol->section == OBJECT_NO_SECTION) {
+                continue;
+            }
+
+            struct linker_symbol *definition =
+                (struct linker_symbol *) arena_allocate(arena, sizeof(struct linker_symbol));
+            if (definition == NULL) {
+                return false;
+            }
+            *definition = (struct linker_symbol) {
+                .address = *(uint32_t *) vector_at(inputs[i].addresses, symbol->section) +
+                    symbol->offset,
+                .path = inputs[i].path
+            };
+
+            struct linker_symbol *existing;
+            if (hash_map_get(symbols, symbol->name, (void **) &existing) ==
+                HASH_MAP_STATUS_SUCCESS)
+            {
+                log_error("Label '%s' is declared in both '%s' and '%s'",
+                          symbol->name, existing->path, inputs[i].path);
+                success = false;
+            }
+            else if (hash_map_insert(symbols, symbol->name, definition) !=
+                     HASH_MAP_STATUS_SUCCESS)
+            {
+                return false;
+            }
+        }
+    }
+    return success;
+}
+
+
+/**
+ * Patches every relocation of the objects with the address of its symbol.
+ *
+ * @param inputs      The placed objects.
+ * @param num_inputs  The number of objects.
+ * @param symbols     The addresses of the symbols.
+ *
+ * @return Whether every referenced symbol is declared.
+ */
+static bool linker_relocate(const struct linker_input *inputs,
+                            uint32_t num_inputs,
+                            const struct hash_map *symbols)
+{
+    bool success = true;
+    for (uint32_t i = 0; i < num_inputs; i++) {
+        struct vector_iterator iterator = vector_iterate(inputs[i].object.relocations);
+        struct object_relocation *relocation;
+        while ((relocation = vector_iterator_next(&iterator)) != NULL) {
+            const struct object_symbol *symbol =
+                vector_at(inputs[i].object.symbols, relocation->symbol);
+            struct linker_symbol *definition;
+            if (hash_map_get(symbols, symbol->name, (void **) &definition) !=
+                HASH_MAP_STATUS_SUCCESS)
+            {
+                log_error("Use of undeclared label '%s' in '%s'", symbol->name, inputs[i].path);
+                success = false;
+                continue;
+            }
+
+            const struct object_section *section =
+                vector_at(inputs[i].object.sections, relocation->section);
+            object_patch(section->data + relocation->offset, relocation->type,
+                         definition->address);
+        }
+    }
+    return success;
+}
+
+
+/**
+ * Builds the image of the linked sections.
+ *
+ * @param inputs      The placed objects.
+ * @param num_inputs  The number of objects.
+ * @param ranges      The ranges taken by placed sections, sorted by address.
+ * @param image[out]  A pointer to return the image, whose vectors are allocated on the heap.
+ */
+static void linker_build_image(const struct linker_input *inputs,
+                               uint32_t num_inputs,
+                               const struct vector *ranges,
+                               struct encoder_image *image)
+{
+    image->data = create_vector(sizeof(uint8_t));
+    image->segments = create_vector(sizeof(struct encoder_segment));
+    image->position = 0;
+    image->size = 0;
+
+    struct vector_iterator iterator = vector_iterate(ranges);
+    struct linker_range *range;
+    while ((range = vector_iterator_next(&iterator)) != NULL) {
+        struct encoder_segment segment = {
+            .address = range->address,
+            .offset = image->data->size,
+            .length = range->size
+        };
+        vector_add(image->segments, &segment);
+        vector_insert_at(image->data, image->data->size, range->data, range->size);
+    }
+
+    // As with an image from the assembler, the image extends to the end of the last section,
+    // including empty sections that a trailing .org directive started.
+    for (uint32_t i = 0; i < num_inputs; i++) {
+        for (uint32_t j = 0; j < inputs[i].object.sections->size; j++) {
+            const struct object_section *section = vector_at(inputs[i].object.sections, j);
+            uint32_t address = *(uint32_t *) vector_at(inputs[i].addresses, j);
+            if ((section->absolute || section->size > 0) && address + section->size > image->size) {
+                image->size = address + section->size;
+            }
+        }
+    }
+    image->position = image->size;
+}
+
+
+int main(int argc, char *argv[]) {
+    char *output_path = "./a.out";
+    char *script_path = NULL;
+    enum logger_log_level verbosity = LOGGER_LEVEL_WARN;
+
+    int flag;
+    while ((flag = getopt(argc, argv, "o:T:v")) != -1) {
+        switch (flag) {
+        case 'o':
+            output_path = optarg;
+            break;
+        case 'T':
+            script_path = optarg;
+            break;
+        case 'v':
+            verbosity++;
+            break;
+        default:
+            usage("unknown option flag");
+            break;
+        }
+    }
+
+    logger_set_level(verbosity);
+
+    if (optind >= argc) {
+        usage("missing required 'object' argument");
+    }
+    uint32_t num_inputs = argc - optind;
+
+    struct arena *arena = create_arena(0);
+    struct linker_input *inputs =
+        (struct linker_input *) arena_allocate(arena, num_inputs * sizeof(struct linker_input));
+    for (uint32_t i = 0; i < num_inputs; i++) {
+        if (!linker_read_input(argv[optind + i], arena, &inputs[i])) {
+            log_fatal("Linker failed to read objects, will not proceed with linking");
+        }
+    }
+
+    // Absolute sections are placed first, so that relocatable sections are placed around them.
+    struct vector *ranges = create_vector(sizeof(struct linker_range));
+    for (uint32_t i = 0; i < num_inputs; i++) {
+        struct vector_iterator iterator = vector_iterate(inputs[i].object.sections);
+        struct object_section *section;
+        while ((section = vector_iterator_next(&iterator)) != NULL) {
+            if (section->absolute && section->size > 0) {
+                struct linker_range range = {
+                    .address = section->address,
+                    .size = section->size,
+                    .data = section->data,
+                    .path = inputs[i].path
+                };
+                vector_add(ranges, &range);
+            }
+        }
+    }
+
+    uint32_t address = 0;
+    if (script_path != NULL &&
+        !linker_run_script(script_path, inputs, num_inputs, ranges, &address))
+    {
+        log_fatal("Linker failed to run layout script, will not proceed with linking");
+    }
+    for (uint32_t i = 0; i < num_inputs; i++) {
+        if (!inputs[i].placed && !linker_place_input(&inputs[i], ranges, &address, true)) {
+            log_fatal("Linker failed to place sections, will not proceed with linking");
+        }
+    }
+    if (!linker_check_overlaps(ranges)) {
+        log_fatal("Linker failed to place sections, will not proceed with linking");
+    }
+
+    struct hash_map *symbols = create_hash_map(0);
+    if (!linker_define_symbols(inputs, num_inputs, arena, symbols) ||
+        !linker_relocate(inputs, num_inputs, symbols))
+    {
+        log_fatal("Linker failed to resolve labels, will not proceed with output file writing");
+    }
+
+    struct encoder_image image;
+    linker_build_image(inputs, num_inputs, ranges, &image);
+    log_info("Linker finished successfully (objects: %" PRIu32 ", sections: %" PRIu32
+             ", image size: %" PRIu32 ")", num_inputs, ranges->size, image.size);
+
+    FILE *out_file = fopen(output_path, "wb");
+    if (out_file == NULL) {
+        log_fatal("Cannot open output file '%s'", output_path);
+    }
+    if (!encoder_write_image(&image, out_file)) {
+        log_fatal("Cannot write to output file '%s'", output_path);
+    }
+
+    fclose(out_file);
+    destroy_vector(image.data);
+    destroy_vector(image.segments);
+    destroy_hash_map(symbols);
+    destroy_vector(ranges);
+    destroy_arena(arena);
+    return 0;
+}
@@ -7,7 +7,9 @@
 #include <string.h>
 
 
+static void cli_process_break(struct processor *processor, int argc, char **argv);
 static void cli_process_continue(struct processor *processor, int argc, char **argv);
+static void cli_process_engine(struct processor *processor, int argc, char **argv);
 static void cli_process_finish(struct processor *processor, int argc, char **argv);
 static void cli_process_help(struct processor *processor, int argc, char **argv);
 static void cli_process_load(struct processor *processor, int argc, char **argv);
@@ -20,8 +22,11 @@ static void cli_process_verbose(struct processor *processor, int argc, char **ar
 
 
 static const struct cli_command_descriptor cli_command_table[] = {
+    {"break", cli_process_break, "[address ...]", "toggle breakpoints at addresses or list them"},
     {"continue", cli_process_continue, NULL,
-     "continue until reset is asserted or an error occurs"},
+     "continue until reset is asserted, a breakpoint is reached, or an error occurs"},
+    {"engine", cli_process_engine, "[switch|threaded|block|jit|jit-checked]",
+     "set or view the execution engine"},
     {"finish", cli_process_finish, NULL,
      "continue until a return (jlr0 r0, r0, ra) instruction is executed"},
     {"help", cli_process_help, NULL, "print command help information"},
@@ -35,32 +40,65 @@ static const struct cli_command_descriptor cli_command_table[] = {
 };
 
 
-static void cli_process_continue(struct processor *processor, int argc, char **argv) {
-    (void) argv;
-
-    if (argc != 0) {
-        log_error("Unexpected arguments");
+static void cli_process_break(struct processor *processor, int argc, char **argv) {
+    if (argc == 0) {
+        for (uint32_t address = 0; address <= UINT16_MAX; address++) {
+            if (processor_has_breakpoint(processor, address)) {
+                printf("Breakpoint at 0x%04" PRIx16 "\n", (uint16_t) address);
+            }
+        }
         return;
     }
 
+    for (uint32_t i = 0; i < (uint32_t) argc; i++) {
+        uint16_t address = strtoul(argv[i], NULL, 0);
+        bool enabled = !processor_has_breakpoint(processor, address);
+        processor_set_breakpoint(processor, address, enabled);
+        printf("Breakpoint %s at 0x%04" PRIx16 "\n", enabled ? "set" : "cleared", address);
+    }
+}
+
+
+/**
+ * Runs the processor until a stop condition in the mask (or a halt or error) is reached, and
+ * reports why execution stopped.
+ *
+ * @param processor  The processor to run.
+ * @param stop_mask  The optional stop conditions to pass to processor_run.
+ */
+static void cli_run_until(struct processor *processor, uint32_t stop_mask) {
     if (processor->registers->reset == 0x001) {
         log_warn("Reset is asserted, not ticking clock");
         return;
     }
 
     uint32_t cycles = 0;
-    while (processor->registers->reset == 0x0000) {
-        enum processor_status tick_status = processor_tick(processor, NULL);
-        if (tick_status != PROCESSOR_STATUS_SUCCESS) {
-            log_warn("Execution stopped after %" PRIu32 " cycles (errno %d)", cycles, tick_status);
-            return;
-        }
-        cycles++;
+    struct processor_run_result result;
+    enum processor_status run_status;
+    do {
+        run_status = processor_run(processor, UINT32_MAX, stop_mask, &result);
+        cycles += result.cycles;
+    } while (result.reason == PROCESSOR_STOP_BUDGET);
+
+    switch (result.reason) {
+    case PROCESSOR_STOP_RETURN:
+        log_debug("Executed ret instruction after %" PRIu32 " cycles", cycles);
+        log_debug("Returned to 0x%04" PRIx16 " with value 0x%04" PRIx16,
+                  registers_read(processor->registers, RA),
+                  registers_read(processor->registers, A0));
+        break;
+    case PROCESSOR_STOP_BREAKPOINT:
+        printf("Breakpoint reached after %" PRIu32 " cycles. Execution paused at 0x%04" PRIx16 "\n",
+               cycles, processor->registers->pc);
+        break;
+    default:
+        log_warn("Execution stopped after %" PRIu32 " cycles (errno %d)", cycles, run_status);
+        break;
     }
 }
 
 
-static void cli_process_finish(struct processor *processor, int argc, char **argv) {
+static void cli_process_continue(struct processor *processor, int argc, char **argv) {
     (void) argv;
 
     if (argc != 0) {
@@ -68,33 +106,49 @@ static void cli_process_finish(struct processor *processor, int argc, char **arg
         return;
     }
 
-    if (processor->registers->reset == 0x001) {
-        log_warn("Reset is asserted, not ticking clock");
+    cli_run_until(processor, PROCESSOR_STOP_BREAKPOINT);
+}
+
+
+static void cli_process_engine(struct processor *processor, int argc, char **argv) {
+    static const char *engine_names[] = {
+        [PROCESSOR_ENGINE_SWITCH] = "switch",
+        [PROCESSOR_ENGINE_THREADED] = "threaded",
+        [PROCESSOR_ENGINE_BLOCK] = "block",
+        [PROCESSOR_ENGINE_JIT] = "jit",
+        [PROCESSOR_ENGINE_JIT_CHECKED] = "jit-checked"
+    };
+    size_t num_engines = sizeof(engine_names) / sizeof(engine_names[0]);
+
+    switch (argc) {
+    case 0:
+        printf("Current execution engine is: %s\n", engine_names[processor->engine]);
+        break;
+    case 1:
+        for (size_t i = 0; i < num_engines; i++) {
+            if (strcmp(argv[0], engine_names[i]) == 0) {
+                processor->engine = (enum processor_engine) i;
+                return;
+            }
+        }
+        log_error("Unknown execution engine %s", argv[0]);
+        break;
+    default:
+        log_error("Unexpected arguments");
         return;
     }
+}
 
-    uint32_t cycles = 0;
-    while (processor->registers->reset == 0x0000) {
-        union isa_instruction executed;
-        enum processor_status tick_status = processor_tick(processor, &executed);
-        if (tick_status != PROCESSOR_STATUS_SUCCESS) {
-            log_warn("Execution stopped after %" PRIu32 " cycles (errno %d)", cycles, tick_status);
-            return;
-        }
-        if (executed.dss_type.format == ISA_OPCODE_FORMAT_DSS &&
-            executed.dss_type.funct == (JLR0 >> ISA_INSTRUCTION_FORMAT_SIZE) &&
-            executed.dss_type.dest == ZERO &&
-            executed.dss_type.source1 == ZERO &&
-            executed.dss_type.source2 == RA)
-        {
-            log_debug("Executed ret instruction after %" PRIu32 " cycles", cycles);
-            log_debug("Returned to 0x%04" PRIx16 " with value 0x%04" PRIx16,
-                      registers_read(processor->registers, RA),
-                      registers_read(processor->registers, A0));
-            return;
-        }
-        cycles++;
+
+static void cli_process_finish(struct processor *processor, int argc, char **argv) {
+    (void) argv;
+
+    if (argc != 0) {
+        log_error("Unexpected arguments");
+        return;
     }
+
+    cli_run_until(processor, PROCESSOR_STOP_RETURN | PROCESSOR_STOP_BREAKPOINT);
 }
 
 
@@ -289,12 +343,12 @@ static void cli_process_tick(struct processor *processor, int argc, char **argv)
         return;
     }
 
-    for (uint32_t i = 0; i < num_cycles; i++) {
-        enum processor_status tick_status = processor_tick(processor, NULL);
-        if (tick_status != PROCESSOR_STATUS_SUCCESS) {
-            log_warn("Execution stopped before requested number of cycles (errno %d)", tick_status);
-            return;
-        }
+    struct processor_run_result result;
+    enum processor_status run_status =
+        processor_run(processor, num_cycles, PROCESSOR_STOP_NONE, &result);
+    if (result.reason != PROCESSOR_STOP_BUDGET) {
+        log_warn("Execution stopped before requested number of cycles (errno %d)", run_status);
+        return;
     }
 }
 
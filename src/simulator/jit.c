@@ -0,0 +1,484 @@
+#define _DEFAULT_SOURCE
+
+#include "simulator/jit.h"
+#include "simulator/processor.h"
+#include "simulator/translator.h"
+#include "architecture/isa.h"
+#include "architecture/logger.h"
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+
+#if defined(__x86_64__) && defined(__unix__)
+#define JIT_SUPPORTED
+#endif
+
+
+/**
+ * A cursor for writing machine code into the arena.
+ */
+struct jit_emitter {
+    /** The start of the code being emitted. */
+    uint8_t *code;
+    /** The number of bytes emitted so far. */
+    size_t length;
+};
+
+
+/** Appends the listed bytes to the code in emitter `e`. */
+#define JIT_EMIT(e, ...)                                        \
+    jit_emit((e), (const uint8_t[]) {__VA_ARGS__},              \
+             sizeof((const uint8_t[]) {__VA_ARGS__}))
+
+
+/** x86-64 register numbers used by the emitter. */
+enum jit_register {
+    JIT_EAX = 0,
+    JIT_ECX = 1,
+    JIT_EDX = 2
+};
+
+
+static void jit_emit(struct jit_emitter *e, const uint8_t *bytes, size_t size) {
+    memcpy(e->code + e->length, bytes, size);
+    e->length += size;
+}
+
+
+static void jit_emit_u16(struct jit_emitter *e, uint16_t value) {
+    JIT_EMIT(e, value & UINT8_MAX, value >> CHAR_BIT);
+}
+
+
+static void jit_emit_u32(struct jit_emitter *e, uint32_t value) {
+    for (uint32_t b = 0; b < sizeof(uint32_t); b++) {
+        JIT_EMIT(e, (value >> (b * CHAR_BIT)) & UINT8_MAX);
+    }
+}
+
+
+static void jit_emit_u64(struct jit_emitter *e, uint64_t value) {
+    for (uint32_t b = 0; b < sizeof(uint64_t); b++) {
+        JIT_EMIT(e, (value >> (b * CHAR_BIT)) & UINT8_MAX);
+    }
+}
+
+
+static uint8_t jit_gp_offset(uint8_t index) {
+    return offsetof(struct register_file, gp) + index * sizeof(uint16_t);
+}
+
+
+// All register file accesses below are [rbx + disp8], since rbx holds the register file pointer.
+
+static void jit_emit_load(struct jit_emitter *e, enum jit_register reg, uint8_t index) {
+    JIT_EMIT(e, 0x0F, 0xB7, 0x43 | (reg << 3), jit_gp_offset(index));  // movzx reg, word [rbx+d]
+}
+
+
+static void jit_emit_load_signed(struct jit_emitter *e, enum jit_register reg, uint8_t index) {
+    JIT_EMIT(e, 0x0F, 0xBF, 0x43 | (reg << 3), jit_gp_offset(index));  // movsx reg, word [rbx+d]
+}
+
+
+static void jit_emit_store(struct jit_emitter *e, enum jit_register reg, uint8_t index) {
+    JIT_EMIT(e, 0x66, 0x89, 0x43 | (reg << 3), jit_gp_offset(index));  // mov word [rbx+d], reg
+}
+
+
+static void jit_emit_store_immediate(struct jit_emitter *e, uint8_t offset, uint16_t value) {
+    JIT_EMIT(e, 0x66, 0xC7, 0x43, offset);  // mov word [rbx+d], imm16
+    jit_emit_u16(e, value);
+}
+
+
+static void jit_emit_set_pc(struct jit_emitter *e, uint16_t pc) {
+    jit_emit_store_immediate(e, offsetof(struct register_file, pc), pc);
+}
+
+
+static void jit_emit_prologue(struct jit_emitter *e) {
+    JIT_EMIT(e, 0x53);              // push rbx
+    JIT_EMIT(e, 0x41, 0x54);        // push r12
+    JIT_EMIT(e, 0x41, 0x55);        // push r13
+    JIT_EMIT(e, 0x48, 0x89, 0xFB);  // mov rbx, rdi (registers)
+    JIT_EMIT(e, 0x49, 0x89, 0xF4);  // mov r12, rsi (memory)
+    JIT_EMIT(e, 0x49, 0x89, 0xD5);  // mov r13, rdx (processor)
+}
+
+
+static void jit_emit_exit(struct jit_emitter *e, uint16_t executed, enum translator_exit exit) {
+    if (executed > 0) {
+        JIT_EMIT(e, 0x66, 0x81, 0x43, offsetof(struct register_file, ccount));  // add word [rbx+d]
+        jit_emit_u16(e, executed);
+    }
+    JIT_EMIT(e, 0xB8);  // mov eax, imm32
+    jit_emit_u32(e, ((uint32_t) exit << 16) | executed);
+    JIT_EMIT(e, 0x41, 0x5D);  // pop r13
+    JIT_EMIT(e, 0x41, 0x5C);  // pop r12
+    JIT_EMIT(e, 0x5B);        // pop rbx
+    JIT_EMIT(e, 0xC3);        // ret
+}
+
+
+/**
+ * Stores a halfword on behalf of compiled code and invalidates any decoded or translated code it
+ * overwrites.
+ *
+ * @param processor  The processor to store to.
+ * @param address    The address to store to.
+ * @param value      The halfword to store.
+ *
+ * @return Non-zero if the store invalidated any translated block.
+ */
+static uint32_t jit_store_halfword(struct processor *processor, uint32_t address, uint32_t value) {
+    struct memory *memory = processor->memory;
+    uint32_t epoch = processor->translator->epoch;
+    memory->m[address + 1] = value >> CHAR_BIT;
+    memory->m[address] = value & ((1U << CHAR_BIT) - 1U);
+    processor_invalidate_range(processor, address, sizeof(uint16_t));
+    return processor->translator->epoch != epoch;
+}
+
+
+static void jit_emit_jump(struct jit_emitter *e,
+                          const struct translator_block *block,
+                          uint16_t i)
+{
+    const struct translator_uop *uop = &block->uops[i];
+    uint16_t uop_pc = block->start + i * sizeof(uint32_t);
+    uint16_t fall_through = uop_pc + sizeof(uint32_t);
+    bool is_register_jump = uop->type == JLR0 || uop->type == JLR1;
+    uint8_t condition = (uop->type == JL0 || uop->type == JLR0) ? 0x00 : 0x01;
+
+    jit_emit_load(e, JIT_EAX, uop->source1);
+    JIT_EMIT(e, 0x83, 0xF8, condition);  // cmp eax, imm8
+    JIT_EMIT(e, 0x75, 0x00);             // jne not_taken (patched below)
+    size_t not_taken_patch = e->length - 1;
+
+    if (uop->dest != ZERO) {
+        jit_emit_store_immediate(e, jit_gp_offset(uop->dest), fall_through);
+    }
+    if (is_register_jump) {
+        // The target is read after Dest is written, matching processor_tick when Dest == Source2.
+        jit_emit_load(e, JIT_ECX, uop->source2);
+        JIT_EMIT(e, 0x81, 0xF9);  // cmp ecx, imm32
+        jit_emit_u32(e, uop_pc);
+        JIT_EMIT(e, 0x75, 0x05);  // jne +5
+        JIT_EMIT(e, 0xB9);        // mov ecx, imm32
+        jit_emit_u32(e, fall_through);
+        JIT_EMIT(e, 0x66, 0x89, 0x4B, offsetof(struct register_file, pc));  // mov word [rbx+d], cx
+    }
+    else {
+        jit_emit_set_pc(e, uop->immediate == uop_pc ? fall_through : uop->immediate);
+    }
+    jit_emit_exit(e, i + 1, TRANSLATOR_EXIT_TAKEN);
+
+    e->code[not_taken_patch] = e->length - (not_taken_patch + 1);
+    jit_emit_set_pc(e, fall_through);
+    jit_emit_exit(e, i + 1, TRANSLATOR_EXIT_FALL_THROUGH);
+}
+
+
+static void jit_emit_uop(struct jit_emitter *e, const struct translator_block *block, uint16_t i) {
+    const struct translator_uop *uop = &block->uops[i];
+    uint16_t uop_pc = block->start + i * sizeof(uint32_t);
+
+    switch (uop->type) {
+    case TRANSLATOR_UOP_NOP:
+        break;
+    case ADDI:
+    case SUBI:
+    case ANDI:
+    case ORI:
+    case XORI: {
+        static const uint8_t alu_immediate[] = {
+            [ADDI] = 0x05, [SUBI] = 0x2D, [ANDI] = 0x25, [ORI] = 0x0D, [XORI] = 0x35
+        };
+        jit_emit_load(e, JIT_EAX, uop->source1);
+        JIT_EMIT(e, alu_immediate[uop->type]);  // <op> eax, imm32
+        jit_emit_u32(e, uop->immediate);
+        jit_emit_store(e, JIT_EAX, uop->dest);
+        break;
+    }
+    case SLLI:
+    case SRLI:
+    case SRAI: {
+        // Shift counts are masked to 5 bits by the hardware, as they are for the interpreters.
+        if (uop->type == SRAI) {
+            jit_emit_load_signed(e, JIT_EAX, uop->source1);
+        }
+        else {
+            jit_emit_load(e, JIT_EAX, uop->source1);
+        }
+        uint8_t shift = uop->type == SLLI ? 0xE0 : (uop->type == SRLI ? 0xE8 : 0xF8);
+        JIT_EMIT(e, 0xC1, shift, uop->immediate & 0x1F);  // shl/shr/sar eax, imm8
+        jit_emit_store(e, JIT_EAX, uop->dest);
+        break;
+    }
+    case ADD:
+    case SUB:
+    case AND:
+    case OR:
+    case XOR: {
+        static const uint8_t alu_register[] = {
+            [ADD] = 0x01, [SUB] = 0x29, [AND] = 0x21, [OR] = 0x09, [XOR] = 0x31
+        };
+        jit_emit_load(e, JIT_EAX, uop->source1);
+        jit_emit_load(e, JIT_ECX, uop->source2);
+        JIT_EMIT(e, alu_register[uop->type], 0xC8);  // <op> eax, ecx
+        jit_emit_store(e, JIT_EAX, uop->dest);
+        break;
+    }
+    case SLL:
+    case SRL:
+    case SRA: {
+        if (uop->type == SRA) {
+            jit_emit_load_signed(e, JIT_EAX, uop->source1);
+        }
+        else {
+            jit_emit_load(e, JIT_EAX, uop->source1);
+        }
+        jit_emit_load(e, JIT_ECX, uop->source2);
+        uint8_t shift = uop->type == SLL ? 0xE0 : (uop->type == SRL ? 0xE8 : 0xF8);
+        JIT_EMIT(e, 0xD3, shift);  // shl/shr/sar eax, cl
+        jit_emit_store(e, JIT_EAX, uop->dest);
+        break;
+    }
+    case EQ:
+    case GT:
+    case LT:
+    case NE: {
+        static const uint8_t set_condition[] = {
+            [EQ] = 0x94, [GT] = 0x97, [LT] = 0x92, [NE] = 0x95
+        };
+        jit_emit_load(e, JIT_EAX, uop->source1);
+        jit_emit_load(e, JIT_ECX, uop->source2);
+        JIT_EMIT(e, 0x39, 0xC8);                            // cmp eax, ecx
+        JIT_EMIT(e, 0x0F, set_condition[uop->type], 0xC0);  // setcc al
+        JIT_EMIT(e, 0x0F, 0xB6, 0xC0);                      // movzx eax, al
+        jit_emit_store(e, JIT_EAX, uop->dest);
+        break;
+    }
+    case LD:
+        jit_emit_load(e, JIT_EAX, uop->source1);
+        JIT_EMIT(e, 0x05);  // add eax, imm32
+        jit_emit_u32(e, uop->immediate);
+        JIT_EMIT(e, 0x0F, 0xB7, 0xC0);              // movzx eax, ax
+        JIT_EMIT(e, 0x41, 0x0F, 0xB7, 0x04, 0x04);  // movzx eax, word [r12+rax]
+        jit_emit_store(e, JIT_EAX, uop->dest);
+        break;
+    case ST: {
+        jit_emit_load(e, JIT_EAX, uop->source1);
+        JIT_EMIT(e, 0x05);  // add eax, imm32
+        jit_emit_u32(e, uop->immediate);
+        JIT_EMIT(e, 0x0F, 0xB7, 0xF0);       // movzx esi, ax
+        jit_emit_load(e, JIT_EDX, uop->dest);
+        JIT_EMIT(e, 0x4C, 0x89, 0xEF);       // mov rdi, r13
+        JIT_EMIT(e, 0x48, 0xB8);             // mov rax, imm64
+        jit_emit_u64(e, (uint64_t) (uintptr_t) &jit_store_halfword);
+        JIT_EMIT(e, 0xFF, 0xD0);             // call rax
+        JIT_EMIT(e, 0x85, 0xC0);             // test eax, eax
+        JIT_EMIT(e, 0x74, 0x00);             // jz continue (patched below)
+        size_t continue_patch = e->length - 1;
+        jit_emit_set_pc(e, uop_pc + sizeof(uint32_t));
+        jit_emit_exit(e, i + 1, TRANSLATOR_EXIT_INVALIDATED);
+        e->code[continue_patch] = e->length - (continue_patch + 1);
+        break;
+    }
+    case JL0:
+    case JL1:
+    case JLR0:
+    case JLR1:
+        jit_emit_jump(e, block, i);
+        break;
+    case HALT:
+        jit_emit_store_immediate(e, offsetof(struct register_file, reset), 0x0001);
+        jit_emit_set_pc(e, uop_pc);
+        jit_emit_exit(e, i, TRANSLATOR_EXIT_HALTED);
+        break;
+    default:
+        break;
+    }
+}
+
+
+static void jit_protect_arena(struct jit_state *jit, bool writable) {
+    int protection = writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+    if (mprotect(jit->arena, JIT_ARENA_SIZE, protection) != 0) {
+        log_fatal("JIT could not change protection of the code arena");
+    }
+}
+
+
+static translator_native_block jit_compile_block(struct processor *processor,
+                                                 struct translator_block *block)
+{
+    struct jit_state *jit = processor->jit;
+
+    // Blocks ending in an invalid instruction are rare and always interpreted.
+    if (block->uops[block->length - 1].type == TRANSLATOR_UOP_INVALID) {
+        return NULL;
+    }
+
+    // When the arena is full, all compiled code is discarded and blocks start over as cold.
+    if (jit->arena_used + JIT_MAX_BLOCK_CODE_SIZE > JIT_ARENA_SIZE) {
+        log_debug("JIT arena is full, discarding all compiled blocks");
+        for (uint32_t pc = 0; pc < PROCESSOR_DECODE_CACHE_SIZE; pc++) {
+            struct translator_block *cached = processor->translator->blocks[pc];
+            if (cached != NULL) {
+                cached->native = NULL;
+                cached->executions = 0;
+            }
+        }
+        jit->arena_used = 0;
+    }
+
+    jit_protect_arena(jit, true);
+
+    struct jit_emitter e = {.code = jit->arena + jit->arena_used, .length = 0};
+    jit_emit_prologue(&e);
+    for (uint16_t i = 0; i < block->length; i++) {
+        jit_emit_uop(&e, block, i);
+    }
+    if (!translator_is_terminal(block->uops[block->length - 1].type)) {
+        jit_emit_set_pc(&e, block->start + block->length * sizeof(uint32_t));
+        jit_emit_exit(&e, block->length, TRANSLATOR_EXIT_FALL_THROUGH);
+    }
+
+    jit_protect_arena(jit, false);
+
+    jit->arena_used += (e.length + 15) & ~((size_t) 15);
+    jit->compiled_blocks++;
+    log_debug("JIT compiled block at 0x%04" PRIx16 " (%zu bytes)", block->start, e.length);
+    return (translator_native_block) (uintptr_t) e.code;
+}
+
+
+struct jit_state *create_jit_state(void) {
+    struct jit_state *jit = (struct jit_state *) calloc(1, sizeof(struct jit_state));
+
+#ifdef JIT_SUPPORTED
+    void *arena = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_EXEC,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        log_warn("JIT could not map a code arena, blocks will be interpreted");
+    }
+    else {
+        jit->arena = (uint8_t *) arena;
+    }
+#else
+    log_warn("JIT is not supported on this host, blocks will be interpreted");
+#endif
+
+    return jit;
+}
+
+
+void destroy_jit_state(struct jit_state *jit) {
+    if (jit == NULL) {
+        return;
+    }
+    if (jit->arena != NULL) {
+        munmap(jit->arena, JIT_ARENA_SIZE);
+    }
+    if (jit->shadow != NULL) {
+        destroy_processor(jit->shadow);
+    }
+    free(jit);
+}
+
+
+static void jit_warm_block(struct processor *processor, struct translator_block *block) {
+    struct jit_state *jit = processor->jit;
+    if (block->native == NULL && jit->arena != NULL && ++block->executions == JIT_HOT_THRESHOLD) {
+        block->native = jit_compile_block(processor, block);
+    }
+}
+
+
+static enum translator_exit jit_dispatch_block(struct processor *processor,
+                                               struct translator_block *block,
+                                               uint32_t *executed)
+{
+    if (block->native == NULL) {
+        return translator_run_block(processor, block, executed);
+    }
+
+    uint32_t result = block->native(processor->registers, processor->memory->m, processor);
+    *executed = result & UINT16_MAX;
+    return (enum translator_exit) (result >> 16);
+}
+
+
+static enum translator_exit jit_run_block(struct processor *processor,
+                                          struct translator_block *block,
+                                          uint32_t *executed)
+{
+    jit_warm_block(processor, block);
+    return jit_dispatch_block(processor, block, executed);
+}
+
+
+static enum translator_exit jit_run_block_checked(struct processor *processor,
+                                                  struct translator_block *block,
+                                                  uint32_t *executed)
+{
+    struct processor *shadow = processor->jit->shadow;
+
+    jit_warm_block(processor, block);
+    uint16_t start = block->start;
+    bool native = block->native != NULL;
+    enum translator_exit exit = jit_dispatch_block(processor, block, executed);
+
+    // The shadow processor executes the same instructions with the reference engine. A HALT or
+    // invalid instruction that ended the block is executed too, since it changes no state other
+    // than reset.
+    for (uint32_t i = 0; i < *executed; i++) {
+        processor_tick(shadow, NULL);
+    }
+    if (exit == TRANSLATOR_EXIT_HALTED || exit == TRANSLATOR_EXIT_INVALID_INSTRUCTION) {
+        processor_tick(shadow, NULL);
+    }
+
+    if (memcmp(processor->registers, shadow->registers, sizeof(struct register_file)) != 0 ||
+        memcmp(processor->memory, shadow->memory, sizeof(struct memory)) != 0)
+    {
+        log_error("JIT check failed for %s block at 0x%04" PRIx16 " (pc = 0x%04" PRIx16
+                  ", expected 0x%04" PRIx16 ")",
+                  native ? "compiled" : "interpreted", start,
+                  processor->registers->pc, shadow->registers->pc);
+        return TRANSLATOR_EXIT_CHECK_FAILED;
+    }
+    return exit;
+}
+
+
+enum processor_status jit_execute(struct processor *processor,
+                                  uint32_t max_cycles,
+                                  uint32_t *cycles)
+{
+    if (processor->jit == NULL) {
+        processor->jit = create_jit_state();
+    }
+    struct jit_state *jit = processor->jit;
+
+    if (processor->engine != PROCESSOR_ENGINE_JIT_CHECKED) {
+        return translator_execute_blocks(processor, &jit_run_block, max_cycles, cycles);
+    }
+
+    if (jit->shadow == NULL) {
+        jit->shadow = create_processor();
+    }
+    *jit->shadow->registers = *processor->registers;
+    memcpy(jit->shadow->memory, processor->memory, sizeof(struct memory));
+    processor_invalidate_range(jit->shadow, 0x0000, PROCESSOR_DECODE_CACHE_SIZE);
+
+    return translator_execute_blocks(processor, &jit_run_block_checked, max_cycles, cycles);
+}
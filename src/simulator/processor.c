@@ -1,4 +1,7 @@
 #include "simulator/processor.h"
+#include "simulator/jit.h"
+#include "simulator/threaded.h"
+#include "simulator/translator.h"
 #include "architecture/isa.h"
 #include "architecture/logger.h"
 #include <inttypes.h>
@@ -14,6 +17,13 @@ struct processor *create_processor(void) {
     processor->memory = (struct memory *) malloc(sizeof(struct memory));
     processor->registers = (struct register_file *) malloc(sizeof(struct register_file));
     processor->registers->ccount = 0;
+    processor->decode_cache = (struct processor_decoded_instruction *)
+        calloc(PROCESSOR_DECODE_CACHE_SIZE, sizeof(struct processor_decoded_instruction));
+    processor->translator = NULL;
+    processor->jit = NULL;
+    processor->engine = PROCESSOR_ENGINE_SWITCH;
+    processor->breakpoints = (uint8_t *) calloc(PROCESSOR_BREAKPOINT_MAP_SIZE, sizeof(uint8_t));
+    processor->num_breakpoints = 0;
     processor_assert_reset(processor);
     return processor;
 }
@@ -22,6 +32,10 @@ struct processor *create_processor(void) {
 void destroy_processor(struct processor *processor) {
     free(processor->memory);
     free(processor->registers);
+    free(processor->decode_cache);
+    free(processor->breakpoints);
+    destroy_translator_cache(processor->translator);
+    destroy_jit_state(processor->jit);
     free(processor);
 }
 
@@ -44,9 +58,11 @@ enum processor_status processor_load_program(struct processor *processor,
         memory_store_byte(processor->memory, address + bytes_read, byte);
         bytes_read++;
         if (address + bytes_read > UINT16_MAX) {
+            processor_invalidate_range(processor, address, bytes_read);
             return PROCESSOR_STATUS_OUT_OF_MEMORY;
         }
     }
+    processor_invalidate_range(processor, address, bytes_read);
 
     log_info("Loaded %" PRIu32 " bytes into instruction memory at 0x%04" PRIx16,
              bytes_read,
@@ -56,6 +72,26 @@ enum processor_status processor_load_program(struct processor *processor,
 }
 
 
+void processor_invalidate_range(struct processor *processor, uint16_t address, uint32_t size) {
+    if (processor == NULL || size == 0) {
+        return;
+    }
+
+    // An instruction fetched from pc covers bytes pc through pc + 3, so any instruction starting
+    // up to three bytes before the written range may also have changed.
+    uint32_t first = address >= sizeof(uint32_t) - 1 ? address - (sizeof(uint32_t) - 1) : 0;
+    uint32_t last = (uint32_t) address + size - 1;
+    if (last >= PROCESSOR_DECODE_CACHE_SIZE) {
+        last = PROCESSOR_DECODE_CACHE_SIZE - 1;
+    }
+
+    for (uint32_t pc = first; pc <= last; pc++) {
+        processor->decode_cache[pc].valid = false;
+    }
+    translator_invalidate_range(processor->translator, address, size);
+}
+
+
 enum processor_status processor_assert_reset(struct processor *processor) {
     if (processor == NULL) {
         return PROCESSOR_STATUS_INVALID_ARGUMENT;
@@ -75,8 +111,8 @@ enum processor_status processor_deassert_reset(struct processor *processor) {
 }
 
 
-static uint32_t processor_fetch_instruction(struct processor *processor) {
-    uint16_t start_addr = processor->registers->pc;
+static uint32_t processor_fetch_instruction(struct processor *processor, uint16_t pc) {
+    uint16_t start_addr = pc;
     uint16_t end_addr = start_addr + sizeof(uint32_t);
 
     uint32_t binary = 0;
@@ -88,25 +124,80 @@ static uint32_t processor_fetch_instruction(struct processor *processor) {
 }
 
 
-static union isa_instruction processor_decode_instruction(uint32_t binary,
-                                                          enum isa_opcode_format *format)
+static enum processor_status processor_execute_i_type(
+    struct processor *processor,
+    const struct processor_decoded_instruction *decoded);
+static enum processor_status processor_execute_dsi_type(
+    struct processor *processor,
+    const struct processor_decoded_instruction *decoded);
+static enum processor_status processor_execute_dss_type(
+    struct processor *processor,
+    const struct processor_decoded_instruction *decoded);
+
+
+static void processor_decode_instruction(uint32_t binary,
+                                         struct processor_decoded_instruction *decoded)
 {
     union isa_instruction instruction;
     instruction.binary = binary;
-    *format = (enum isa_opcode_format) (binary & ((1U << ISA_INSTRUCTION_FORMAT_SIZE) - 1U));
-    return instruction;
+
+    decoded->instruction = instruction;
+    decoded->opcode = (instruction.i_type.funct << ISA_INSTRUCTION_FORMAT_SIZE) |
+        instruction.i_type.format;
+    decoded->dest = instruction.dss_type.dest;
+    decoded->source1 = instruction.dss_type.source1;
+    decoded->source2 = instruction.dss_type.source2;
+    decoded->immediate = instruction.dsi_type.immediate;
+
+    enum isa_opcode_format format = (enum isa_opcode_format) instruction.i_type.format;
+    switch (format) {
+    case ISA_OPCODE_FORMAT_I:
+        log_debug("Decode: I-type instruction");
+        decoded->execute = &processor_execute_i_type;
+        break;
+    case ISA_OPCODE_FORMAT_DSI:
+        log_debug("Decode: DSI-type instruction");
+        decoded->execute = &processor_execute_dsi_type;
+        break;
+    case ISA_OPCODE_FORMAT_DSS:
+        log_debug("Decode: DSS-type instruction");
+        decoded->execute = &processor_execute_dss_type;
+        break;
+    default:
+        decoded->execute = NULL;
+        break;
+    }
+    decoded->threaded_handler = NULL;
+    decoded->valid = true;
+}
+
+
+struct processor_decoded_instruction *processor_decode(struct processor *processor, uint16_t pc) {
+    struct processor_decoded_instruction *decoded = &processor->decode_cache[pc];
+    if (!decoded->valid) {
+        uint32_t binary = processor_fetch_instruction(processor, pc);
+        log_debug("Fetch: 0x%08" PRIx32, binary);
+        processor_decode_instruction(binary, decoded);
+    }
+    else {
+        log_debug("Fetch: 0x%08" PRIx32 " (decode cache hit)", decoded->instruction.binary);
+    }
+    return decoded;
 }
 
 
-static enum processor_status processor_execute_i_type(struct processor *processor,
-                                                      struct isa_i_format instruction)
+static enum processor_status processor_execute_i_type(
+    struct processor *processor,
+    const struct processor_decoded_instruction *decoded)
 {
-    enum isa_opcode opcode =
-        (enum isa_opcode) ((instruction.funct << ISA_INSTRUCTION_FORMAT_SIZE) | instruction.format);
-    uint16_t immediate = instruction.immediate;
+    enum isa_opcode opcode = (enum isa_opcode) decoded->opcode;
+    uint16_t immediate = decoded->immediate;
 
-    const struct isa_opcode_map *opcode_map = isa_get_opcode_map_from_opcode(opcode);
-    log_debug("Execute: %s 0x%04" PRIx16, opcode_map->symbol, immediate);
+    // The log macros only evaluate their arguments when the level is enabled, so the metadata
+    // lookups below are skipped entirely unless debug output is on.
+    log_debug("Execute: %s 0x%04" PRIx16,
+              isa_get_opcode_map_from_opcode(opcode)->symbol,
+              immediate);
 
     switch (opcode) {
     case HALT:
@@ -119,21 +210,20 @@ static enum processor_status processor_execute_i_type(struct processor *processo
 }
 
 
-static enum processor_status processor_execute_dsi_type(struct processor *processor,
-                                                        struct isa_dsi_format instruction)
+static enum processor_status processor_execute_dsi_type(
+    struct processor *processor,
+    const struct processor_decoded_instruction *decoded)
 {
     struct memory *memory = processor->memory;
     struct register_file *registers = processor->registers;
 
-    enum isa_opcode opcode =
-        (enum isa_opcode) ((instruction.funct << ISA_INSTRUCTION_FORMAT_SIZE) | instruction.format);
-    enum isa_register dest = (enum isa_register) instruction.dest;
-    enum isa_register source1 = (enum isa_register) instruction.source1;
-    uint16_t immediate = instruction.immediate;
+    enum isa_opcode opcode = (enum isa_opcode) decoded->opcode;
+    enum isa_register dest = (enum isa_register) decoded->dest;
+    enum isa_register source1 = (enum isa_register) decoded->source1;
+    uint16_t immediate = decoded->immediate;
 
-    const struct isa_opcode_map *opcode_map = isa_get_opcode_map_from_opcode(opcode);
     log_debug("Execute: %s %s, %s, 0x%04" PRIx16,
-              opcode_map->symbol,
+              isa_get_opcode_map_from_opcode(opcode)->symbol,
               isa_get_register_map_from_index(dest)->symbol,
               isa_get_register_map_from_index(source1)->symbol,
               immediate);
@@ -171,6 +261,7 @@ static enum processor_status processor_execute_dsi_type(struct processor *proces
     case ST: {
         uint16_t addr = registers_read(registers, source1) + immediate;
         memory_store_halfword(memory, addr, registers_read(registers, dest));
+        processor_invalidate_range(processor, addr, sizeof(uint16_t));
         break;
     }
     case JL0: {
@@ -194,20 +285,19 @@ static enum processor_status processor_execute_dsi_type(struct processor *proces
 }
 
 
-static enum processor_status processor_execute_dss_type(struct processor *processor,
-                                                        struct isa_dss_format instruction)
+static enum processor_status processor_execute_dss_type(
+    struct processor *processor,
+    const struct processor_decoded_instruction *decoded)
 {
     struct register_file *registers = processor->registers;
 
-    enum isa_opcode opcode =
-        (enum isa_opcode) ((instruction.funct << ISA_INSTRUCTION_FORMAT_SIZE) | instruction.format);
-    enum isa_register dest = (enum isa_register) instruction.dest;
-    enum isa_register source1 = (enum isa_register) instruction.source1;
-    enum isa_register source2 = (enum isa_register) instruction.source2;
+    enum isa_opcode opcode = (enum isa_opcode) decoded->opcode;
+    enum isa_register dest = (enum isa_register) decoded->dest;
+    enum isa_register source1 = (enum isa_register) decoded->source1;
+    enum isa_register source2 = (enum isa_register) decoded->source2;
 
-    const struct isa_opcode_map *opcode_map = isa_get_opcode_map_from_opcode(opcode);
     log_debug("Execute: %s %s, %s, %s",
-              opcode_map->symbol,
+              isa_get_opcode_map_from_opcode(opcode)->symbol,
               isa_get_register_map_from_index(dest)->symbol,
               isa_get_register_map_from_index(source1)->symbol,
               isa_get_register_map_from_index(source2)->symbol);
@@ -293,33 +383,18 @@ enum processor_status processor_tick(struct processor *processor, union isa_inst
 
     log_info("Clock tick: pc = 0x%04" PRIx16, processor->registers->pc);
 
-    uint32_t binary = processor_fetch_instruction(processor);
-    log_debug("Fetch: 0x%08" PRIx32, binary)
+    // The fetch and decode stages are only performed the first time an address is executed (or
+    // after the memory at that address is written). Otherwise the cached decoding is reused.
+    uint16_t old_pc = processor->registers->pc;
+    struct processor_decoded_instruction *decoded = processor_decode(processor, old_pc);
 
-    enum isa_opcode_format format;
-    union isa_instruction instruction = processor_decode_instruction(binary, &format);
     if (executed != NULL) {
-        *executed = instruction;
+        *executed = decoded->instruction;
     }
 
-    enum processor_status execute_status;
-    uint16_t old_pc = processor->registers->pc;
-    switch (format) {
-    case ISA_OPCODE_FORMAT_I:
-        log_debug("Decode: I-type instruction");
-        execute_status = processor_execute_i_type(processor, instruction.i_type);
-        break;
-    case ISA_OPCODE_FORMAT_DSI:
-        log_debug("Decode: DSI-type instruction");
-        execute_status = processor_execute_dsi_type(processor, instruction.dsi_type);
-        break;
-    case ISA_OPCODE_FORMAT_DSS:
-        log_debug("Decode: DSS-type instruction");
-        execute_status = processor_execute_dss_type(processor, instruction.dss_type);
-        break;
-    default:
-        execute_status = PROCESSOR_STATUS_INVALID_INSTRUCTION;
-        break;
+    enum processor_status execute_status = PROCESSOR_STATUS_INVALID_INSTRUCTION;
+    if (decoded->execute != NULL) {
+        execute_status = decoded->execute(processor, decoded);
     }
 
     if (execute_status != PROCESSOR_STATUS_SUCCESS) {
@@ -338,3 +413,160 @@ enum processor_status processor_tick(struct processor *processor, union isa_inst
     processor->registers->ccount++;
     return PROCESSOR_STATUS_SUCCESS;
 }
+
+
+enum processor_status processor_execute(struct processor *processor,
+                                        uint32_t max_cycles,
+                                        uint32_t *cycles)
+{
+    if (processor == NULL) {
+        return PROCESSOR_STATUS_INVALID_ARGUMENT;
+    }
+
+    uint32_t executed = 0;
+    enum processor_status status = PROCESSOR_STATUS_SUCCESS;
+    switch (processor->engine) {
+    case PROCESSOR_ENGINE_THREADED:
+        status = threaded_execute(processor, max_cycles, &executed);
+        break;
+    case PROCESSOR_ENGINE_BLOCK:
+        status = translator_execute(processor, max_cycles, &executed);
+        break;
+    case PROCESSOR_ENGINE_JIT:
+    case PROCESSOR_ENGINE_JIT_CHECKED:
+        status = jit_execute(processor, max_cycles, &executed);
+        break;
+    default:
+        while (executed < max_cycles) {
+            status = processor_tick(processor, NULL);
+            if (status != PROCESSOR_STATUS_SUCCESS) {
+                break;
+            }
+            executed++;
+        }
+        break;
+    }
+
+    if (cycles != NULL) {
+        *cycles = executed;
+    }
+    return status;
+}
+
+
+static enum processor_stop_reason processor_stop_reason_from_status(enum processor_status status) {
+    switch (status) {
+    case PROCESSOR_STATUS_SUCCESS:
+        return PROCESSOR_STOP_BUDGET;
+    case PROCESSOR_STATUS_HALTED:
+        return PROCESSOR_STOP_HALT;
+    default:
+        return PROCESSOR_STOP_ERROR;
+    }
+}
+
+
+static bool processor_is_return(const struct processor_decoded_instruction *decoded) {
+    return decoded->opcode == JLR0 &&
+        decoded->dest == ZERO &&
+        decoded->source1 == ZERO &&
+        decoded->source2 == RA;
+}
+
+
+enum processor_status processor_run(struct processor *processor,
+                                    uint32_t max_cycles,
+                                    uint32_t stop_mask,
+                                    struct processor_run_result *result)
+{
+    if (processor == NULL || result == NULL) {
+        return PROCESSOR_STATUS_INVALID_ARGUMENT;
+    }
+
+    bool check_return = (stop_mask & PROCESSOR_STOP_RETURN) != 0;
+    bool check_breakpoints =
+        (stop_mask & PROCESSOR_STOP_BREAKPOINT) != 0 && processor->num_breakpoints > 0;
+
+    // Without per-instruction stop conditions the whole budget can be handed to the selected
+    // engine, which may execute many instructions at a time.
+    if (!check_return && !check_breakpoints) {
+        enum processor_status status = processor_execute(processor, max_cycles, &result->cycles);
+        result->reason = processor_stop_reason_from_status(status);
+        return status;
+    }
+
+    struct register_file *registers = processor->registers;
+    result->cycles = 0;
+    if (registers->reset == 0x0001) {
+        result->reason = PROCESSOR_STOP_HALT;
+        return PROCESSOR_STATUS_HALTED;
+    }
+
+    uint32_t cycles = 0;
+    enum processor_status status = PROCESSOR_STATUS_SUCCESS;
+    enum processor_stop_reason reason = PROCESSOR_STOP_BUDGET;
+    while (cycles < max_cycles) {
+        uint16_t pc = registers->pc;
+        if (check_breakpoints && cycles > 0 && processor_has_breakpoint(processor, pc)) {
+            reason = PROCESSOR_STOP_BREAKPOINT;
+            break;
+        }
+
+        // Whether the instruction is a return is checked before it executes, since a store could
+        // invalidate its decode cache entry.
+        const struct processor_decoded_instruction *decoded = processor_decode(processor, pc);
+        bool returning = check_return && processor_is_return(decoded);
+
+        status = PROCESSOR_STATUS_INVALID_INSTRUCTION;
+        if (decoded->execute != NULL) {
+            status = decoded->execute(processor, decoded);
+        }
+        if (status != PROCESSOR_STATUS_SUCCESS) {
+            reason = processor_stop_reason_from_status(status);
+            break;
+        }
+
+        if (registers->pc == pc) {
+            registers->pc += sizeof(uint32_t);
+        }
+        registers->ccount++;
+        cycles++;
+
+        if (returning) {
+            reason = PROCESSOR_STOP_RETURN;
+            break;
+        }
+    }
+
+    result->cycles = cycles;
+    result->reason = reason;
+    return status;
+}
+
+
+enum processor_status processor_set_breakpoint(struct processor *processor,
+                                               uint16_t address,
+                                               bool enabled)
+{
+    if (processor == NULL) {
+        return PROCESSOR_STATUS_INVALID_ARGUMENT;
+    }
+
+    uint8_t bit = 1 << (address % CHAR_BIT);
+    uint8_t *byte = &processor->breakpoints[address / CHAR_BIT];
+    bool was_enabled = (*byte & bit) != 0;
+    if (enabled && !was_enabled) {
+        *byte |= bit;
+        processor->num_breakpoints++;
+    }
+    else if (!enabled && was_enabled) {
+        *byte &= ~bit;
+        processor->num_breakpoints--;
+    }
+    return PROCESSOR_STATUS_SUCCESS;
+}
+
+
+bool processor_has_breakpoint(const struct processor *processor, uint16_t address) {
+    return (processor->breakpoints[address / CHAR_BIT] >> (address % CHAR_BIT)) & 1;
+}
@@ -0,0 +1,178 @@
+#include "simulator/threaded.h"
+#include "simulator/processor.h"
+#include "architecture/isa.h"
+#include "architecture/logger.h"
+#include <inttypes.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+// Labels as values and computed goto are GNU extensions, which -Wpedantic reports.
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+
+/** Reads general purpose register `index`. */
+#define THREADED_READ(index) (gp[(index)])
+
+/** Writes general purpose register `index`, ignoring writes to the ZERO register. */
+#define THREADED_WRITE(index, value)            \
+    do {                                        \
+        if ((index) != ZERO) {                  \
+            gp[(index)] = (value);              \
+        }                                       \
+    } while (0)
+
+/** Retires the current instruction and falls through to the next sequential instruction. */
+#define THREADED_NEXT()                         \
+    do {                                        \
+        pc += sizeof(uint32_t);                 \
+        goto retire;                            \
+    } while (0)
+
+/** Retires the current instruction after a taken jump to `target`. */
+#define THREADED_JUMP(target)                                           \
+    do {                                                                \
+        uint16_t new_pc = (target);                                     \
+        pc = new_pc == pc ? (uint16_t) (pc + sizeof(uint32_t)) : new_pc; \
+        goto retire;                                                    \
+    } while (0)
+
+
+enum processor_status threaded_execute(struct processor *processor,
+                                       uint32_t max_cycles,
+                                       uint32_t *cycles)
+{
+    static const void *const dispatch_table[1U << (ISA_INSTRUCTION_FORMAT_SIZE +
+                                                   ISA_INSTRUCTION_FUNCT_SIZE)] = {
+        [HALT] = &&op_halt,
+        [ADDI] = &&op_addi, [SUBI] = &&op_subi, [ANDI] = &&op_andi, [ORI]  = &&op_ori,
+        [XORI] = &&op_xori, [SLLI] = &&op_slli, [SRLI] = &&op_srli, [SRAI] = &&op_srai,
+        [LD]   = &&op_ld,   [ST]   = &&op_st,   [JL0]  = &&op_jl0,  [JL1]  = &&op_jl1,
+        [ADD]  = &&op_add,  [SUB]  = &&op_sub,  [AND]  = &&op_and,  [OR]   = &&op_or,
+        [XOR]  = &&op_xor,  [SLL]  = &&op_sll,  [SRL]  = &&op_srl,  [SRA]  = &&op_sra,
+        [EQ]   = &&op_eq,   [GT]   = &&op_gt,   [LT]   = &&op_lt,   [NE]   = &&op_ne,
+        [JLR0] = &&op_jlr0, [JLR1] = &&op_jlr1
+    };
+
+    *cycles = 0;
+    if (processor->registers->reset == 0x0001) {
+        return PROCESSOR_STATUS_HALTED;
+    }
+
+    struct register_file *registers = processor->registers;
+    struct memory *memory = processor->memory;
+    struct processor_decoded_instruction *cache = processor->decode_cache;
+    uint16_t *gp = registers->gp;
+
+    uint16_t pc = registers->pc;
+    uint32_t executed = 0;
+    enum processor_status status = PROCESSOR_STATUS_SUCCESS;
+    const struct processor_decoded_instruction *d;
+
+dispatch:
+    if (executed >= max_cycles) {
+        goto done;
+    }
+    d = &cache[pc];
+    if (!d->valid || d->threaded_handler == NULL) {
+        struct processor_decoded_instruction *entry = processor_decode(processor, pc);
+        const void *handler = dispatch_table[entry->opcode];
+        entry->threaded_handler = handler != NULL ? handler : &&op_invalid;
+        d = entry;
+    }
+    goto *d->threaded_handler;
+
+retire:
+    registers->ccount++;
+    executed++;
+    goto dispatch;
+
+op_halt:
+    registers->reset = 0x0001;
+    status = PROCESSOR_STATUS_HALTED;
+    log_info("Processor halted at pc = 0x%04" PRIx16, pc);
+    goto done;
+op_invalid:
+    status = PROCESSOR_STATUS_INVALID_INSTRUCTION;
+    log_error("Simulator error after instruction decode: %d", status);
+    goto done;
+
+op_addi: THREADED_WRITE(d->dest, THREADED_READ(d->source1) + d->immediate); THREADED_NEXT();
+op_subi: THREADED_WRITE(d->dest, THREADED_READ(d->source1) - d->immediate); THREADED_NEXT();
+op_andi: THREADED_WRITE(d->dest, THREADED_READ(d->source1) & d->immediate); THREADED_NEXT();
+op_ori:  THREADED_WRITE(d->dest, THREADED_READ(d->source1) | d->immediate); THREADED_NEXT();
+op_xori: THREADED_WRITE(d->dest, THREADED_READ(d->source1) ^ d->immediate); THREADED_NEXT();
+op_slli: THREADED_WRITE(d->dest, THREADED_READ(d->source1) << d->immediate); THREADED_NEXT();
+op_srli: THREADED_WRITE(d->dest, THREADED_READ(d->source1) >> d->immediate); THREADED_NEXT();
+op_srai:
+    THREADED_WRITE(d->dest, (int16_t) THREADED_READ(d->source1) >> d->immediate);
+    THREADED_NEXT();
+op_ld: {
+    uint16_t addr = THREADED_READ(d->source1) + d->immediate;
+    THREADED_WRITE(d->dest, (memory->m[addr + 1] << CHAR_BIT) | memory->m[addr]);
+    THREADED_NEXT();
+}
+op_st: {
+    uint16_t addr = THREADED_READ(d->source1) + d->immediate;
+    uint16_t value = THREADED_READ(d->dest);
+    memory->m[addr + 1] = value >> CHAR_BIT;
+    memory->m[addr] = value & ((1U << CHAR_BIT) - 1U);
+    processor_invalidate_range(processor, addr, sizeof(uint16_t));
+    THREADED_NEXT();
+}
+op_jl0:
+    if (THREADED_READ(d->source1) == 0x0000) {
+        THREADED_WRITE(d->dest, pc + sizeof(uint32_t));
+        THREADED_JUMP(d->immediate);
+    }
+    THREADED_NEXT();
+op_jl1:
+    if (THREADED_READ(d->source1) == 0x0001) {
+        THREADED_WRITE(d->dest, pc + sizeof(uint32_t));
+        THREADED_JUMP(d->immediate);
+    }
+    THREADED_NEXT();
+
+op_add: THREADED_WRITE(d->dest, THREADED_READ(d->source1) + THREADED_READ(d->source2));
+    THREADED_NEXT();
+op_sub: THREADED_WRITE(d->dest, THREADED_READ(d->source1) - THREADED_READ(d->source2));
+    THREADED_NEXT();
+op_and: THREADED_WRITE(d->dest, THREADED_READ(d->source1) & THREADED_READ(d->source2));
+    THREADED_NEXT();
+op_or:  THREADED_WRITE(d->dest, THREADED_READ(d->source1) | THREADED_READ(d->source2));
+    THREADED_NEXT();
+op_xor: THREADED_WRITE(d->dest, THREADED_READ(d->source1) ^ THREADED_READ(d->source2));
+    THREADED_NEXT();
+op_sll: THREADED_WRITE(d->dest, THREADED_READ(d->source1) << THREADED_READ(d->source2));
+    THREADED_NEXT();
+op_srl: THREADED_WRITE(d->dest, THREADED_READ(d->source1) >> THREADED_READ(d->source2));
+    THREADED_NEXT();
+op_sra: THREADED_WRITE(d->dest, (int16_t) THREADED_READ(d->source1) >> THREADED_READ(d->source2));
+    THREADED_NEXT();
+op_eq:  THREADED_WRITE(d->dest, THREADED_READ(d->source1) == THREADED_READ(d->source2));
+    THREADED_NEXT();
+op_gt:  THREADED_WRITE(d->dest, THREADED_READ(d->source1) > THREADED_READ(d->source2));
+    THREADED_NEXT();
+op_lt:  THREADED_WRITE(d->dest, THREADED_READ(d->source1) < THREADED_READ(d->source2));
+    THREADED_NEXT();
+op_ne:  THREADED_WRITE(d->dest, THREADED_READ(d->source1) != THREADED_READ(d->source2));
+    THREADED_NEXT();
+op_jlr0:
+    if (THREADED_READ(d->source1) == 0x0000) {
+        THREADED_WRITE(d->dest, pc + sizeof(uint32_t));
+        THREADED_JUMP(THREADED_READ(d->source2));
+    }
+    THREADED_NEXT();
+op_jlr1:
+    if (THREADED_READ(d->source1) == 0x0001) {
+        THREADED_WRITE(d->dest, pc + sizeof(uint32_t));
+        THREADED_JUMP(THREADED_READ(d->source2));
+    }
+    THREADED_NEXT();
+
+done:
+    registers->pc = pc;
+    *cycles = executed;
+    return status;
+}
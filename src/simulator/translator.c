@@ -0,0 +1,347 @@
+#include "simulator/translator.h"
+#include "simulator/processor.h"
+#include "architecture/isa.h"
+#include "architecture/logger.h"
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+struct translator_cache *create_translator_cache(void) {
+    struct translator_cache *cache =
+        (struct translator_cache *) calloc(1, sizeof(struct translator_cache));
+    return cache;
+}
+
+
+void destroy_translator_cache(struct translator_cache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    for (uint32_t pc = 0; pc < PROCESSOR_DECODE_CACHE_SIZE; pc++) {
+        free(cache->blocks[pc]);
+    }
+    free(cache);
+}
+
+
+bool translator_is_terminal(uint8_t type) {
+    switch (type) {
+    case HALT:
+    case JL0:
+    case JL1:
+    case JLR0:
+    case JLR1:
+    case TRANSLATOR_UOP_INVALID:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+static struct translator_uop translator_translate_instruction(
+    const struct processor_decoded_instruction *decoded)
+{
+    struct translator_uop uop = {
+        .type = decoded->opcode,
+        .dest = decoded->dest,
+        .source1 = decoded->source1,
+        .source2 = decoded->source2,
+        .immediate = decoded->immediate
+    };
+
+    if (decoded->execute == NULL || isa_get_opcode_map_from_opcode(decoded->opcode) == NULL) {
+        uop.type = TRANSLATOR_UOP_INVALID;
+        return uop;
+    }
+
+    // Everything other than control flow and stores only writes to Dest, so those instructions
+    // have no effect when Dest is the ZERO register.
+    switch (decoded->opcode) {
+    case HALT:
+    case ST:
+    case JL0:
+    case JL1:
+    case JLR0:
+    case JLR1:
+        break;
+    default:
+        if (decoded->dest == ZERO) {
+            uop.type = TRANSLATOR_UOP_NOP;
+        }
+        break;
+    }
+    return uop;
+}
+
+
+struct translator_block *translator_get_block(struct processor *processor, uint16_t pc) {
+    struct translator_cache *cache = processor->translator;
+    if (cache->blocks[pc] != NULL) {
+        return cache->blocks[pc];
+    }
+
+    struct translator_uop uops[TRANSLATOR_MAX_BLOCK_LENGTH];
+    uint16_t length = 0;
+    uint16_t addr = pc;
+    while (length < TRANSLATOR_MAX_BLOCK_LENGTH) {
+        struct processor_decoded_instruction *decoded = processor_decode(processor, addr);
+        struct translator_uop uop = translator_translate_instruction(decoded);
+        uops[length++] = uop;
+        if (translator_is_terminal(uop.type)) {
+            break;
+        }
+        addr += sizeof(uint32_t);
+    }
+
+    struct translator_block *block =
+        (struct translator_block *) malloc(sizeof(struct translator_block) +
+                                           length * sizeof(struct translator_uop));
+    block->start = pc;
+    block->length = length;
+    block->fall_through = (struct translator_link) {.block = NULL, .epoch = 0};
+    block->taken = (struct translator_link) {.block = NULL, .epoch = 0};
+    block->executions = 0;
+    block->native = NULL;
+    memcpy(block->uops, uops, length * sizeof(struct translator_uop));
+
+    uint32_t end = (uint32_t) pc + length * sizeof(uint32_t);
+    if (end > PROCESSOR_DECODE_CACHE_SIZE) {
+        end = PROCESSOR_DECODE_CACHE_SIZE;
+    }
+    memset(&cache->code_map[pc], true, end - pc);
+
+    cache->blocks[pc] = block;
+    log_debug("Translated block at 0x%04" PRIx16 " (%" PRIu16 " instructions)", pc, length);
+    return block;
+}
+
+
+void translator_invalidate_range(struct translator_cache *cache, uint16_t address, uint32_t size) {
+    if (cache == NULL || size == 0) {
+        return;
+    }
+
+    uint32_t last = (uint32_t) address + size - 1;
+    if (last >= PROCESSOR_DECODE_CACHE_SIZE) {
+        last = PROCESSOR_DECODE_CACHE_SIZE - 1;
+    }
+
+    // Most stores are to data, so check the code map before searching for blocks to discard.
+    bool is_code = false;
+    for (uint32_t addr = address; addr <= last; addr++) {
+        is_code |= cache->code_map[addr];
+    }
+    if (!is_code) {
+        return;
+    }
+
+    uint32_t first = address >= TRANSLATOR_MAX_BLOCK_BYTES - 1 ?
+        address - (TRANSLATOR_MAX_BLOCK_BYTES - 1) : 0;
+    for (uint32_t start = first; start <= last; start++) {
+        struct translator_block *block = cache->blocks[start];
+        if (block != NULL && start + block->length * sizeof(uint32_t) > address) {
+            log_debug("Invalidated block at 0x%04" PRIx16, block->start);
+            free(block);
+            cache->blocks[start] = NULL;
+            cache->epoch++;
+        }
+    }
+}
+
+
+enum translator_exit translator_run_block(struct processor *processor,
+                                          struct translator_block *block,
+                                          uint32_t *executed)
+{
+    struct translator_cache *cache = processor->translator;
+    struct register_file *registers = processor->registers;
+    struct memory *memory = processor->memory;
+    uint16_t *gp = registers->gp;
+
+    uint16_t start = block->start;
+    uint16_t length = block->length;
+    uint32_t epoch = cache->epoch;
+    uint16_t next_pc = start + length * sizeof(uint32_t);
+    enum translator_exit exit = TRANSLATOR_EXIT_FALL_THROUGH;
+
+    for (uint16_t i = 0; i < length; i++) {
+        const struct translator_uop *uop = &block->uops[i];
+        uint16_t uop_pc = start + i * sizeof(uint32_t);
+
+        switch (uop->type) {
+        case TRANSLATOR_UOP_NOP:
+            break;
+        case ADDI: gp[uop->dest] = gp[uop->source1] + uop->immediate; break;
+        case SUBI: gp[uop->dest] = gp[uop->source1] - uop->immediate; break;
+        case ANDI: gp[uop->dest] = gp[uop->source1] & uop->immediate; break;
+        case ORI:  gp[uop->dest] = gp[uop->source1] | uop->immediate; break;
+        case XORI: gp[uop->dest] = gp[uop->source1] ^ uop->immediate; break;
+        case SLLI: gp[uop->dest] = gp[uop->source1] << uop->immediate; break;
+        case SRLI: gp[uop->dest] = gp[uop->source1] >> uop->immediate; break;
+        case SRAI: gp[uop->dest] = (int16_t) gp[uop->source1] >> uop->immediate; break;
+        case ADD:  gp[uop->dest] = gp[uop->source1] + gp[uop->source2]; break;
+        case SUB:  gp[uop->dest] = gp[uop->source1] - gp[uop->source2]; break;
+        case AND:  gp[uop->dest] = gp[uop->source1] & gp[uop->source2]; break;
+        case OR:   gp[uop->dest] = gp[uop->source1] | gp[uop->source2]; break;
+        case XOR:  gp[uop->dest] = gp[uop->source1] ^ gp[uop->source2]; break;
+        case SLL:  gp[uop->dest] = gp[uop->source1] << gp[uop->source2]; break;
+        case SRL:  gp[uop->dest] = gp[uop->source1] >> gp[uop->source2]; break;
+        case SRA:  gp[uop->dest] = (int16_t) gp[uop->source1] >> gp[uop->source2]; break;
+        case EQ:   gp[uop->dest] = gp[uop->source1] == gp[uop->source2]; break;
+        case GT:   gp[uop->dest] = gp[uop->source1] > gp[uop->source2]; break;
+        case LT:   gp[uop->dest] = gp[uop->source1] < gp[uop->source2]; break;
+        case NE:   gp[uop->dest] = gp[uop->source1] != gp[uop->source2]; break;
+        case LD: {
+            uint16_t addr = gp[uop->source1] + uop->immediate;
+            gp[uop->dest] = (memory->m[addr + 1] << CHAR_BIT) | memory->m[addr];
+            break;
+        }
+        case ST: {
+            uint16_t addr = gp[uop->source1] + uop->immediate;
+            uint16_t value = gp[uop->dest];
+            memory->m[addr + 1] = value >> CHAR_BIT;
+            memory->m[addr] = value & ((1U << CHAR_BIT) - 1U);
+            processor_invalidate_range(processor, addr, sizeof(uint16_t));
+
+            // If the store modified translated code, this block (and any block linked to it) may
+            // no longer exist, so execution must resume from a fresh lookup of the next pc.
+            if (cache->epoch != epoch) {
+                *executed = i + 1;
+                registers->ccount += i + 1;
+                registers->pc = uop_pc + sizeof(uint32_t);
+                return TRANSLATOR_EXIT_INVALIDATED;
+            }
+            break;
+        }
+        case JL0:
+        case JL1: {
+            uint16_t condition = uop->type == JL0 ? 0x0000 : 0x0001;
+            if (gp[uop->source1] == condition) {
+                if (uop->dest != ZERO) {
+                    gp[uop->dest] = uop_pc + sizeof(uint32_t);
+                }
+                next_pc = uop->immediate == uop_pc ? next_pc : uop->immediate;
+                exit = TRANSLATOR_EXIT_TAKEN;
+            }
+            break;
+        }
+        case JLR0:
+        case JLR1: {
+            uint16_t condition = uop->type == JLR0 ? 0x0000 : 0x0001;
+            if (gp[uop->source1] == condition) {
+                if (uop->dest != ZERO) {
+                    gp[uop->dest] = uop_pc + sizeof(uint32_t);
+                }
+                uint16_t target = gp[uop->source2];
+                next_pc = target == uop_pc ? next_pc : target;
+                exit = TRANSLATOR_EXIT_TAKEN;
+            }
+            break;
+        }
+        case HALT:
+            *executed = i;
+            registers->ccount += i;
+            registers->pc = uop_pc;
+            registers->reset = 0x0001;
+            return TRANSLATOR_EXIT_HALTED;
+        default:
+            *executed = i;
+            registers->ccount += i;
+            registers->pc = uop_pc;
+            return TRANSLATOR_EXIT_INVALID_INSTRUCTION;
+        }
+    }
+
+    *executed = length;
+    registers->ccount += length;
+    registers->pc = next_pc;
+    return exit;
+}
+
+
+enum processor_status translator_execute_blocks(struct processor *processor,
+                                                translator_block_runner run_block,
+                                                uint32_t max_cycles,
+                                                uint32_t *cycles)
+{
+    *cycles = 0;
+    if (processor->registers->reset == 0x0001) {
+        return PROCESSOR_STATUS_HALTED;
+    }
+    if (processor->translator == NULL) {
+        processor->translator = create_translator_cache();
+    }
+
+    struct translator_cache *cache = processor->translator;
+    struct register_file *registers = processor->registers;
+
+    uint32_t executed = 0;
+    enum processor_status status = PROCESSOR_STATUS_SUCCESS;
+    struct translator_block *block = translator_get_block(processor, registers->pc);
+
+    while (max_cycles - executed >= block->length) {
+        uint32_t block_cycles;
+        enum translator_exit exit = run_block(processor, block, &block_cycles);
+        executed += block_cycles;
+
+        switch (exit) {
+        case TRANSLATOR_EXIT_FALL_THROUGH:
+        case TRANSLATOR_EXIT_TAKEN: {
+            // Follow the cached link to the next block if it is still valid, otherwise look the
+            // block up (translating it if needed) and link it for next time.
+            struct translator_link *link =
+                exit == TRANSLATOR_EXIT_TAKEN ? &block->taken : &block->fall_through;
+            if (link->block != NULL && link->epoch == cache->epoch &&
+                link->block->start == registers->pc)
+            {
+                block = link->block;
+                break;
+            }
+            struct translator_block *next = translator_get_block(processor, registers->pc);
+            link->block = next;
+            link->epoch = cache->epoch;
+            block = next;
+            break;
+        }
+        case TRANSLATOR_EXIT_INVALIDATED:
+            block = translator_get_block(processor, registers->pc);
+            break;
+        case TRANSLATOR_EXIT_HALTED:
+            log_info("Processor halted at pc = 0x%04" PRIx16, registers->pc);
+            *cycles = executed;
+            return PROCESSOR_STATUS_HALTED;
+        case TRANSLATOR_EXIT_CHECK_FAILED:
+            *cycles = executed;
+            return PROCESSOR_STATUS_CHECK_FAILED;
+        default:
+            status = PROCESSOR_STATUS_INVALID_INSTRUCTION;
+            log_error("Simulator error after instruction decode: %d", status);
+            *cycles = executed;
+            return status;
+        }
+    }
+
+    // Not enough cycles remain to execute the whole next block, so the rest are single-stepped.
+    while (executed < max_cycles) {
+        status = processor_tick(processor, NULL);
+        if (status != PROCESSOR_STATUS_SUCCESS) {
+            break;
+        }
+        executed++;
+    }
+    *cycles = executed;
+    return status;
+}
+
+
+enum processor_status translator_execute(struct processor *processor,
+                                         uint32_t max_cycles,
+                                         uint32_t *cycles)
+{
+    return translator_execute_blocks(processor, &translator_run_block, max_cycles, cycles);
+}
@@ -0,0 +1,178 @@
+#include "structures/arena.h"
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/** The alignment of every pointer returned by arena_allocate. */
+#define ARENA_ALIGNMENT (alignof(max_align_t))
+
+
+struct arena *create_arena(size_t chunk_size) {
+    struct arena *arena = (struct arena *) malloc(sizeof(struct arena));
+
+    arena->current = NULL;
+    arena->chunk_size = chunk_size > 0 ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE;
+    arena->bytes_allocated = 0;
+    arena->cleanups = NULL;
+
+    return arena;
+}
+
+
+/**
+ * Calls and forgets every cleanup callback registered with an arena.
+ *
+ * @param arena  The arena to run cleanups for.
+ */
+static void arena_run_cleanups(struct arena *arena) {
+    struct arena_cleanup *curr = arena->cleanups;
+    while (curr != NULL) {
+        curr->callback(curr->data);
+        curr = curr->prev;
+    }
+    arena->cleanups = NULL;
+}
+
+
+void destroy_arena(struct arena *arena) {
+    if (arena == NULL) {
+        return;
+    }
+
+    arena_run_cleanups(arena);
+    struct arena_chunk *curr = arena->current;
+    while (curr != NULL) {
+        struct arena_chunk *prev = curr->prev;
+        free(curr);
+        curr = prev;
+    }
+
+    free(arena);
+}
+
+
+/**
+ * Gets the offset of the first aligned byte at or after the used portion of a chunk.
+ *
+ * @param chunk  The chunk to check.
+ *
+ * @return The offset into the chunk's data member.
+ */
+static size_t arena_aligned_offset(const struct arena_chunk *chunk) {
+    uintptr_t address = (uintptr_t) (chunk->data + chunk->used);
+    uintptr_t aligned = (address + ARENA_ALIGNMENT - 1) & ~((uintptr_t) ARENA_ALIGNMENT - 1);
+    return chunk->used + (size_t) (aligned - address);
+}
+
+
+void *arena_allocate(struct arena *arena, size_t size) {
+    if (arena == NULL) {
+        return NULL;
+    }
+
+    struct arena_chunk *chunk = arena->current;
+    size_t offset = chunk != NULL ? arena_aligned_offset(chunk) : 0;
+    if (chunk == NULL || offset > chunk->size || size > chunk->size - offset) {
+        // Requests larger than the chunk size get a chunk of their own, with room for alignment.
+        // Twice the request is reserved so that a growing allocation (e.g. a vector) can usually
+        // be extended in place by arena_reallocate; untouched memory is never paged in.
+        size_t chunk_size = arena->chunk_size;
+        if (size + ARENA_ALIGNMENT > chunk_size) {
+            chunk_size = size <= (SIZE_MAX - ARENA_ALIGNMENT) / 2 ?
+                2 * size + ARENA_ALIGNMENT : size + ARENA_ALIGNMENT;
+        }
+        chunk = (struct arena_chunk *) malloc(sizeof(struct arena_chunk) + chunk_size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+
+        chunk->prev = arena->current;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        arena->current = chunk;
+        offset = arena_aligned_offset(chunk);
+    }
+
+    chunk->used = offset + size;
+    arena->bytes_allocated += size;
+    return chunk->data + offset;
+}
+
+
+void *arena_reallocate(struct arena *arena, void *data, size_t old_size, size_t new_size) {
+    if (arena == NULL) {
+        return NULL;
+    }
+    if (data == NULL) {
+        return arena_allocate(arena, new_size);
+    }
+
+    struct arena_chunk *chunk = arena->current;
+    uint8_t *start = (uint8_t *) data;
+    if (chunk != NULL && start + old_size == chunk->data + chunk->used) {
+        size_t offset = (size_t) (start - chunk->data);
+        if (new_size <= chunk->size - offset) {
+            chunk->used = offset + new_size;
+            arena->bytes_allocated = arena->bytes_allocated - old_size + new_size;
+            return data;
+        }
+    }
+
+    void *new_data = arena_allocate(arena, new_size);
+    if (new_data != NULL) {
+        memcpy(new_data, data, old_size < new_size ? old_size : new_size);
+    }
+    return new_data;
+}
+
+
+bool arena_add_cleanup(struct arena *arena, arena_cleanup_callback callback, void *data) {
+    if (arena == NULL || callback == NULL) {
+        return false;
+    }
+
+    struct arena_cleanup *cleanup =
+        (struct arena_cleanup *) arena_allocate(arena, sizeof(struct arena_cleanup));
+    if (cleanup == NULL) {
+        return false;
+    }
+
+    cleanup->prev = arena->cleanups;
+    cleanup->callback = callback;
+    cleanup->data = data;
+    arena->cleanups = cleanup;
+    return true;
+}
+
+
+void arena_reset(struct arena *arena) {
+    if (arena == NULL) {
+        return;
+    }
+
+    arena_run_cleanups(arena);
+    struct arena_chunk *largest = NULL;
+    struct arena_chunk *curr = arena->current;
+    while (curr != NULL) {
+        struct arena_chunk *prev = curr->prev;
+        if (largest == NULL || curr->size > largest->size) {
+            free(largest);
+            largest = curr;
+        }
+        else {
+            free(curr);
+        }
+        curr = prev;
+    }
+
+    if (largest != NULL) {
+        largest->prev = NULL;
+        largest->used = 0;
+    }
+    arena->current = largest;
+    arena->bytes_allocated = 0;
+}
@@ -0,0 +1,144 @@
+#include "structures/hash_map.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * Hashes a string with the FNV-1a hash.
+ *
+ * @param key  The null-terminated string to hash.
+ *
+ * @return The hash of the string.
+ */
+static uint32_t hash_map_hash(const char *key) {
+    uint32_t hash = 2166136261U;
+    for (const char *c = key; *c != '\0'; c++) {
+        hash ^= (uint8_t) *c;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+
+/**
+ * Finds the slot that holds a key, or the empty slot where it would be inserted.
+ *
+ * @param entries   The slots to search.
+ * @param capacity  The number of slots (a power of two).
+ * @param key       The key to find.
+ * @param hash      The hash of the key.
+ *
+ * @return Pointer to the slot.
+ */
+static struct hash_map_entry *hash_map_find_slot(struct hash_map_entry *entries,
+                                                 uint32_t capacity,
+                                                 const char *key,
+                                                 uint32_t hash)
+{
+    uint32_t mask = capacity - 1;
+    for (uint32_t i = hash & mask; ; i = (i + 1) & mask) {
+        struct hash_map_entry *entry = &entries[i];
+        if (entry->key == NULL || (entry->hash == hash && strcmp(entry->key, key) == 0)) {
+            return entry;
+        }
+    }
+}
+
+
+/**
+ * Moves every key into a new set of slots.
+ *
+ * @param map           The hash map to resize.
+ * @param new_capacity  The new number of slots (a power of two larger than the number of keys).
+ *
+ * @return Whether the map was resized.
+ */
+static bool hash_map_resize(struct hash_map *map, uint32_t new_capacity) {
+    struct hash_map_entry *new_entries =
+        (struct hash_map_entry *) calloc(new_capacity, sizeof(struct hash_map_entry));
+    if (new_entries == NULL) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < map->capacity; i++) {
+        struct hash_map_entry *entry = &map->entries[i];
+        if (entry->key != NULL) {
+            *hash_map_find_slot(new_entries, new_capacity, entry->key, entry->hash) = *entry;
+        }
+    }
+
+    free(map->entries);
+    map->entries = new_entries;
+    map->capacity = new_capacity;
+    return true;
+}
+
+
+struct hash_map *create_hash_map(uint32_t capacity) {
+    struct hash_map *map = (struct hash_map *) malloc(sizeof(struct hash_map));
+
+    // The map is kept at most half full so that probe sequences stay short.
+    uint32_t num_slots = HASH_MAP_INITIAL_CAPACITY;
+    while (num_slots / 2 < capacity && num_slots <= UINT32_MAX / 2) {
+        num_slots *= 2;
+    }
+
+    map->entries = (struct hash_map_entry *) calloc(num_slots, sizeof(struct hash_map_entry));
+    map->capacity = num_slots;
+    map->size = 0;
+
+    return map;
+}
+
+
+void destroy_hash_map(struct hash_map *map) {
+    if (map == NULL) {
+        return;
+    }
+
+    free(map->entries);
+    free(map);
+}
+
+
+enum hash_map_status hash_map_insert(struct hash_map *map, const char *key, void *value) {
+    if (map == NULL || key == NULL) {
+        return HASH_MAP_STATUS_INVALID_ARGUMENT;
+    }
+
+    if (map->size + 1 > map->capacity / 2) {
+        if (map->capacity > UINT32_MAX / 2 || !hash_map_resize(map, map->capacity * 2)) {
+            return HASH_MAP_STATUS_OUT_OF_MEMORY;
+        }
+    }
+
+    uint32_t hash = hash_map_hash(key);
+    struct hash_map_entry *entry = hash_map_find_slot(map->entries, map->capacity, key, hash);
+    if (entry->key != NULL) {
+        return HASH_MAP_STATUS_DUPLICATE_KEY;
+    }
+
+    entry->key = key;
+    entry->hash = hash;
+    entry->value = value;
+    map->size++;
+    return HASH_MAP_STATUS_SUCCESS;
+}
+
+
+enum hash_map_status hash_map_get(const struct hash_map *map, const char *key, void **value) {
+    if (map == NULL || key == NULL || value == NULL) {
+        return HASH_MAP_STATUS_INVALID_ARGUMENT;
+    }
+
+    uint32_t hash = hash_map_hash(key);
+    struct hash_map_entry *entry = hash_map_find_slot(map->entries, map->capacity, key, hash);
+    if (entry->key == NULL) {
+        return HASH_MAP_STATUS_NOT_FOUND;
+    }
+
+    *value = entry->value;
+    return HASH_MAP_STATUS_SUCCESS;
+}
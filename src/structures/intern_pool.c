@@ -0,0 +1,192 @@
+#include "structures/intern_pool.h"
+#include "structures/arena.h"
+#include "structures/vector.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/**
+ * Hashes a string with the FNV-1a hash.
+ *
+ * @param text    The text of the string.
+ * @param length  The number of characters in the string.
+ *
+ * @return The hash of the string.
+ */
+static uint32_t intern_pool_hash(const char *text, size_t length) {
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (uint8_t) text[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+
+/**
+ * Finds the slot that holds a string, or the empty slot where it would be inserted.
+ *
+ * @param pool    The intern pool to search.
+ * @param text    The text of the string.
+ * @param length  The number of characters in the string.
+ * @param hash    The hash of the string.
+ *
+ * @return Pointer to the slot.
+ */
+static uint32_t *intern_pool_find_slot(const struct intern_pool *pool,
+                                       const char *text,
+                                       size_t length,
+                                       uint32_t hash)
+{
+    const struct intern_pool_entry *entries = pool->entries->data;
+    uint32_t mask = pool->capacity - 1;
+    for (uint32_t i = hash & mask; ; i = (i + 1) & mask) {
+        uint32_t *slot = &pool->slots[i];
+        if (*slot == 0) {
+            return slot;
+        }
+
+        const struct intern_pool_entry *entry = &entries[*slot - 1];
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(entry->text, text, length) == 0)
+        {
+            return slot;
+        }
+    }
+}
+
+
+/**
+ * Moves every ID into a new set of slots.
+ *
+ * @param pool          The intern pool to resize.
+ * @param new_capacity  The new number of slots (a power of two larger than the number of strings).
+ *
+ * @return Whether the pool was resized.
+ */
+static bool intern_pool_resize(struct intern_pool *pool, uint32_t new_capacity) {
+    uint32_t *new_slots = (uint32_t *) calloc(new_capacity, sizeof(uint32_t));
+    if (new_slots == NULL) {
+        return false;
+    }
+
+    // IDs are unique, so each one goes in the first empty slot of its probe sequence.
+    uint32_t mask = new_capacity - 1;
+    const struct intern_pool_entry *entries = pool->entries->data;
+    for (uint32_t id = 0; id < pool->entries->size; id++) {
+        uint32_t i = entries[id].hash & mask;
+        while (new_slots[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        new_slots[i] = id + 1;
+    }
+
+    free(pool->slots);
+    pool->slots = new_slots;
+    pool->capacity = new_capacity;
+    return true;
+}
+
+
+struct intern_pool *create_intern_pool(void) {
+    struct intern_pool *pool = (struct intern_pool *) malloc(sizeof(struct intern_pool));
+
+    pool->entries = create_vector(sizeof(struct intern_pool_entry));
+    pool->slots = (uint32_t *) calloc(INTERN_POOL_INITIAL_CAPACITY, sizeof(uint32_t));
+    pool->capacity = INTERN_POOL_INITIAL_CAPACITY;
+    pool->text = create_arena(0);
+
+    return pool;
+}
+
+
+void destroy_intern_pool(struct intern_pool *pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    destroy_vector(pool->entries);
+    free(pool->slots);
+    destroy_arena(pool->text);
+    free(pool);
+}
+
+
+enum intern_pool_status intern_pool_intern(struct intern_pool *pool,
+                                           const char *text,
+                                           size_t length,
+                                           uint32_t *id)
+{
+    if (pool == NULL || (text == NULL && length > 0) || id == NULL || length >= UINT32_MAX) {
+        return INTERN_POOL_STATUS_INVALID_ARGUMENT;
+    }
+
+    uint32_t hash = intern_pool_hash(text, length);
+    uint32_t *slot = intern_pool_find_slot(pool, text, length, hash);
+    if (*slot != 0) {
+        *id = *slot - 1;
+        return INTERN_POOL_STATUS_SUCCESS;
+    }
+
+    // The table is kept at most half full so that probe sequences stay short.
+    uint32_t size = pool->entries->size;
+    if (size + 1 > pool->capacity / 2) {
+        if (pool->capacity > UINT32_MAX / 2 || !intern_pool_resize(pool, pool->capacity * 2)) {
+            return INTERN_POOL_STATUS_OUT_OF_MEMORY;
+        }
+        slot = intern_pool_find_slot(pool, text, length, hash);
+    }
+
+    char *copy = (char *) arena_allocate(pool->text, length + 1);
+    if (copy == NULL) {
+        return INTERN_POOL_STATUS_OUT_OF_MEMORY;
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+
+    struct intern_pool_entry entry = {.text = copy, .length = (uint32_t) length, .hash = hash};
+    if (vector_add(pool->entries, &entry) != VECTOR_STATUS_SUCCESS) {
+        return INTERN_POOL_STATUS_OUT_OF_MEMORY;
+    }
+
+    *slot = size + 1;
+    *id = size;
+    return INTERN_POOL_STATUS_SUCCESS;
+}
+
+
+enum intern_pool_status intern_pool_find(const struct intern_pool *pool,
+                                         const char *text,
+                                         size_t length,
+                                         uint32_t *id)
+{
+    if (pool == NULL || (text == NULL && length > 0) || id == NULL) {
+        return INTERN_POOL_STATUS_INVALID_ARGUMENT;
+    }
+
+    uint32_t *slot = intern_pool_find_slot(pool, text, length, intern_pool_hash(text, length));
+    if (*slot == 0) {
+        return INTERN_POOL_STATUS_NOT_FOUND;
+    }
+
+    *id = *slot - 1;
+    return INTERN_POOL_STATUS_SUCCESS;
+}
+
+
+const char *intern_pool_text(const struct intern_pool *pool, uint32_t id) {
+    if (pool == NULL) {
+        return NULL;
+    }
+
+    const struct intern_pool_entry *entry = vector_at(pool->entries, id);
+    return entry != NULL ? entry->text : NULL;
+}
+
+
+uint32_t intern_pool_size(const struct intern_pool *pool) {
+    return pool != NULL ? pool->entries->size : 0;
+}
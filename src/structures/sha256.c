@@ -0,0 +1,145 @@
+#include "structures/sha256.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/** The round constants, the fractional parts of the cube roots of the first 64 primes. */
+static const uint32_t sha256_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+/**
+ * Rotates a word right.
+ *
+ * @param x  The word to rotate.
+ * @param n  The number of bits to rotate by (1 to 31).
+ *
+ * @return The rotated word.
+ */
+static inline uint32_t sha256_rotate(uint32_t x, uint32_t n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+
+/**
+ * Hashes one block of data into the intermediate hash value.
+ *
+ * @param hash   The hash to update.
+ * @param block  The SHA256_BLOCK_SIZE bytes of the block.
+ */
+static void sha256_compress(struct sha256 *hash, const uint8_t *block) {
+    uint32_t w[64];
+    for (uint32_t i = 0; i < 16; i++) {
+        w[i] = (uint32_t) block[i * 4] << 24 | (uint32_t) block[i * 4 + 1] << 16 |
+            (uint32_t) block[i * 4 + 2] << 8 | (uint32_t) block[i * 4 + 3];
+    }
+    for (uint32_t i = 16; i < 64; i++) {
+        uint32_t s0 = sha256_rotate(w[i - 15], 7) ^ sha256_rotate(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = sha256_rotate(w[i - 2], 17) ^ sha256_rotate(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = hash->state[0], b = hash->state[1], c = hash->state[2], d = hash->state[3];
+    uint32_t e = hash->state[4], f = hash->state[5], g = hash->state[6], h = hash->state[7];
+    for (uint32_t i = 0; i < 64; i++) {
+        uint32_t s1 = sha256_rotate(e, 6) ^ sha256_rotate(e, 11) ^ sha256_rotate(e, 25);
+        uint32_t choice = (e & f) ^ (~e & g);
+        uint32_t t1 = h + s1 + choice + sha256_constants[i] + w[i];
+        uint32_t s0 = sha256_rotate(a, 2) ^ sha256_rotate(a, 13) ^ sha256_rotate(a, 22);
+        uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + majority;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    hash->state[0] += a;
+    hash->state[1] += b;
+    hash->state[2] += c;
+    hash->state[3] += d;
+    hash->state[4] += e;
+    hash->state[5] += f;
+    hash->state[6] += g;
+    hash->state[7] += h;
+}
+
+
+void sha256_init(struct sha256 *hash) {
+    static const uint32_t initial_state[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(hash->state, initial_state, sizeof(initial_state));
+    hash->buffer_size = 0;
+    hash->length = 0;
+}
+
+
+void sha256_update(struct sha256 *hash, const void *data, size_t length) {
+    const uint8_t *bytes = (const uint8_t *) data;
+    hash->length += length;
+
+    if (hash->buffer_size > 0) {
+        size_t count = SHA256_BLOCK_SIZE - hash->buffer_size;
+        if (count > length) {
+            count = length;
+        }
+        memcpy(hash->buffer + hash->buffer_size, bytes, count);
+        hash->buffer_size += count;
+        bytes += count;
+        length -= count;
+        if (hash->buffer_size < SHA256_BLOCK_SIZE) {
+            return;
+        }
+        sha256_compress(hash, hash->buffer);
+        hash->buffer_size = 0;
+    }
+
+    // Whole blocks are hashed directly from the data rather than copied through the buffer.
+    while (length >= SHA256_BLOCK_SIZE) {
+        sha256_compress(hash, bytes);
+        bytes += SHA256_BLOCK_SIZE;
+        length -= SHA256_BLOCK_SIZE;
+    }
+    memcpy(hash->buffer, bytes, length);
+    hash->buffer_size = length;
+}
+
+
+void sha256_finish(struct sha256 *hash, uint8_t *digest) {
+    uint64_t num_bits = hash->length * 8;
+
+    // The data is padded with a one bit, zeros, and its length in bits, to a whole block.
+    uint8_t padding[SHA256_BLOCK_SIZE + sizeof(uint64_t)] = {0x80};
+    size_t padding_size = (hash->buffer_size < SHA256_BLOCK_SIZE - sizeof(uint64_t) ?
+                           SHA256_BLOCK_SIZE : 2 * SHA256_BLOCK_SIZE) -
+        hash->buffer_size - sizeof(uint64_t);
+    sha256_update(hash, padding, padding_size);
+
+    uint8_t length[sizeof(uint64_t)];
+    for (uint32_t b = 0; b < sizeof(uint64_t); b++) {
+        length[b] = (num_bits >> (56 - b * 8)) & UINT8_MAX;
+    }
+    sha256_update(hash, length, sizeof(length));
+
+    for (uint32_t i = 0; i < 8; i++) {
+        digest[i * 4] = (hash->state[i] >> 24) & UINT8_MAX;
+        digest[i * 4 + 1] = (hash->state[i] >> 16) & UINT8_MAX;
+        digest[i * 4 + 2] = (hash->state[i] >> 8) & UINT8_MAX;
+        digest[i * 4 + 3] = hash->state[i] & UINT8_MAX;
+    }
+}
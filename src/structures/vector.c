@@ -0,0 +1,157 @@
+#include "structures/vector.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+struct vector *create_vector(size_t element_size) {
+    return create_vector_in_arena(NULL, element_size);
+}
+
+
+struct vector *create_vector_in_arena(struct arena *arena, size_t element_size) {
+    struct vector *vector;
+    if (arena != NULL) {
+        vector = (struct vector *) arena_allocate(arena, sizeof(struct vector));
+    }
+    else {
+        vector = (struct vector *) malloc(sizeof(struct vector));
+    }
+    if (vector == NULL) {
+        return NULL;
+    }
+
+    vector->data = NULL;
+    vector->element_size = element_size;
+    vector->size = 0;
+    vector->capacity = 0;
+    vector->arena = arena;
+
+    return vector;
+}
+
+
+void destroy_vector(struct vector *vector) {
+    if (vector == NULL || vector->arena != NULL) {
+        return;
+    }
+
+    free(vector->data);
+    free(vector);
+}
+
+
+enum vector_status vector_reserve(struct vector *vector, uint32_t capacity) {
+    if (vector == NULL) {
+        return VECTOR_STATUS_INVALID_ARGUMENT;
+    }
+    if (capacity <= vector->capacity) {
+        return VECTOR_STATUS_SUCCESS;
+    }
+
+    // Grow geometrically so that a series of adds takes amortized constant time per element.
+    uint32_t new_capacity = vector->capacity > 0 ? vector->capacity : VECTOR_INITIAL_CAPACITY;
+    while (new_capacity < capacity) {
+        new_capacity = new_capacity <= UINT32_MAX / 2 ? new_capacity * 2 : UINT32_MAX;
+    }
+
+    size_t new_size = (size_t) new_capacity * vector->element_size;
+    void *new_data;
+    if (vector->arena != NULL) {
+        new_data = arena_reallocate(vector->arena, vector->data,
+                                    (size_t) vector->capacity * vector->element_size, new_size);
+    }
+    else {
+        new_data = realloc(vector->data, new_size);
+    }
+    if (new_data == NULL) {
+        return VECTOR_STATUS_OUT_OF_MEMORY;
+    }
+
+    vector->data = new_data;
+    vector->capacity = new_capacity;
+    return VECTOR_STATUS_SUCCESS;
+}
+
+
+enum vector_status vector_add(struct vector *vector, const void *element) {
+    if (vector == NULL) {
+        return VECTOR_STATUS_INVALID_ARGUMENT;
+    }
+    return vector_insert_at(vector, vector->size, element, 1);
+}
+
+
+enum vector_status vector_insert_at(struct vector *vector,
+                                    uint32_t index,
+                                    const void *elements,
+                                    uint32_t count)
+{
+    if (vector == NULL || (elements == NULL && count > 0)) {
+        return VECTOR_STATUS_INVALID_ARGUMENT;
+    }
+    if (index > vector->size) {
+        return VECTOR_STATUS_INVALID_INDEX;
+    }
+    if (count > UINT32_MAX - vector->size) {
+        return VECTOR_STATUS_OUT_OF_MEMORY;
+    }
+
+    enum vector_status reserve_status = vector_reserve(vector, vector->size + count);
+    if (reserve_status != VECTOR_STATUS_SUCCESS) {
+        return reserve_status;
+    }
+
+    uint8_t *base = (uint8_t *) vector->data;
+    size_t element_size = vector->element_size;
+    memmove(base + (size_t) (index + count) * element_size,
+            base + (size_t) index * element_size,
+            (size_t) (vector->size - index) * element_size);
+    memcpy(base + (size_t) index * element_size, elements, (size_t) count * element_size);
+
+    vector->size += count;
+    return VECTOR_STATUS_SUCCESS;
+}
+
+
+void *vector_at(const struct vector *vector, uint32_t index) {
+    if (vector == NULL || index >= vector->size) {
+        return NULL;
+    }
+    return (uint8_t *) vector->data + (size_t) index * vector->element_size;
+}
+
+
+enum vector_status vector_truncate(struct vector *vector, uint32_t size) {
+    if (vector == NULL) {
+        return VECTOR_STATUS_INVALID_ARGUMENT;
+    }
+    if (size > vector->size) {
+        return VECTOR_STATUS_INVALID_INDEX;
+    }
+
+    vector->size = size;
+    return VECTOR_STATUS_SUCCESS;
+}
+
+
+struct vector_iterator vector_iterate(const struct vector *vector) {
+    return (struct vector_iterator) {
+        .vector = vector,
+        .index = 0
+    };
+}
+
+
+void *vector_iterator_next(struct vector_iterator *iterator) {
+    if (iterator == NULL) {
+        return NULL;
+    }
+
+    void *element = vector_at(iterator->vector, iterator->index);
+    if (element != NULL) {
+        iterator->index++;
+    }
+    return element;
+}